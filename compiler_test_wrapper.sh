@@ -5,9 +5,17 @@ set -euo pipefail
 type="$1"
 
 input_raw="$2"
+#anything after the input is passed on to the compiler
+compiler_args=("${@:3}")
 input="${input_raw%.*}"
-output_raw="$(basename ${input}).ir"
-output="${output_raw%.*}"
+output="$(basename ${input})"
+#parse tests only need to get through the compiler, the rest emit an object directly
+if [ $type == "parse" ]; then
+    output_raw="${output}.ir"
+else
+    output_raw="${output}.o"
+    compiler_args+=(--emit=obj)
+fi
 print_ast=false
 print_ir=false
 
@@ -18,19 +26,65 @@ if [ "$print_ast" = true ]; then
         -ex continue \
         -ex quit \
         --args \
-        ./compiler ${input_raw} ${output_raw}
+        ./compiler "${compiler_args[@]}" ${input_raw} ${output_raw}
+elif [ $type == "server" ]; then
+    #the same compile, sent as a request to a server reading stdin
+    response="$(echo "1 ${compiler_args[*]} ${input_raw} ${output_raw}" | ./compiler --server)"
+    if [ "$response" != "1 ok" ]; then
+        echo "${response}" >&2
+        exit 1
+    fi
+elif [ $type == "server_cache" ]; then
+    #the same compile sent 32 times at once to a server with as many workers,
+    #so they all store the same cache and incremental entries together
+    rm -rf ${output}.cache ${output}.incremental
+    for dir in cache incremental; do
+        requests=""
+        for i in $(seq 32); do
+            requests+="${i} --${dir/cache/cache-dir}=${output}.${dir} ${compiler_args[*]} ${input_raw} ${output}.${dir}.${i}.o"$'\n'
+        done
+        responses="$(printf '%s' "${requests}" | ./compiler --server -j 32 | sort -n | tr '\n' ' ')"
+        if [ "${responses}" != "$(seq 32 | sed 's/$/ ok/' | tr '\n' ' ')" ]; then
+            echo "${responses}" >&2
+            exit 1
+        fi
+        for i in $(seq 2 32); do
+            cmp ${output}.${dir}.1.o ${output}.${dir}.${i}.o
+        done
+        if [ -n "$(find ${output}.${dir} -name '*.tmp.*')" ]; then
+            echo "temporary files left in ${output}.${dir}" >&2
+            exit 1
+        fi
+    done
+    cp ${output}.cache.1.o ${output_raw}
+elif [ $type == "fail" ]; then
+    #the input's first line is `//error: line.column message`, and the
+    #compiler has to reject the input with that error at that place
+    expected="$(sed -n '1s|^//error: ||p' ${input_raw})"
+    if [ -z "${expected}" ]; then
+        echo "${input_raw} doesn't start with the error it expects" >&2
+        exit 1
+    fi
+    if ./compiler "${compiler_args[@]}" ${input_raw} ${output_raw} 2>${output}.err; then
+        echo "compiled, expected ${expected}" >&2
+        exit 1
+    fi
+    if ! grep -qF -- ":${expected}" ${output}.err; then
+        echo "expected ${expected}, got $(cat ${output}.err)" >&2
+        exit 1
+    fi
+    exit 0
 else
-    ./compiler ${input_raw} ${output_raw}
+    ./compiler "${compiler_args[@]}" ${input_raw} ${output_raw}
 fi
 
 if [ "$print_ir" = true ]; then
-    cat ${output_raw}
+    ./compiler "${compiler_args[@]}" --emit=ll ${input_raw} ${output}.ir
+    cat ${output}.ir
 fi
 
-if [ $type != "parse" ]; then
-    llc -filetype=obj ${output_raw} -o ${output}.o
-    if [ $type == "exe" ]; then
-        c++ ${input}.cc ${output}.o -o ${output}
-        ./${output}
-    fi
+if [ $type == "exe" ] || [ $type == "server" ] || [ $type == "server_cache" ]; then
+    #kernels with cpu for loops call into the runtime library, built next to the compiler
+    c++ ${input}.cc ${output_raw} -o ${output} -L. -lklrt -Wl,-rpath,"$(pwd)"
+    ./${output}
 fi
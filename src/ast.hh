@@ -6,12 +6,59 @@
 #include <optional>
 #include <memory>
 #include <variant>
+#include <tuple>
+#include <new>
 
 #include "types.hh"
 #include "location.hh"
 #include "registry.hh"
 
 namespace ast {
+    //non owning handle to a node in an ast::arena
+    template<typename T>
+    struct ptr {
+        T* p = nullptr;
+        T* operator->() const { return p; }
+        T& operator*() const { return *p; }
+        explicit operator bool() const { return p != nullptr; }
+    };
+
+    //nodes of one kind, bump allocated in fixed size chunks so they stay put
+    //and sit next to each other, and destroyed together with the pool
+    template<typename T>
+    class node_pool {
+    private:
+        static constexpr size_t chunk_size = 1024;
+        std::vector<T*> chunks;
+        size_t used = chunk_size;
+    public:
+        node_pool() = default;
+        node_pool(const node_pool&) = delete;
+        node_pool& operator=(const node_pool&) = delete;
+        ~node_pool() {
+            for (size_t c = 0; c < chunks.size(); c++) {
+                size_t n = c + 1 == chunks.size() ? used : chunk_size;
+                for (size_t i = 0; i < n; i++) {
+                    chunks[c][i].~T();
+                }
+                ::operator delete(chunks[c]);
+            }
+        }
+        template<typename ...Args>
+        T* make(Args&&... args) {
+            if (used == chunk_size) {
+                chunks.push_back(static_cast<T*>(::operator new(chunk_size * sizeof(T))));
+                used = 0;
+            }
+            T* t = new (&chunks.back()[used]) T{std::forward<Args>(args)...};
+            used++;
+            return t;
+        }
+        size_t size() const {
+            return chunks.empty() ? 0 : (chunks.size() - 1) * chunk_size + used;
+        }
+    };
+
     struct function_call;
     struct binary_operator;
     struct unary_operator;
@@ -35,17 +82,17 @@ namespace ast {
     struct accessor;
     struct expression {
         std::variant<
-            std::unique_ptr<ast::block>,
-            std::unique_ptr<ast::if_statement>,
-            std::unique_ptr<ast::for_loop>,
-            std::unique_ptr<ast::while_loop>,
-            std::unique_ptr<ast::switch_statement>,
-            std::unique_ptr<ast::accessor>,
+            ast::ptr<ast::block>,
+            ast::ptr<ast::if_statement>,
+            ast::ptr<ast::for_loop>,
+            ast::ptr<ast::while_loop>,
+            ast::ptr<ast::switch_statement>,
+            ast::ptr<ast::accessor>,
             ast::identifier,
-            ast::literal,
-            std::unique_ptr<ast::function_call>,
-            std::unique_ptr<ast::binary_operator>,
-            std::unique_ptr<ast::unary_operator>
+            ast::ptr<ast::literal>,
+            ast::ptr<ast::function_call>,
+            ast::ptr<ast::binary_operator>,
+            ast::ptr<ast::unary_operator>
         > expression;
         ast::named_type type;
         yy::location loc;
@@ -101,7 +148,8 @@ namespace ast {
     struct variable_def {
         std::optional<ast::named_type> explicit_type;
         ast::identifier identifier;
-        ast::expression expression;
+        //zero when left out, which needs an explicit type
+        std::optional<ast::expression> expression;
         yy::location loc;
     };
     struct while_loop {
@@ -138,6 +186,11 @@ namespace ast {
     struct accessor {
         ast::identifier identifier;
         std::vector<ast::access> fields;
+        //the variable's type, which the fields are looked up from
+        ast::named_type identifier_type;
+        //the last field is a reduction over a vector's lanes, like .sum, so
+        //the accessor is a value rather than a place in memory
+        bool reduction = false;
         ast::named_type type;
         yy::location loc;
     };
@@ -146,11 +199,34 @@ namespace ast {
         ast::expression expression;
         yy::location loc;
     };
+    //how a simd for loop's body is widened, a lane per iteration
+    struct simd {
+        //0 for the target's native width for the widest scalar in the body
+        size_t lanes = 0;
+        //the rest are filled in by typecheck
+        size_t widest_bits = 0;
+        uint64_t step = 1;
+    };
+    //how a cpu for loop's iterations are split between threads
+    struct cpu {
+        //iterations each thread takes at a time, 0 for the runtime to pick
+        uint64_t grain = 0;
+        //filled in by typecheck
+        uint64_t step = 1;
+    };
     struct for_loop {
+        //names the loop for schedules
+        std::optional<ast::identifier> label;
         ast::variable_def initial;
         ast::expression condition;
         ast::assignment step;
+        //only set by schedules, for loops whose step could take the variable
+        //past its type's largest value. the loop ends after an iteration
+        //this is true in, before the step wraps the variable around
+        std::optional<ast::expression> stop;
         ast::block block;
+        std::optional<ast::simd> simd;
+        std::optional<ast::cpu> cpu;
         ast::named_type type;
         yy::location loc;
     };
@@ -165,20 +241,83 @@ namespace ast {
     struct s_continue {
         yy::location loc;
     };
+    //one step of a schedule, which changes the order a function's loops run
+    //their iterations in but not what they compute
+    struct directive {
+        enum kind {
+            split, tile, reorder, vectorize, parallel, unroll,
+        } kind;
+        //labels of the loops it applies to, then of the loops it makes
+        std::vector<ast::identifier> loops;
+        //split factors, vector lanes, a grain or an unroll count
+        std::vector<uint64_t> factors;
+        yy::location loc;
+        std::string to_string() {
+            switch (kind) {
+                case split:     { return "split"; }
+                case tile:      { return "tile"; }
+                case reorder:   { return "reorder"; }
+                case vectorize: { return "vectorize"; }
+                case parallel:  { return "parallel"; }
+                case unroll:    { return "unroll"; }
+                default: assert(false);
+            }
+        }
+    };
+    //how the labelled loops of a function run, written apart from it
+    struct schedule {
+        ast::identifier function;
+        std::vector<ast::directive> directives;
+        yy::location loc;
+    };
     struct statement {
         std::variant<
             ast::expression,
-            ast::function_def,
-            ast::variable_def,
-            ast::type_def,
-            ast::assignment,
-            ast::s_return,
-            ast::s_break,
-            ast::s_continue
+            ast::ptr<ast::function_def>,
+            ast::ptr<ast::variable_def>,
+            ast::ptr<ast::type_def>,
+            ast::ptr<ast::assignment>,
+            ast::ptr<ast::s_return>,
+            ast::ptr<ast::s_break>,
+            ast::s_continue,
+            ast::ptr<ast::schedule>
         > statement;
     };
+    //owns every node reachable through an ast::ptr, and frees them all at once
+    struct arena {
+        std::tuple<
+            node_pool<ast::literal>,
+            node_pool<ast::block>,
+            node_pool<ast::if_statement>,
+            node_pool<ast::for_loop>,
+            node_pool<ast::while_loop>,
+            node_pool<ast::switch_statement>,
+            node_pool<ast::accessor>,
+            node_pool<ast::function_call>,
+            node_pool<ast::binary_operator>,
+            node_pool<ast::unary_operator>,
+            node_pool<ast::function_def>,
+            node_pool<ast::variable_def>,
+            node_pool<ast::type_def>,
+            node_pool<ast::assignment>,
+            node_pool<ast::s_return>,
+            node_pool<ast::s_break>,
+            node_pool<ast::schedule>
+        > pools;
+
+        template<typename T, typename ...Args>
+        ast::ptr<T> make(Args&&... args) {
+            return {std::get<node_pool<T>>(pools).make(std::forward<Args>(args)...)};
+        }
+        size_t size() const {
+            return std::apply([](auto&... pool) {
+                return (pool.size() + ...);
+            }, pools);
+        }
+    };
     struct program {
-        bi_registry<ast::identifier, std::string> symbols_registry;
+        std::unique_ptr<ast::arena> arena = std::make_unique<ast::arena>();
+        interner<ast::identifier> symbols_registry;
         statement_list statements;
     };
 }
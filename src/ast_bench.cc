@@ -0,0 +1,57 @@
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "bench.hh"
+#include "lexer.hh"
+#include "parser.hh"
+#include "typecheck.hh"
+
+static size_t allocations = 0;
+static size_t allocated_bytes = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    allocated_bytes += size;
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char *argv[]) {
+    size_t functions = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000;
+    std::string filename = write_temp_source("ast_bench", generate_functions(functions));
+
+    lexer_context lexer(filename);
+    parser_context parser(lexer);
+
+    size_t allocations_before = allocations;
+    size_t bytes_before = allocated_bytes;
+    bench_timer parse_timer;
+    auto program_ast = std::make_unique<ast::program>(parser.parse_program(filename));
+    double parse_s = parse_timer.seconds();
+    size_t parse_allocations = allocations - allocations_before;
+    size_t parse_bytes = allocated_bytes - bytes_before;
+
+    bench_timer typecheck_timer;
+    typecheck_context typecheck_context{program_ast->symbols_registry};
+    typecheck(typecheck_context, *program_ast);
+    double typecheck_s = typecheck_timer.seconds();
+
+    bench_timer free_timer;
+    program_ast.reset();
+    double free_s = free_timer.seconds();
+    std::remove(filename.c_str());
+
+    printf("%zu functions\n", functions);
+    printf("parse:     %.3f s, %zu allocations, %.1f MB\n", parse_s, parse_allocations, parse_bytes / 1e6);
+    printf("typecheck: %.3f s\n", typecheck_s);
+    printf("free:      %.3f s\n", free_s);
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <sys/resource.h>
+
+struct bench_timer {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+//a synthetic kernel file, shaped like the generated kernels we compile
+static std::string generate_functions(size_t functions) {
+    std::ostringstream s;
+    for (size_t f = 0; f < functions; f++) {
+        s << "// generated kernel " << f << "\n";
+        s << "export fn u32 kernel_" << f << "(u32 n, u32 seed) {\n";
+        s << "    var a = seed;\n";
+        s << "    var b = 1u32;\n";
+        s << "    for var i = 0u32; i < n; i = i + 1u32 {\n";
+        s << "        var t = b * 31u32 + a % 7u32;\n";
+        s << "        if t > 1000u32 { a = t - 1000u32; } else { a = t; };\n";
+        s << "        b = a ^ (t << 3u32);\n";
+        s << "    };\n";
+        s << "    return a + b;\n";
+        s << "};\n";
+    }
+    return s.str();
+}
+
+//one function with its body nested depth blocks deep
+static std::string generate_nested_blocks(size_t depth) {
+    std::ostringstream s;
+    s << "export fn u32 nested(u32 n) {\n";
+    s << "    var a = n;\n";
+    for (size_t d = 0; d < depth; d++) {
+        s << "if a > " << d << "u32 {\n";
+        s << "a = a - 1u32;\n";
+    }
+    for (size_t d = 0; d < depth; d++) {
+        s << "};\n";
+    }
+    s << "    return a;\n";
+    s << "};\n";
+    return s.str();
+}
+
+//one function returning a single expression of terms operands
+static std::string generate_long_expression(size_t terms) {
+    static const char* ops[] = {" + ", " * ", " ^ ", " - "};
+    std::ostringstream s;
+    s << "export fn u32 expression(u32 a, u32 b) {\n";
+    s << "    return a";
+    for (size_t t = 1; t < terms; t++) {
+        s << ops[t % 4] << "(b + " << t << "u32)";
+        if (t % 8 == 0) {
+            s << "\n";
+        }
+    }
+    s << ";\n";
+    s << "};\n";
+    return s.str();
+}
+
+//one function switching over cases values
+static std::string generate_switch(size_t cases) {
+    std::ostringstream s;
+    s << "export fn i32 switched(i32 n) {\n";
+    s << "    var a = n;\n";
+    s << "    switch n {\n";
+    for (size_t c = 0; c < cases; c++) {
+        s << "        case " << c << " { a = a * " << c % 13 + 2 << " + " << c << "; }\n";
+    }
+    s << "    };\n";
+    s << "    return a;\n";
+    s << "};\n";
+    return s.str();
+}
+
+//functions of 100 variables each, every one with a name of its own
+static std::string generate_identifiers(size_t identifiers) {
+    std::ostringstream s;
+    for (size_t f = 0; f * 100 < identifiers; f++) {
+        s << "export fn u32 identifiers_" << f << "(u32 n) {\n";
+        s << "    var value_" << f << "_0 = n;\n";
+        for (size_t i = 1; i < 100; i++) {
+            s << "    var value_" << f << "_" << i << " = value_" << f << "_" << i - 1 << " + " << i << "u32;\n";
+        }
+        s << "    return value_" << f << "_99;\n";
+        s << "};\n";
+    }
+    return s.str();
+}
+
+static std::string write_temp_source(const std::string& name, const std::string& source) {
+    std::string filename = std::string{P_tmpdir} + "/" + name + ".kl";
+    std::ofstream out(filename, std::ios::binary);
+    out << source;
+    return filename;
+}
+
+//starts a new peak resident set size measurement. linux resets the peak when
+//5 is written to clear_refs, elsewhere the peak stays the whole process's
+static void reset_peak_rss() {
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+static double peak_rss_mb() {
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::stod(line.substr(6)) / 1024;
+        }
+    }
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+}
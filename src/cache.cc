@@ -0,0 +1,92 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <llvm/Support/SHA1.h>
+#include <llvm/ADT/StringExtras.h>
+
+#include "cache.hh"
+#include "error.hh"
+#include "incremental.hh"
+
+compile_cache::compile_cache(std::string dir): dir(dir) {
+    if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+        error("error: couldn't create cache directory", dir);
+    }
+}
+
+std::string compile_cache::key(const std::vector<std::string>& options, std::string_view source) {
+    llvm::SHA1 sha1;
+    for (auto& option: options) {
+        //the terminators keep adjacent options from running into each other
+        sha1.update(llvm::StringRef(option.c_str(), option.size() + 1));
+    }
+    sha1.update(llvm::StringRef(source.data(), source.size()));
+    return llvm::toHex(sha1.final(), true);
+}
+
+static bool copy_file(const std::string& from, const std::string& to) {
+    std::ifstream in(from, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    std::ofstream out(to, std::ios::binary | std::ios::trunc);
+    out << in.rdbuf();
+    return static_cast<bool>(out.flush());
+}
+
+//hits and misses are kept in one file, updated under an exclusive lock
+static void update_stats(const std::string& dir, bool hit, compile_cache::statistics* read) {
+    int fd = open((dir + "/stats").c_str(), O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        return;
+    }
+    flock(fd, read ? LOCK_SH : LOCK_EX);
+    compile_cache::statistics stats;
+    char buffer[64] = {};
+    if (pread(fd, buffer, sizeof(buffer) - 1, 0) > 0) {
+        std::sscanf(buffer, "%zu %zu", &stats.hits, &stats.misses);
+    }
+    if (read) {
+        *read = stats;
+    } else {
+        (hit ? stats.hits : stats.misses)++;
+        int n = std::snprintf(buffer, sizeof(buffer), "%zu %zu\n", stats.hits, stats.misses);
+        if (pwrite(fd, buffer, n, 0) == n) {
+            ftruncate(fd, n);
+        }
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+bool compile_cache::fetch(const std::string& key, const std::string& filename) {
+    //entries are spread over subdirectories by the first byte of the key
+    bool hit = copy_file(dir + "/" + key.substr(0, 2) + "/" + key, filename);
+    update_stats(dir, hit, nullptr);
+    return hit;
+}
+
+void compile_cache::store(const std::string& key, const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    std::ostringstream data;
+    if (!(data << in.rdbuf())) {
+        return;
+    }
+    std::string subdir = dir + "/" + key.substr(0, 2);
+    mkdir(subdir.c_str(), 0777);
+    //server workers can store the same entry at once, and other processes
+    //should either see the whole entry or none of it
+    write_file_atomic(subdir + "/" + key, data.str());
+}
+
+compile_cache::statistics compile_cache::stats() {
+    statistics stats;
+    update_stats(dir, false, &stats);
+    return stats;
+}
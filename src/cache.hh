@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+//a directory of compiler outputs named by a hash of everything that went
+//into them, shared between compiler processes
+struct compile_cache {
+    std::string dir;
+
+    compile_cache(std::string dir);
+
+    //the hash of the source text together with every option that changes the output
+    std::string key(const std::vector<std::string>& options, std::string_view source);
+    //copies the cached output for key to filename, if there is one, and counts the hit or miss
+    bool fetch(const std::string& key, const std::string& filename);
+    //adds filename as the output for key
+    void store(const std::string& key, const std::string& filename);
+
+    struct statistics {
+        size_t hits = 0;
+        size_t misses = 0;
+    };
+    statistics stats();
+};
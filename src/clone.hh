@@ -0,0 +1,127 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <variant>
+#include <vector>
+
+#include "ast.hh"
+
+//a deep copy, for the bounds and bodies a schedule directive needs more
+//than once, and for compiling a program twice
+struct clone_fn {
+    ast::arena& arena;
+    //copy function definitions too, rather than sharing them
+    bool functions = false;
+
+    template<typename T>
+    ast::ptr<T> operator()(ast::ptr<T>& p) {
+        return arena.make<T>(std::invoke(*this, *p));
+    }
+    template<typename T>
+    std::optional<T> operator()(std::optional<T>& o) {
+        if (o) {
+            return std::invoke(*this, *o);
+        }
+        return std::nullopt;
+    }
+    template<typename T>
+    std::vector<T> operator()(std::vector<T>& v) {
+        std::vector<T> copy;
+        for (auto& t: v) {
+            copy.push_back(std::invoke(*this, t));
+        }
+        return copy;
+    }
+    template<typename ... Ts>
+    std::variant<Ts...> operator()(std::variant<Ts...>& v) {
+        return std::visit([this](auto& t) {
+            return std::variant<Ts...>{std::in_place_type<std::decay_t<decltype(t)>>, std::invoke(*this, t)};
+        }, v);
+    }
+
+    ast::statement operator()(ast::statement& statement) {
+        return {std::invoke(*this, statement.statement)};
+    }
+    ast::expression operator()(ast::expression& expression) {
+        return {std::invoke(*this, expression.expression), expression.type, expression.loc};
+    }
+    ast::block operator()(ast::block& block) {
+        return {std::invoke(*this, block.statements), block.type};
+    }
+    ast::if_statement operator()(ast::if_statement& if_statement) {
+        return {std::invoke(*this, if_statement.conditions), std::invoke(*this, if_statement.blocks),
+            if_statement.type, if_statement.loc};
+    }
+    ast::for_loop operator()(ast::for_loop& for_loop) {
+        return {for_loop.label, std::invoke(*this, for_loop.initial), std::invoke(*this, for_loop.condition),
+            std::invoke(*this, for_loop.step), std::invoke(*this, for_loop.stop), std::invoke(*this, for_loop.block),
+            for_loop.simd, for_loop.cpu, for_loop.type, for_loop.loc};
+    }
+    ast::while_loop operator()(ast::while_loop& while_loop) {
+        return {std::invoke(*this, while_loop.condition), std::invoke(*this, while_loop.block),
+            while_loop.type, while_loop.loc};
+    }
+    ast::switch_statement operator()(ast::switch_statement& switch_statement) {
+        ast::switch_statement copy {std::invoke(*this, switch_statement.expression), {},
+            switch_statement.type, switch_statement.loc};
+        for (auto& case_statement: switch_statement.cases) {
+            copy.cases.push_back({case_statement.cases, std::invoke(*this, case_statement.block), case_statement.type});
+        }
+        return copy;
+    }
+    ast::variable_def operator()(ast::variable_def& variable_def) {
+        return {variable_def.explicit_type, variable_def.identifier, std::invoke(*this, variable_def.expression),
+            variable_def.loc};
+    }
+    ast::assignment operator()(ast::assignment& assignment) {
+        return {std::invoke(*this, assignment.accessor), std::invoke(*this, assignment.expression), assignment.loc};
+    }
+    ast::accessor operator()(ast::accessor& accessor) {
+        return {accessor.identifier, std::invoke(*this, accessor.fields), accessor.identifier_type,
+            accessor.reduction, accessor.type, accessor.loc};
+    }
+    ast::function_call operator()(ast::function_call& function_call) {
+        return {function_call.identifier, std::invoke(*this, function_call.arguments), function_call.type,
+            function_call.loc};
+    }
+    ast::binary_operator operator()(ast::binary_operator& binary_operator) {
+        return {std::invoke(*this, binary_operator.l), std::invoke(*this, binary_operator.r),
+            binary_operator.binary_operator, binary_operator.type, binary_operator.loc};
+    }
+    ast::unary_operator operator()(ast::unary_operator& unary_operator) {
+        return {std::invoke(*this, unary_operator.r), unary_operator.unary_operator, unary_operator.type,
+            unary_operator.loc};
+    }
+    ast::s_return operator()(ast::s_return& s_return) {
+        return {std::invoke(*this, s_return.expression), s_return.loc};
+    }
+    ast::s_break operator()(ast::s_break& s_break) {
+        return {std::invoke(*this, s_break.expression), s_break.loc};
+    }
+    ast::literal operator()(ast::literal& literal) {
+        return literal;
+    }
+    ast::identifier operator()(ast::identifier identifier) {
+        return identifier;
+    }
+    ast::s_continue operator()(ast::s_continue& s_continue) {
+        return s_continue;
+    }
+    //shared rather than copied: types and schedules have no state, and
+    //unroll doesn't copy bodies that define functions
+    ast::ptr<ast::type_def> operator()(ast::ptr<ast::type_def>& type_def) {
+        return type_def;
+    }
+    ast::ptr<ast::function_def> operator()(ast::ptr<ast::function_def>& function_def) {
+        if (!functions) {
+            return function_def;
+        }
+        return arena.make<ast::function_def>(ast::function_def{function_def->to_export, function_def->identifier,
+            function_def->returntype, function_def->parameter_list, std::invoke(*this, function_def->block),
+            function_def->loc});
+    }
+    ast::ptr<ast::schedule> operator()(ast::ptr<ast::schedule>& schedule) {
+        return schedule;
+    }
+};
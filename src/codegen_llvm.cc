@@ -1,7 +1,11 @@
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
 #include <variant>
 #include <functional>
+#include <future>
+#include <thread>
+#include <mutex>
 
 #include <llvm/IR/Value.h>
 #include <llvm/IR/Module.h>
@@ -10,6 +14,7 @@
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/DIBuilder.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/IR/CFG.h>
 #include <llvm/ExecutionEngine/GenericValue.h>
 #include <llvm/Support/TargetRegistry.h>
 #include <llvm/Target/TargetOptions.h>
@@ -17,35 +22,183 @@
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/Host.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/GlobalIFunc.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
 
 #include <iostream>
 #include "ast.hh"
 #include "codegen_llvm.hh"
 #include "error.hh"
+#include "parallel.hh"
+#include "incremental.hh"
+#include "timing.hh"
+
+//the definition a user type names, following it through other user types
+static ast::type* find_type(codegen_context_llvm& context, ast::user_type user_type) {
+    for (codegen_context_llvm* c = &context; c; c = c->parent) {
+        if (ast::type** type = c->type_defs.find(user_type)) {
+            if (std::holds_alternative<ast::user_type>((*type)->type_)) {
+                return find_type(context, std::get<ast::user_type>((*type)->type_));
+            }
+            return *type;
+        }
+    }
+    return nullptr;
+}
+
+static size_t field_index(ast::field_list& fields, ast::identifier identifier) {
+    size_t i = 0;
+    while (fields[i].identifier != identifier) {
+        i++;
+    }
+    return i;
+}
+
+//like to_llvm_type, but with user types replaced by their definitions
+struct llvm_type_fn {
+    codegen_context_llvm& context;
+    llvm::Type* operator()(ast::named_type& named_type) {
+        return std::visit(*this, named_type.type);
+    }
+    llvm::Type* operator()(ast::type& type) {
+        return std::visit(*this, type.type_);
+    }
+    llvm::Type* operator()(ast::primitive_type primitive_type) {
+        return primitive_type.to_llvm_type(context.context);
+    }
+    llvm::Type* operator()(ast::buffer_type buffer_type) {
+        return buffer_type.to_llvm_type(context.context);
+    }
+    llvm::Type* operator()(ast::user_type user_type) {
+        ast::type* type = find_type(context, user_type);
+        assert(type);
+        return std::invoke(*this, *type);
+    }
+    llvm::Type* operator()(std::unique_ptr<ast::struct_type>& struct_type) {
+        std::vector<llvm::Type*> fields;
+        for (auto& field: struct_type->fields) {
+            fields.push_back(std::invoke(*this, field.type));
+        }
+        return llvm::StructType::get(context.context, fields);
+    }
+    llvm::Type* operator()(std::unique_ptr<ast::array_type>& array_type) {
+        llvm::Type* element = std::invoke(*this, array_type->element_type);
+        ast::layout layout = array_type->layout;
+        if (layout.value == ast::layout::aos) {
+            return llvm::ArrayType::get(element, array_type->length);
+        }
+        //an array per field, the whole length of them for soa or one block's for aosoa
+        std::vector<llvm::Type*> fields;
+        for (llvm::Type* field: llvm::cast<llvm::StructType>(element)->elements()) {
+            fields.push_back(llvm::ArrayType::get(field, layout.value == ast::layout::soa ? array_type->length : layout.block));
+        }
+        llvm::StructType* field_arrays = llvm::StructType::get(context.context, fields);
+        if (layout.value == ast::layout::soa) {
+            return field_arrays;
+        }
+        return llvm::ArrayType::get(field_arrays, (array_type->length + layout.block - 1) / layout.block);
+    }
+};
+
+static llvm::Type* llvm_type(codegen_context_llvm& context, ast::named_type type) {
+    return std::invoke(llvm_type_fn{context}, type);
+}
 
 static llvm::AllocaInst *
 CreateEntryBlockAlloca(
-codegen_context_llvm& context, const ast::identifier identifier, ast::type type
+codegen_context_llvm& context, const ast::identifier identifier, llvm::Type* type
 ) {
     llvm::BasicBlock* saved_bb = context.builder.GetInsertBlock();
     llvm::BasicBlock* entry_bb = context.current_function_entry;
     context.builder.SetInsertPoint(entry_bb, entry_bb->begin());
-    //TODO create allocas for aggregate types (structs, arrays)
-    llvm::AllocaInst* a = context.builder.CreateAlloca(type.to_llvm_type(context.context), 0, context.symbols_registry.get(identifier).c_str());
+    llvm::AllocaInst* a = context.builder.CreateAlloca(type, 0, context.symbols_registry.c_str(identifier));
     context.builder.SetInsertPoint(saved_bb);
     return a;
 }
 
-llvm::Value* accessor_access(codegen_context_llvm& context, ast::accessor& accessor) {
-    return *context.variable_scopes.find_item(accessor.identifier);
+static void start_unreachable_block(codegen_context_llvm& context) {
+    //code after a return, break or continue still needs a block to go in,
+    //rather than following the terminator in the same block
+    llvm::Function* f = context.builder.GetInsertBlock()->getParent();
+    context.builder.SetInsertPoint(llvm::BasicBlock::Create(context.context, "unreachable", f));
+}
+
+static llvm::Function* declare_function(codegen_context_llvm& context, ast::function_def& function_def) {
+    std::vector<llvm::Type*> parameter_types;
+    for (auto& param: function_def.parameter_list) {
+        if (param.type.is_buffer()) {
+            //passed as a pointer and length, as c would
+            llvm::StructType* buffer = llvm::cast<llvm::StructType>(llvm_type(context, param.type));
+            parameter_types.push_back(buffer->getElementType(0));
+            parameter_types.push_back(buffer->getElementType(1));
+        } else {
+            parameter_types.push_back(llvm_type(context, param.type));
+        }
+    }
+    llvm::FunctionType* ft = llvm::FunctionType::get(
+        llvm_type(context, function_def.returntype),
+        parameter_types,
+        false);
+    llvm::Function* f = llvm::Function::Create(
+        ft,
+        function_def.to_export || context.separate_modules ? llvm::Function::ExternalLinkage : llvm::Function::InternalLinkage,
+        context.symbols_registry.c_str(function_def.identifier), context.module.get());
+    auto arg = f->arg_begin();
+    for (auto& param: function_def.parameter_list) {
+        std::string name = context.symbols_registry.c_str(param.identifier);
+        (arg++)->setName(name);
+        if (param.type.is_buffer()) {
+            (arg++)->setName(name + "_length");
+        }
+    }
+    return f;
+}
+
+static llvm::Function* find_function(codegen_context_llvm& context, ast::identifier identifier) {
+    if (llvm::Function* f = context.module->getFunction(context.symbols_registry.c_str(identifier))) {
+        return f;
+    }
+    //defined in another chunk, so declare it in this module on first use
+    for (codegen_context_llvm* c = &context; c; c = c->parent) {
+        if (ast::function_def** function_def = c->function_defs.find(identifier)) {
+            return declare_function(context, **function_def);
+        }
+    }
+    return nullptr;
 }
 
 struct llvm_codegen_fn {
     codegen_context_llvm& context;
+    //while a simd for body is widened, array indices that differ between
+    //lanes are vectors, and so are the addresses they give
+    std::function<llvm::Value*(ast::expression&)> widened_index;
     llvm::Value* operator()(ast::program& program) {
+        //prototypes first, so functions can be called before their definition
+        for (auto& statement: program.statements) {
+            if (std::holds_alternative<ast::ptr<ast::function_def>>(statement.statement)) {
+                ast::function_def& function_def = *std::get<ast::ptr<ast::function_def>>(statement.statement);
+                context.function_defs.insert(function_def.identifier, &function_def);
+                declare_function(context, function_def);
+            } else if (std::holds_alternative<ast::ptr<ast::type_def>>(statement.statement)) {
+                std::invoke(*this, statement);
+            }
+        }
         context.variable_scopes.push_scope();
         for (auto& statement: program.statements) {
-            std::invoke(*this, statement);
+            if (std::holds_alternative<ast::ptr<ast::function_def>>(statement.statement)) {
+                define_function(*std::get<ast::ptr<ast::function_def>>(statement.statement));
+            } else {
+                std::invoke(*this, statement);
+            }
         }
         context.variable_scopes.pop_scope();
         return NULL;
@@ -53,7 +206,7 @@ struct llvm_codegen_fn {
     llvm::Value* operator()(ast::statement& statement) {
         return std::visit(*this, statement.statement);
     }
-    llvm::Value* operator()(std::unique_ptr<ast::block>& block) {
+    llvm::Value* operator()(ast::ptr<ast::block>& block) {
         return std::invoke(*this, *block);
     }
     llvm::Value* operator()(ast::block& block) {
@@ -65,7 +218,7 @@ struct llvm_codegen_fn {
         context.variable_scopes.pop_scope();
         return ret;
     }
-    llvm::Value* operator()(std::unique_ptr<ast::if_statement>& if_statement) {
+    llvm::Value* operator()(ast::ptr<ast::if_statement>& if_statement) {
         return std::invoke(*this, *if_statement);
     }
     llvm::Value* operator()(ast::if_statement& if_statement) {
@@ -94,7 +247,7 @@ struct llvm_codegen_fn {
         llvm::PHINode* phi = nullptr;
         if (!type.is_void()) {
             phi = context.builder.CreatePHI(
-                type.to_llvm_type(context.context),
+                llvm_type(context, type),
                 if_statement.blocks.size(), "phi");
         }
 
@@ -111,7 +264,7 @@ struct llvm_codegen_fn {
                 context.builder.SetInsertPoint(basic_blocks[i]);
                 llvm::Value* v = std::invoke(*this, if_statement.blocks[i]);
                 if (!type.is_void()) {
-                    phi->addIncoming(v, basic_blocks[i]);
+                    phi->addIncoming(v, context.builder.GetInsertBlock());
                 }
                 context.builder.CreateBr(merge_block);
             } else {
@@ -125,7 +278,7 @@ struct llvm_codegen_fn {
                 context.builder.SetInsertPoint(basic_blocks[i]);
                 llvm::Value* v = std::invoke(*this, if_statement.blocks[i]);
                 if (!type.is_void()) {
-                    phi->addIncoming(v, basic_blocks[i]);
+                    phi->addIncoming(v, context.builder.GetInsertBlock());
                 }
                 context.builder.CreateBr(merge_block);
             }
@@ -135,7 +288,7 @@ struct llvm_codegen_fn {
             context.builder.SetInsertPoint(basic_blocks.back());
             llvm::Value* v = std::invoke(*this, if_statement.blocks.back());
             if (!type.is_void()) {
-                phi->addIncoming(v, basic_blocks.back());
+                phi->addIncoming(v, context.builder.GetInsertBlock());
             }
             context.builder.CreateBr(merge_block);
         }
@@ -144,10 +297,16 @@ struct llvm_codegen_fn {
 
         return phi;
     }
-    llvm::Value* operator()(std::unique_ptr<ast::for_loop>& for_loop) {
+    llvm::Value* operator()(ast::ptr<ast::for_loop>& for_loop) {
         return std::invoke(*this, *for_loop);
     }
     llvm::Value* operator()(ast::for_loop& for_loop) {
+        if (for_loop.simd) {
+            return simd_for(for_loop);
+        }
+        if (for_loop.cpu) {
+            return cpu_for(for_loop);
+        }
         llvm::Function* f = context.builder.GetInsertBlock()->getParent();
         context.variable_scopes.push_scope();
         std::invoke(*this, for_loop.initial);
@@ -162,7 +321,7 @@ struct llvm_codegen_fn {
         if (!type.is_void()) {
             context.builder.SetInsertPoint(merge_bb);
             phi = context.builder.CreatePHI(
-                type.to_llvm_type(context.context),
+                llvm_type(context, type),
                 0, "forphi");
             context.current_loop_phi = phi;
         }
@@ -172,6 +331,14 @@ struct llvm_codegen_fn {
         if (!type.is_void()) {
             phi->addIncoming(v, context.builder.GetInsertBlock());
         }
+        if (for_loop.stop) {
+            llvm::BasicBlock* step_bb = llvm::BasicBlock::Create(context.context, "forstep", f);
+            context.builder.CreateCondBr(std::invoke(*this, *for_loop.stop), merge_bb, step_bb);
+            context.builder.SetInsertPoint(step_bb);
+            if (!type.is_void()) {
+                phi->addIncoming(v, step_bb);
+            }
+        }
         std::invoke(*this, for_loop.step);
         llvm::Value* cond = std::invoke(*this, for_loop.condition);
         context.variable_scopes.pop_scope();
@@ -180,7 +347,9 @@ struct llvm_codegen_fn {
 
         return phi;
     }
-    llvm::Value* operator()(std::unique_ptr<ast::while_loop>& while_loop) {
+    llvm::Value* simd_for(ast::for_loop& for_loop);
+    llvm::Value* cpu_for(ast::for_loop& for_loop);
+    llvm::Value* operator()(ast::ptr<ast::while_loop>& while_loop) {
         return std::invoke(*this, *while_loop);
     }
     llvm::Value* operator()(ast::while_loop& while_loop) {
@@ -196,7 +365,7 @@ struct llvm_codegen_fn {
         if (!type.is_void()) {
             context.builder.SetInsertPoint(merge_bb);
             phi = context.builder.CreatePHI(
-                type.to_llvm_type(context.context),
+                llvm_type(context, type),
                 0, "whilephi");
             context.current_loop_phi = phi;
         }
@@ -212,7 +381,7 @@ struct llvm_codegen_fn {
         }
         return phi;
     }
-    llvm::Value* operator()(std::unique_ptr<ast::switch_statement>& switch_statement) {
+    llvm::Value* operator()(ast::ptr<ast::switch_statement>& switch_statement) {
         return std::invoke(*this, *switch_statement);
     }
     llvm::Value* operator()(ast::switch_statement& switch_statement) {
@@ -234,7 +403,7 @@ struct llvm_codegen_fn {
         llvm::PHINode* phi {};
         if (!type.is_void()) {
             phi = context.builder.CreatePHI(
-                type.to_llvm_type(context.context),
+                llvm_type(context, type),
                 num_basic_cases, "phi");
         }
 
@@ -262,23 +431,19 @@ struct llvm_codegen_fn {
             return NULL;
         }
     }
+    llvm::Value* operator()(ast::ptr<ast::function_def>& function_def) {
+        return std::invoke(*this, *function_def);
+    }
     llvm::Value* operator()(ast::function_def& function_def) {
-        //prototype
-        std::vector<llvm::Type*> parameter_types;
-        for (auto& param: function_def.parameter_list) {
-            parameter_types.push_back(param.type.to_llvm_type(context.context));
-        }
-        llvm::FunctionType* ft = llvm::FunctionType::get(
-            function_def.returntype.to_llvm_type(context.context),
-            parameter_types,
-            false);
-        llvm::Function* f = llvm::Function::Create(
-            ft,
-            function_def.to_export ? llvm::Function::ExternalLinkage : llvm::Function::InternalLinkage,
-            context.symbols_registry.get(function_def.identifier), context.module.get());
-        size_t i = 0;
-        for (auto& arg: f->args()) {
-            arg.setName(context.symbols_registry.get(function_def.parameter_list[i++].identifier));
+        context.function_defs.insert(function_def.identifier, &function_def);
+        return define_function(function_def);
+    }
+    llvm::Function* define_function(ast::function_def& function_def) {
+        auto name = context.symbols_registry.get(function_def.identifier);
+        time_scope scope("codegen function", {name.data(), name.size()});
+        llvm::Function* f = find_function(context, function_def.identifier);
+        if (context.separate_modules && !function_def.to_export) {
+            context.internal_functions.push_back(function_def.identifier);
         }
 
         //body
@@ -287,33 +452,124 @@ struct llvm_codegen_fn {
         context.builder.SetInsertPoint(bb);
 
         context.variable_scopes.push_scope();
-        size_t j = 0;
-        for (auto& arg: f->args()) {
-            ast::parameter param = function_def.parameter_list[j++];
-            llvm::AllocaInst* alloca = CreateEntryBlockAlloca(context, param.identifier, param.type);
-            context.builder.CreateStore(&arg, alloca);
+        auto arg = f->arg_begin();
+        for (auto& param: function_def.parameter_list) {
+            llvm::Type* type = llvm_type(context, param.type);
+            llvm::Value* value = &*arg++;
+            if (param.type.is_buffer()) {
+                value = context.builder.CreateInsertValue(llvm::UndefValue::get(type), value, 0);
+                value = context.builder.CreateInsertValue(value, &*arg++, 1);
+            }
+            llvm::AllocaInst* alloca = CreateEntryBlockAlloca(context, param.identifier, type);
+            context.builder.CreateStore(value, alloca);
             context.variable_scopes.push_item(param.identifier, std::move(alloca));
         }
 
         std::invoke(*this, function_def.block);
         context.variable_scopes.pop_scope();
+        llvm::BasicBlock* last = context.builder.GetInsertBlock();
+        if (last != &f->getEntryBlock() && last->empty() && llvm::pred_empty(last)) {
+            last->eraseFromParent();
+        }
 
         llvm::verifyFunction(*f);
 
         return f;
     }
+    llvm::Value* operator()(ast::ptr<ast::type_def>& type_def) {
+        return std::invoke(*this, *type_def);
+    }
     llvm::Value* operator()(ast::type_def& type_def) {
-        //TODO
+        context.type_defs.insert(type_def.user_type, &type_def.type);
         return NULL;
     }
+    llvm::Value* index(ast::expression& index_expression) {
+        llvm::Value* index = widened_index ? widened_index(index_expression) : std::invoke(*this, index_expression);
+        llvm::Type* i64 = llvm::Type::getInt64Ty(context.context);
+        if (index->getType()->isVectorTy()) {
+            i64 = llvm::VectorType::get(i64, llvm::cast<llvm::VectorType>(index->getType())->getElementCount());
+        }
+        return context.builder.CreateIntCast(index, i64, index_expression.type.is_signed_integer(), "index");
+    }
+    //the address of the variable, or of the element or field after the first
+    //count fields, and its type
+    llvm::Value* accessor_access(ast::accessor& accessor, size_t count, ast::named_type& type) {
+        llvm::Value* address = *context.variable_scopes.find_item(accessor.identifier);
+        type = accessor.identifier_type;
+        llvm::Type* i64 = llvm::Type::getInt64Ty(context.context);
+        llvm::Value* zero = llvm::ConstantInt::get(i64, 0);
+        for (size_t i = 0; i < count; i++) {
+            auto& access = accessor.fields[i];
+            llvm::Type* aggregate = llvm_type(context, type);
+            if (type.is_vector()) {
+                //a lane, addressed through a pointer to the vector's elements
+                ast::primitive_type element = std::get<ast::primitive_type>(type.type).scalar();
+                llvm::Type* element_type = element.to_llvm_type(context.context);
+                llvm::Value* lanes = context.builder.CreateBitCast(address, element_type->getPointerTo(), "lanes");
+                address = context.builder.CreateInBoundsGEP(element_type, lanes, index(std::get<ast::array_access>(access)), "lane");
+                type = {element};
+                continue;
+            }
+            if (type.is_buffer()) {
+                if (std::holds_alternative<ast::field_access>(access)) {
+                    address = context.builder.CreateStructGEP(aggregate, address, 1, "length");
+                    type = {ast::primitive_type{ast::primitive_type::u64}};
+                    continue;
+                }
+                llvm::Value* element_index = index(std::get<ast::array_access>(access));
+                llvm::Value* data_address = context.builder.CreateStructGEP(aggregate, address, 0);
+                llvm::Value* data = context.builder.CreateLoad(data_address, "data");
+                type = {std::get<ast::buffer_type>(type.type).element_type};
+                address = context.builder.CreateInBoundsGEP(llvm_type(context, type), data, element_index, "element");
+                continue;
+            }
+            ast::type* definition = find_type(context, std::get<ast::user_type>(type.type));
+            if (std::holds_alternative<ast::field_access>(access)) {
+                auto& fields = std::get<std::unique_ptr<ast::struct_type>>(definition->type_)->fields;
+                size_t field = field_index(fields, std::get<ast::field_access>(access));
+                address = context.builder.CreateStructGEP(aggregate, address, field, context.symbols_registry.c_str(fields[field].identifier));
+                type = fields[field].type;
+                continue;
+            }
+            auto& array_type = std::get<std::unique_ptr<ast::array_type>>(definition->type_);
+            llvm::Value* element_index = index(std::get<ast::array_access>(access));
+            type = array_type->element_type;
+            if (array_type->layout.value == ast::layout::aos) {
+                address = context.builder.CreateInBoundsGEP(aggregate, address, {zero, element_index}, "element");
+                continue;
+            }
+            //the field after the index picks which field array the element is in
+            auto& fields = std::get<std::unique_ptr<ast::struct_type>>(find_type(context, std::get<ast::user_type>(type.type))->type_)->fields;
+            size_t field = field_index(fields, std::get<ast::field_access>(accessor.fields[++i]));
+            llvm::Value* field_value = llvm::ConstantInt::get(llvm::Type::getInt32Ty(context.context), field);
+            const char* name = context.symbols_registry.c_str(fields[field].identifier);
+            if (array_type->layout.value == ast::layout::soa) {
+                address = context.builder.CreateInBoundsGEP(aggregate, address, {zero, field_value, element_index}, name);
+            } else {
+                llvm::Value* block_size = llvm::ConstantInt::get(element_index->getType(), array_type->layout.block);
+                llvm::Value* block = context.builder.CreateUDiv(element_index, block_size, "block");
+                llvm::Value* lane = context.builder.CreateURem(element_index, block_size, "lane");
+                address = context.builder.CreateInBoundsGEP(aggregate, address, {zero, block, field_value, lane}, name);
+            }
+            type = fields[field].type;
+        }
+        return address;
+    }
+    llvm::Value* operator()(ast::ptr<ast::s_return>& s_return) {
+        return std::invoke(*this, *s_return);
+    }
     llvm::Value* operator()(ast::s_return& s_return) {
         if (s_return.expression) {
             context.builder.CreateRet(std::invoke(*this, *s_return.expression));
         } else {
             context.builder.CreateRetVoid();
         }
+        start_unreachable_block(context);
         return NULL;
     }
+    llvm::Value* operator()(ast::ptr<ast::s_break>& s_break) {
+        return std::invoke(*this, *s_break);
+    }
     llvm::Value* operator()(ast::s_break& s_break) {
         if (!context.current_loop_exit) {
             error(s_break.loc, "cannot call break statement outside of a loop body");
@@ -323,6 +579,7 @@ struct llvm_codegen_fn {
             context.current_loop_phi->addIncoming(v, context.builder.GetInsertBlock());
         }
         context.builder.CreateBr(context.current_loop_exit);
+        start_unreachable_block(context);
         return NULL;
     }
     llvm::Value* operator()(ast::s_continue& s_continue) {
@@ -330,17 +587,30 @@ struct llvm_codegen_fn {
             error(s_continue.loc, "cannot call continue statement outside of a loop body");
         }
         context.builder.CreateBr(context.current_loop_entry);
+        start_unreachable_block(context);
+        return NULL;
+    }
+    //applied to the ast before typecheck
+    llvm::Value* operator()(ast::ptr<ast::schedule>&) {
         return NULL;
     }
+    llvm::Value* operator()(ast::ptr<ast::variable_def>& variable_def) {
+        return std::invoke(*this, *variable_def);
+    }
     llvm::Value* operator()(ast::variable_def& variable_def) {
-        llvm::Value* value = std::invoke(*this, variable_def.expression);
-        llvm::AllocaInst* alloca = CreateEntryBlockAlloca(context, variable_def.identifier, variable_def.expression.type);
+        llvm::Type* type = llvm_type(context, variable_def.explicit_type ? *variable_def.explicit_type : variable_def.expression->type);
+        llvm::Value* value = variable_def.expression ? std::invoke(*this, *variable_def.expression) : llvm::Constant::getNullValue(type);
+        llvm::AllocaInst* alloca = CreateEntryBlockAlloca(context, variable_def.identifier, type);
         context.builder.CreateStore(value, alloca);
         context.variable_scopes.push_item(variable_def.identifier, std::move(alloca));
         return NULL;
     }
+    llvm::Value* operator()(ast::ptr<ast::assignment>& assignment) {
+        return std::invoke(*this, *assignment);
+    }
     llvm::Value* operator()(ast::assignment& assignment) {
-        llvm::Value* access = accessor_access(context, assignment.accessor);
+        ast::named_type type;
+        llvm::Value* access = accessor_access(assignment.accessor, assignment.accessor.fields.size(), type);
         llvm::Value* value = std::invoke(*this, assignment.expression);
         context.builder.CreateStore(value, access);
         return NULL;
@@ -351,7 +621,10 @@ struct llvm_codegen_fn {
     }
     llvm::Value* operator()(ast::identifier& identifier) {
         llvm::Value* variable = *context.variable_scopes.find_item(identifier);
-        return context.builder.CreateLoad(variable, context.symbols_registry.get(identifier).c_str());
+        return context.builder.CreateLoad(variable, context.symbols_registry.c_str(identifier));
+    }
+    llvm::Value* operator()(ast::ptr<ast::literal>& literal) {
+        return std::invoke(*this, *literal);
     }
     llvm::Value* operator()(ast::literal& literal) {
         struct literal_visitor {
@@ -372,56 +645,115 @@ struct llvm_codegen_fn {
                 }
             }
             llvm::Value* operator()(bool& x) {
-                return llvm::ConstantInt::get(llvm::Type::getInt1Ty(context.context), x);
+                return llvm::ConstantInt::get(type.to_llvm_type(context.context), x);
             }
         };
         return std::visit(literal_visitor{context, literal.type}, literal.literal);
     }
     llvm::Value* operator()(ast::accessor& accessor) {
-        llvm::Value* access = accessor_access(context, accessor);
+        ast::named_type type;
+        if (accessor.reduction) {
+            llvm::Value* access = accessor_access(accessor, accessor.fields.size() - 1, type);
+            llvm::Value* vector = context.builder.CreateLoad(access, "vector");
+            return reduce(vector, std::get<ast::primitive_type>(type.type), std::get<ast::field_access>(accessor.fields.back()));
+        }
+        llvm::Value* access = accessor_access(accessor, accessor.fields.size(), type);
         llvm::Value* value = context.builder.CreateLoad(access);
         return value;
     }
-    llvm::Value* operator()(std::unique_ptr<ast::accessor>& accessor) {
+    //combines the lanes with one operator, float sums and products in any order
+    llvm::Value* reduce(llvm::Value* vector, ast::primitive_type type, ast::identifier reduction) {
+        auto name = context.symbols_registry.get(reduction);
+        llvm::Type* scalar = type.scalar().to_llvm_type(context.context);
+        llvm::CallInst* v = nullptr;
+        if (name == "sum") {
+            v = type.is_float() ?
+                context.builder.CreateFAddReduce(llvm::ConstantFP::get(scalar, -0.0), vector) :
+                context.builder.CreateAddReduce(vector);
+        } else if (name == "product") {
+            v = type.is_float() ?
+                context.builder.CreateFMulReduce(llvm::ConstantFP::get(scalar, 1.0), vector) :
+                context.builder.CreateMulReduce(vector);
+        } else if (name == "min") {
+            v = type.is_float() ?
+                context.builder.CreateFPMinReduce(vector) :
+                context.builder.CreateIntMinReduce(vector, type.is_signed_integer());
+        } else if (name == "max") {
+            v = type.is_float() ?
+                context.builder.CreateFPMaxReduce(vector) :
+                context.builder.CreateIntMaxReduce(vector, type.is_signed_integer());
+        } else if (name == "and" || name == "all") {
+            v = context.builder.CreateAndReduce(vector);
+        } else if (name == "or" || name == "any") {
+            v = context.builder.CreateOrReduce(vector);
+        } else if (name == "xor") {
+            v = context.builder.CreateXorReduce(vector);
+        }
+        assert(v);
+        if (type.is_float()) {
+            v->setHasAllowReassoc(true);
+        }
+        return v;
+    }
+    llvm::Value* operator()(ast::ptr<ast::accessor>& accessor) {
         return std::invoke(*this, *accessor);
     }
-    llvm::Value* operator()(std::unique_ptr<ast::function_call>& function_call) {
-        llvm::Function* function = context.module->getFunction(context.symbols_registry.get(function_call->identifier));
+    llvm::Value* operator()(ast::ptr<ast::function_call>& function_call) {
+        llvm::Function* function = find_function(context, function_call->identifier);
         assert(function);
         std::vector<llvm::Value*> arguments;
         for (auto& arg: function_call->arguments) {
-            arguments.push_back(std::invoke(*this, arg));
+            llvm::Value* value = std::invoke(*this, arg);
+            if (arg.type.is_buffer()) {
+                arguments.push_back(context.builder.CreateExtractValue(value, 0));
+                arguments.push_back(context.builder.CreateExtractValue(value, 1));
+            } else {
+                arguments.push_back(value);
+            }
         }
         return context.builder.CreateCall(function, arguments, "calltmp");
     }
-    llvm::Value* operator()(std::unique_ptr<ast::binary_operator>& binary_operator) {
+    llvm::Value* operator()(ast::ptr<ast::binary_operator>& binary_operator) {
         llvm::Value* l = std::invoke(*this, binary_operator->l);
         llvm::Value* r = std::invoke(*this, binary_operator->r);
-        switch (binary_operator->binary_operator) {
+        //a scalar operand of a vector operator is broadcast to every lane
+        unsigned lanes = std::get<ast::primitive_type>(binary_operator->type.type).lanes;
+        if (binary_operator->l.type.is_vector() != binary_operator->r.type.is_vector()) {
+            if (binary_operator->l.type.is_vector()) {
+                r = context.builder.CreateVectorSplat(lanes, r, "broadcast");
+            } else {
+                l = context.builder.CreateVectorSplat(lanes, l, "broadcast");
+            }
+        }
+        return binary(*binary_operator, l, r);
+    }
+    //the operator on operands that are already the same type
+    llvm::Value* binary(ast::binary_operator& binary_operator, llvm::Value* l, llvm::Value* r) {
+        switch (binary_operator.binary_operator) {
             case ast::binary_operator::A_ADD:
-                if (l->getType()->isIntegerTy()) {
+                if (l->getType()->isIntOrIntVectorTy()) {
                     return context.builder.CreateAdd(l, r, "addtmp");
                 } else {
                     return context.builder.CreateFAdd(l, r, "addtmp");
                 }
                 break;
             case ast::binary_operator::A_SUB:
-                if (l->getType()->isIntegerTy()) {
+                if (l->getType()->isIntOrIntVectorTy()) {
                     return context.builder.CreateSub(l, r, "subtmp");
                 } else {
                     return context.builder.CreateFSub(l, r, "subtmp");
                 }
                 break;
             case ast::binary_operator::A_MUL:
-                if (l->getType()->isIntegerTy()) {
+                if (l->getType()->isIntOrIntVectorTy()) {
                     return context.builder.CreateMul(l, r, "multmp");
                 } else {
                     return context.builder.CreateFMul(l, r, "multmp");
                 }
                 break;
             case ast::binary_operator::A_DIV:
-                if (l->getType()->isIntegerTy()) {
-                    if (binary_operator->type.is_unsigned_integer()) {
+                if (l->getType()->isIntOrIntVectorTy()) {
+                    if (binary_operator.type.is_unsigned_integer()) {
                         return context.builder.CreateUDiv(l, r, "divtmp");
                     } else {
                         return context.builder.CreateSDiv(l, r, "divtmp");
@@ -431,8 +763,8 @@ struct llvm_codegen_fn {
                 }
                 break;
             case ast::binary_operator::A_MOD:
-                if (l->getType()->isIntegerTy()) {
-                    if (binary_operator->type.is_unsigned_integer()) {
+                if (l->getType()->isIntOrIntVectorTy()) {
+                    if (binary_operator.type.is_unsigned_integer()) {
                         return context.builder.CreateURem(l, r, "modtmp");
                     } else {
                         return context.builder.CreateSRem(l, r, "modtmp");
@@ -456,20 +788,21 @@ struct llvm_codegen_fn {
             case ast::binary_operator::L_OR:
                 return context.builder.CreateOr(l, r, "lortmp");
             case ast::binary_operator::C_EQ:
-                if (l->getType()->isIntegerTy()) {
+                if (l->getType()->isIntOrIntVectorTy()) {
                     return context.builder.CreateICmpEQ(l, r, "eqtmp");
                 } else {
                     return context.builder.CreateFCmpUEQ(l, r, "eqtmp");
                 }
             case ast::binary_operator::C_NE:
-                if (l->getType()->isIntegerTy()) {
+                if (l->getType()->isIntOrIntVectorTy()) {
                     return context.builder.CreateICmpNE(l, r, "netmp");
                 } else {
                     return context.builder.CreateFCmpUNE(l, r, "netmp");
                 }
+            //the operator's own type is bool, the operands decide the signedness
             case ast::binary_operator::C_GT:
-                if (l->getType()->isIntegerTy()) {
-                    if (binary_operator->type.is_unsigned_integer()) {
+                if (l->getType()->isIntOrIntVectorTy()) {
+                    if (binary_operator.l.type.is_unsigned_integer()) {
                         return context.builder.CreateICmpUGT(l, r, "getmp");
                     } else {
                         return context.builder.CreateICmpSGT(l, r, "getmp");
@@ -478,8 +811,8 @@ struct llvm_codegen_fn {
                     return context.builder.CreateFCmpUGT(l, r, "gttmp");
                 }
             case ast::binary_operator::C_GE:
-                if (l->getType()->isIntegerTy()) {
-                    if (binary_operator->type.is_unsigned_integer()) {
+                if (l->getType()->isIntOrIntVectorTy()) {
+                    if (binary_operator.l.type.is_unsigned_integer()) {
                         return context.builder.CreateICmpUGE(l, r, "getmp");
                     } else {
                         return context.builder.CreateICmpSGE(l, r, "getmp");
@@ -488,8 +821,8 @@ struct llvm_codegen_fn {
                     return context.builder.CreateFCmpUGE(l, r, "getmp");
                 }
             case ast::binary_operator::C_LT:
-                if (l->getType()->isIntegerTy()) {
-                    if (binary_operator->type.is_unsigned_integer()) {
+                if (l->getType()->isIntOrIntVectorTy()) {
+                    if (binary_operator.l.type.is_unsigned_integer()) {
                         return context.builder.CreateICmpULT(l, r, "getmp");
                     } else {
                         return context.builder.CreateICmpSLT(l, r, "getmp");
@@ -498,8 +831,8 @@ struct llvm_codegen_fn {
                     return context.builder.CreateFCmpULT(l, r, "lttmp");
                 }
             case ast::binary_operator::C_LE:
-                if (l->getType()->isIntegerTy()) {
-                    if (binary_operator->type.is_unsigned_integer()) {
+                if (l->getType()->isIntOrIntVectorTy()) {
+                    if (binary_operator.l.type.is_unsigned_integer()) {
                         return context.builder.CreateICmpULE(l, r, "getmp");
                     } else {
                         return context.builder.CreateICmpSLE(l, r, "getmp");
@@ -510,7 +843,7 @@ struct llvm_codegen_fn {
         }
         assert(false);
     }
-    llvm::Value* operator()(std::unique_ptr<ast::unary_operator>& unary_operator) {
+    llvm::Value* operator()(ast::ptr<ast::unary_operator>& unary_operator) {
         llvm::Value* r = std::invoke(*this, unary_operator->r);
         uint64_t ones = -1;
         uint64_t one = 1;
@@ -527,16 +860,889 @@ struct llvm_codegen_fn {
     }
 };
 
-void codegen_llvm(codegen_context_llvm &context, ast::program &program, const std::string& src_filename, const std::string& ir_filename) {
-    context.module = std::make_unique<llvm::Module>(src_filename, context.context);
+//whether a value in a simd for body can differ between lanes, which it can
+//if it uses a variable with a value per lane
+struct llvm_varying_fn {
+    codegen_context_llvm& context;
+    const std::unordered_set<llvm::Value*>& lane_variables;
+    bool variable(ast::identifier identifier) {
+        auto v = context.variable_scopes.find_item(identifier);
+        return v && lane_variables.count(v->get());
+    }
+    bool operator()(ast::statement& statement) {
+        return std::visit(*this, statement.statement);
+    }
+    bool operator()(ast::expression& expression) {
+        return std::visit(*this, expression.expression);
+    }
+    bool operator()(ast::ptr<ast::block>& block) {
+        return std::invoke(*this, *block);
+    }
+    bool operator()(ast::block& block) {
+        for (auto& statement: block.statements) {
+            if (std::invoke(*this, statement)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    bool operator()(ast::ptr<ast::if_statement>& if_statement) {
+        for (auto& condition: if_statement->conditions) {
+            if (std::invoke(*this, condition)) {
+                return true;
+            }
+        }
+        for (auto& block: if_statement->blocks) {
+            if (std::invoke(*this, block)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    bool operator()(ast::ptr<ast::accessor>& accessor) {
+        if (variable(accessor->identifier)) {
+            return true;
+        }
+        for (auto& access: accessor->fields) {
+            if (std::holds_alternative<ast::array_access>(access) && std::invoke(*this, std::get<ast::array_access>(access))) {
+                return true;
+            }
+        }
+        return false;
+    }
+    bool operator()(ast::identifier& identifier) {
+        return variable(identifier);
+    }
+    bool operator()(ast::ptr<ast::literal>&) {
+        return false;
+    }
+    bool operator()(ast::ptr<ast::binary_operator>& binary_operator) {
+        return std::invoke(*this, binary_operator->l) || std::invoke(*this, binary_operator->r);
+    }
+    bool operator()(ast::ptr<ast::unary_operator>& unary_operator) {
+        return std::invoke(*this, unary_operator->r);
+    }
+    //definitions and assignments in the body are always widened. typecheck
+    //doesn't let loops, calls and the like into a simd for body
+    template<typename T>
+    bool operator()(T&) {
+        return true;
+    }
+};
+
+//widens a simd for loop's body so each lane runs one iteration. values that
+//are the same in every lane are left to codegen as scalars, and broadcast
+//where they meet a vector
+struct llvm_simd_fn {
+    llvm_codegen_fn& codegen;
+    codegen_context_llvm& context;
+    unsigned lanes;
+    uint64_t step;
+    llvm::Value* induction;
+    //the loop variable, and the vectors of variables defined in the body
+    std::unordered_set<llvm::Value*> lane_variables;
+    //the lanes running the current block of an if statement, null for all of them
+    llvm::Value* mask = nullptr;
+
+    bool varying(ast::expression& expression) {
+        return std::invoke(llvm_varying_fn{context, lane_variables}, expression);
+    }
+    //a vector, or a scalar if it's the same in every lane
+    llvm::Value* value(ast::expression& expression) {
+        return varying(expression) ? std::invoke(*this, expression) : std::invoke(codegen, expression);
+    }
+    llvm::Value* broadcast(llvm::Value* value) {
+        return !value || value->getType()->isVectorTy() ? value : context.builder.CreateVectorSplat(lanes, value, "broadcast");
+    }
+    llvm::Value* vector(ast::expression& expression) {
+        return broadcast(value(expression));
+    }
+    llvm::Value* active() {
+        return mask ? mask : llvm::Constant::getAllOnesValue(llvm::VectorType::get(llvm::Type::getInt1Ty(context.context), lanes, false));
+    }
+    //lanes' elements are aligned as a scalar's would be
+    unsigned alignment(llvm::Type* type) {
+        return context.module->getDataLayout().getABITypeAlignment(type->getScalarType());
+    }
+    bool induction_variable(ast::expression& expression) {
+        ast::identifier identifier;
+        if (auto* accessor = std::get_if<ast::ptr<ast::accessor>>(&expression.expression)) {
+            if (!(*accessor)->fields.empty()) {
+                return false;
+            }
+            identifier = (*accessor)->identifier;
+        } else if (std::holds_alternative<ast::identifier>(expression.expression)) {
+            identifier = std::get<ast::identifier>(expression.expression);
+        } else {
+            return false;
+        }
+        return *context.variable_scopes.find_item(identifier) == induction;
+    }
+    //the loop variable, plus or minus something the same in every lane
+    bool consecutive_index(ast::expression& index) {
+        if (induction_variable(index)) {
+            return true;
+        }
+        auto* b = std::get_if<ast::ptr<ast::binary_operator>>(&index.expression);
+        if (!b) {
+            return false;
+        }
+        if ((*b)->binary_operator == ast::binary_operator::A_ADD) {
+            return (induction_variable((*b)->l) && !varying((*b)->r)) || (induction_variable((*b)->r) && !varying((*b)->l));
+        }
+        return (*b)->binary_operator == ast::binary_operator::A_SUB && induction_variable((*b)->l) && !varying((*b)->r);
+    }
+    //whether each lane's element is the one after the lane before's, so the
+    //lanes can be loaded or stored as one vector
+    bool consecutive(ast::accessor& accessor) {
+        if (step != 1) {
+            return false;
+        }
+        ast::named_type type = accessor.identifier_type;
+        bool found = false;
+        for (size_t i = 0; i < accessor.fields.size(); i++) {
+            auto& access = accessor.fields[i];
+            if (std::holds_alternative<ast::field_access>(access)) {
+                auto& fields = std::get<std::unique_ptr<ast::struct_type>>(find_type(context, std::get<ast::user_type>(type.type))->type_)->fields;
+                type = fields[field_index(fields, std::get<ast::field_access>(access))].type;
+                continue;
+            }
+            ast::layout::e layout = ast::layout::aos;
+            ast::named_type element;
+            if (type.is_buffer()) {
+                element = {std::get<ast::buffer_type>(type.type).element_type};
+            } else {
+                auto& array_type = std::get<std::unique_ptr<ast::array_type>>(find_type(context, std::get<ast::user_type>(type.type))->type_);
+                layout = array_type->layout.value;
+                element = array_type->element_type;
+            }
+            ast::expression& index = std::get<ast::array_access>(access);
+            if (varying(index)) {
+                if (found || !consecutive_index(index)) {
+                    return false;
+                }
+                found = true;
+                //an aos element is a whole struct apart from the next, and so is an aosoa one at the end of a block
+                size_t rest = accessor.fields.size() - i - 1;
+                if (!(layout == ast::layout::aos ? rest == 0 : layout == ast::layout::soa && rest == 1)) {
+                    return false;
+                }
+            }
+            type = element;
+        }
+        return found;
+    }
+    //the first lane's element as a pointer to a vector, or else a vector of each lane's element
+    llvm::Value* element_address(ast::accessor& accessor, bool& contiguous, llvm::Type* vector_type) {
+        ast::named_type type;
+        contiguous = consecutive(accessor);
+        if (contiguous) {
+            auto widened_index = std::exchange(codegen.widened_index, nullptr);
+            llvm::Value* first = codegen.accessor_access(accessor, accessor.fields.size(), type);
+            codegen.widened_index = widened_index;
+            return context.builder.CreateBitCast(first, vector_type->getPointerTo(), "lanes");
+        }
+        auto widened_index = std::exchange(codegen.widened_index, [this](ast::expression& index) {
+            return value(index);
+        });
+        llvm::Value* addresses = codegen.accessor_access(accessor, accessor.fields.size(), type);
+        codegen.widened_index = widened_index;
+        return addresses;
+    }
+    //the loop variable of each lane's iteration
+    llvm::Value* lane_indices() {
+        llvm::Value* first = context.builder.CreateLoad(induction, "first");
+        std::vector<llvm::Constant*> offsets;
+        for (unsigned lane = 0; lane < lanes; lane++) {
+            offsets.push_back(llvm::ConstantInt::get(first->getType(), lane * step));
+        }
+        return context.builder.CreateAdd(broadcast(first), llvm::ConstantVector::get(offsets), "lanes");
+    }
+
+    llvm::Value* statement(ast::statement& statement) {
+        if (std::holds_alternative<ast::expression>(statement.statement)) {
+            return value(std::get<ast::expression>(statement.statement));
+        }
+        return std::visit(*this, statement.statement);
+    }
+    llvm::Value* operator()(ast::expression& expression) {
+        return std::visit(*this, expression.expression);
+    }
+    llvm::Value* operator()(ast::ptr<ast::block>& block) {
+        return std::invoke(*this, *block);
+    }
+    llvm::Value* operator()(ast::block& block) {
+        llvm::Value* ret = nullptr;
+        context.variable_scopes.push_scope();
+        for (auto& statement: block.statements) {
+            ret = this->statement(statement);
+        }
+        context.variable_scopes.pop_scope();
+        return ret;
+    }
+    llvm::Value* operator()(ast::ptr<ast::if_statement>& if_statement) {
+        //every block runs, on the lanes whose condition picks it
+        llvm::Value* outer = mask;
+        llvm::Value* remaining = active();
+        std::vector<llvm::Value*> masks;
+        std::vector<llvm::Value*> values;
+        for (size_t i = 0; i < if_statement->blocks.size(); i++) {
+            llvm::Value* taken = remaining;
+            if (i < if_statement->conditions.size()) {
+                mask = remaining;
+                llvm::Value* condition = vector(if_statement->conditions[i]);
+                taken = context.builder.CreateAnd(remaining, condition, "taken");
+                remaining = context.builder.CreateAnd(remaining, context.builder.CreateNot(condition), "remaining");
+            }
+            mask = taken;
+            masks.push_back(taken);
+            values.push_back(broadcast(std::invoke(*this, if_statement->blocks[i])));
+        }
+        mask = outer;
+        if (if_statement->type.is_void()) {
+            return nullptr;
+        }
+        llvm::Value* v = if_statement->blocks.size() > if_statement->conditions.size() ?
+            values.back() : llvm::UndefValue::get(values.front()->getType());
+        for (size_t i = if_statement->conditions.size(); i-- > 0;) {
+            v = context.builder.CreateSelect(masks[i], values[i], v);
+        }
+        return v;
+    }
+    llvm::Value* operator()(ast::ptr<ast::type_def>& type_def) {
+        return std::invoke(codegen, type_def);
+    }
+    llvm::Value* operator()(ast::ptr<ast::variable_def>& variable_def) {
+        ast::named_type type = variable_def->explicit_type ? *variable_def->explicit_type : variable_def->expression->type;
+        llvm::Type* vector_type = llvm::VectorType::get(llvm_type(context, type), lanes, false);
+        llvm::Value* v = variable_def->expression ? vector(*variable_def->expression) : llvm::Constant::getNullValue(vector_type);
+        llvm::AllocaInst* alloca = CreateEntryBlockAlloca(context, variable_def->identifier, vector_type);
+        context.builder.CreateStore(v, alloca);
+        lane_variables.insert(alloca);
+        context.variable_scopes.push_item(variable_def->identifier, std::move(alloca));
+        return nullptr;
+    }
+    llvm::Value* operator()(ast::ptr<ast::assignment>& assignment) {
+        llvm::Value* variable = *context.variable_scopes.find_item(assignment->accessor.identifier);
+        if (lane_variables.count(variable)) {
+            llvm::Value* v = vector(assignment->expression);
+            if (mask) {
+                llvm::Value* old = context.builder.CreateLoad(variable);
+                v = context.builder.CreateSelect(mask, v, old);
+            }
+            context.builder.CreateStore(v, variable);
+            return nullptr;
+        }
+        llvm::Type* vector_type = llvm::VectorType::get(llvm_type(context, assignment->expression.type), lanes, false);
+        bool contiguous;
+        llvm::Value* address = element_address(assignment->accessor, contiguous, vector_type);
+        llvm::Value* v = vector(assignment->expression);
+        llvm::Value* lanes_mask = active();
+        unsigned align = alignment(vector_type);
+        if (contiguous) {
+            context.builder.CreateMaskedStore(v, address, align, lanes_mask);
+        } else {
+            context.builder.CreateMaskedScatter(v, address, align, lanes_mask);
+        }
+        return nullptr;
+    }
+    llvm::Value* operator()(ast::identifier& identifier) {
+        llvm::Value* variable = *context.variable_scopes.find_item(identifier);
+        if (variable == induction) {
+            return lane_indices();
+        }
+        return context.builder.CreateLoad(variable, context.symbols_registry.c_str(identifier));
+    }
+    llvm::Value* operator()(ast::ptr<ast::accessor>& accessor) {
+        llvm::Value* variable = *context.variable_scopes.find_item(accessor->identifier);
+        if (variable == induction) {
+            return lane_indices();
+        }
+        if (lane_variables.count(variable)) {
+            return context.builder.CreateLoad(variable, context.symbols_registry.c_str(accessor->identifier));
+        }
+        llvm::Type* vector_type = llvm::VectorType::get(llvm_type(context, accessor->type), lanes, false);
+        bool contiguous;
+        llvm::Value* address = element_address(*accessor, contiguous, vector_type);
+        llvm::Value* lanes_mask = active();
+        unsigned align = alignment(vector_type);
+        if (contiguous) {
+            return context.builder.CreateMaskedLoad(address, align, lanes_mask);
+        }
+        return context.builder.CreateMaskedGather(address, align, lanes_mask);
+    }
+    llvm::Value* operator()(ast::ptr<ast::binary_operator>& binary_operator) {
+        llvm::Value* l = vector(binary_operator->l);
+        llvm::Value* r = vector(binary_operator->r);
+        auto op = binary_operator->binary_operator;
+        if (mask && (op == ast::binary_operator::A_DIV || op == ast::binary_operator::A_MOD) && r->getType()->isIntOrIntVectorTy()) {
+            //lanes that aren't running could divide by zero
+            r = context.builder.CreateSelect(mask, r, llvm::ConstantInt::get(r->getType(), 1));
+        }
+        return codegen.binary(*binary_operator, l, r);
+    }
+    llvm::Value* operator()(ast::ptr<ast::unary_operator>& unary_operator) {
+        return context.builder.CreateNot(vector(unary_operator->r), "nottmp");
+    }
+    //typecheck doesn't let the rest into a simd for body, or only where
+    //they're the same in every lane
+    template<typename T>
+    llvm::Value* operator()(T&) {
+        assert(false);
+        return nullptr;
+    }
+};
+
+//lanes of the widest vector register the target has, for scalars of bits
+static size_t native_lanes(codegen_context_llvm& context, llvm::Function* f, size_t bits) {
+    //chunks share the top level context's target machine, which caches subtargets
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    codegen_context_llvm* c = &context;
+    while (!c->target_machine) {
+        c = c->parent;
+    }
+    unsigned width = c->target_machine->getTargetTransformInfo(*f).getRegisterBitWidth(true);
+    return std::clamp<size_t>(width / bits, 2, 64);
+}
+
+//marks a loop llvm shouldn't vectorize again
+static llvm::MDNode* vectorized_loop(codegen_context_llvm& context) {
+    llvm::Metadata* vectorized[] = {
+        llvm::MDString::get(context.context, "llvm.loop.isvectorized"),
+        llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(llvm::Type::getInt32Ty(context.context), 1)),
+    };
+    llvm::Metadata* loop[] = {nullptr, llvm::MDNode::get(context.context, vectorized)};
+    llvm::MDNode* node = llvm::MDNode::getDistinct(context.context, loop);
+    node->replaceOperandWith(0, node);
+    return node;
+}
+
+llvm::Value* llvm_codegen_fn::simd_for(ast::for_loop& for_loop) {
+    //a vector loop runs while every lane's iteration would pass the
+    //condition, then the scalar loop runs the iterations left over
+    ast::simd& simd = *for_loop.simd;
+    llvm::Function* f = context.builder.GetInsertBlock()->getParent();
+    context.variable_scopes.push_scope();
+    std::invoke(*this, for_loop.initial);
+    llvm::Value* induction = *context.variable_scopes.find_item(for_loop.initial.identifier);
+    ast::binary_operator& condition = *std::get<ast::ptr<ast::binary_operator>>(for_loop.condition.expression);
+    llvm::Value* start = context.builder.CreateLoad(induction, "start");
+    //the body can't change the bound, so it's only worked out once
+    llvm::Value* end = std::invoke(*this, condition.r);
+    size_t lanes = simd.lanes ? simd.lanes : native_lanes(context, f, simd.widest_bits);
+    //how far past the first lane's the last lane's loop variable is, and
+    //the first past the end for <
+    uint64_t span = (lanes - 1) * simd.step + (condition.binary_operator == ast::binary_operator::C_LT ? 1 : 0);
 
-    llvm::InitializeAllTargetInfos();
-    llvm::InitializeAllTargets();
-    llvm::InitializeAllTargetMCs();
-    llvm::InitializeAllAsmParsers();
-    llvm::InitializeAllAsmPrinters();
+    llvm::BasicBlock* check_bb = llvm::BasicBlock::Create(context.context, "simdcheck", f);
+    llvm::BasicBlock* body_bb = llvm::BasicBlock::Create(context.context, "simdbody", f);
+    llvm::BasicBlock* rest_bb = llvm::BasicBlock::Create(context.context, "simdrest", f);
+    llvm::BasicBlock* loop_bb = llvm::BasicBlock::Create(context.context, "forloop", f);
+    llvm::BasicBlock* merge_bb = llvm::BasicBlock::Create(context.context, "formerge", f);
+    context.builder.CreateBr(check_bb);
+
+    context.builder.SetInsertPoint(check_bb);
+    llvm::Value* i = context.builder.CreateLoad(induction, "i");
+    llvm::Value* room = context.builder.CreateICmpUGE(context.builder.CreateSub(end, i), llvm::ConstantInt::get(i->getType(), span));
+    llvm::Value* full = context.builder.CreateAnd(binary(condition, i, end), room, "full");
+    context.builder.CreateCondBr(full, body_bb, rest_bb);
+
+    context.builder.SetInsertPoint(body_bb);
+    llvm_simd_fn widen{*this, context, static_cast<unsigned>(lanes), simd.step, induction, {induction}};
+    std::invoke(widen, for_loop.block);
+    llvm::Value* next = context.builder.CreateLoad(induction);
+    next = context.builder.CreateAdd(next, llvm::ConstantInt::get(next->getType(), lanes * simd.step));
+    context.builder.CreateStore(next, induction);
+    context.builder.CreateBr(check_bb)->setMetadata(llvm::LLVMContext::MD_loop, vectorized_loop(context));
+
+    //the scalar loop runs at least once like any for loop, unless the vector loop already has
+    context.builder.SetInsertPoint(rest_bb);
+    i = context.builder.CreateLoad(induction, "i");
+    llvm::Value* first = context.builder.CreateICmpEQ(i, start, "first");
+    llvm::Value* cond = std::invoke(*this, for_loop.condition);
+    context.builder.CreateCondBr(context.builder.CreateOr(first, cond), loop_bb, merge_bb);
+
+    context.builder.SetInsertPoint(loop_bb);
+    context.current_loop_entry = loop_bb;
+    context.current_loop_exit = merge_bb;
+    std::invoke(*this, for_loop.block);
+    if (for_loop.stop) {
+        llvm::BasicBlock* step_bb = llvm::BasicBlock::Create(context.context, "forstep", f);
+        context.builder.CreateCondBr(std::invoke(*this, *for_loop.stop), merge_bb, step_bb);
+        context.builder.SetInsertPoint(step_bb);
+    }
+    std::invoke(*this, for_loop.step);
+    cond = std::invoke(*this, for_loop.condition);
+    context.builder.CreateCondBr(cond, loop_bb, merge_bb)->setMetadata(llvm::LLVMContext::MD_loop, vectorized_loop(context));
+    context.builder.SetInsertPoint(merge_bb);
+    context.variable_scopes.pop_scope();
+    return nullptr;
+}
+
+//klrt_parallel_for from the runtime, which calls body(captures, first, last)
+//on its threads for ranges of the iterations 0 to count
+static llvm::FunctionCallee parallel_for_function(codegen_context_llvm& context) {
+    llvm::Type* void_type = llvm::Type::getVoidTy(context.context);
+    llvm::Type* i64 = llvm::Type::getInt64Ty(context.context);
+    llvm::Type* i8p = llvm::Type::getInt8PtrTy(context.context);
+    llvm::FunctionType* body_type = llvm::FunctionType::get(void_type, {i8p, i64, i64}, false);
+    return context.module->getOrInsertFunction("klrt_parallel_for",
+        llvm::FunctionType::get(void_type, {i64, i64, body_type->getPointerTo(), i8p}, false));
+}
+
+llvm::Value* llvm_codegen_fn::cpu_for(ast::for_loop& for_loop) {
+    //the body is outlined into a function running a range of iterations,
+    //which the runtime calls on its threads. it uses variables from outside
+    //the loop through their addresses, passed in an array
+    ast::cpu& cpu = *for_loop.cpu;
+    llvm::Function* f = context.builder.GetInsertBlock()->getParent();
+    llvm::Type* i64 = llvm::Type::getInt64Ty(context.context);
+    llvm::Type* i8p = llvm::Type::getInt8PtrTy(context.context);
+    context.variable_scopes.push_scope();
+    std::invoke(*this, for_loop.initial);
+    llvm::Value* induction = *context.variable_scopes.find_item(for_loop.initial.identifier);
+    ast::binary_operator& condition = *std::get<ast::ptr<ast::binary_operator>>(for_loop.condition.expression);
+    bool is_signed = condition.l.type.is_signed_integer();
+    bool inclusive = condition.binary_operator == ast::binary_operator::C_LE;
+    llvm::Value* start = context.builder.CreateLoad(induction, "start");
+    //the body can't change the bound, so it's only worked out once
+    llvm::Value* end = std::invoke(*this, condition.r);
+    llvm::Type* type = start->getType();
+    llvm::Value* step = llvm::ConstantInt::get(type, cpu.step);
+
+    //the first iteration always runs, like any for loop
+    llvm::Value* more = inclusive ?
+        context.builder.CreateICmp(is_signed ? llvm::CmpInst::ICMP_SLE : llvm::CmpInst::ICMP_ULE, start, end) :
+        context.builder.CreateICmp(is_signed ? llvm::CmpInst::ICMP_SLT : llvm::CmpInst::ICMP_ULT, start, end);
+    llvm::Value* distance = context.builder.CreateSub(end, start);
+    if (!inclusive) {
+        distance = context.builder.CreateSub(distance, llvm::ConstantInt::get(type, 1));
+    }
+    llvm::Value* count = context.builder.CreateZExt(context.builder.CreateUDiv(distance, step), i64);
+    count = context.builder.CreateAdd(count, llvm::ConstantInt::get(i64, 1));
+    count = context.builder.CreateSelect(more, count, llvm::ConstantInt::get(i64, 1), "iterations");
+
+    llvm::FunctionType* body_type = llvm::FunctionType::get(llvm::Type::getVoidTy(context.context), {i8p, i64, i64}, false);
+    llvm::Function* body = llvm::Function::Create(body_type, llvm::Function::InternalLinkage,
+        f->getName() + ".cpu_for", context.module.get());
+    llvm::BasicBlock* saved_bb = context.builder.GetInsertBlock();
+    llvm::BasicBlock* saved_entry = context.current_function_entry;
+    llvm::BasicBlock* saved_loop_entry = context.current_loop_entry;
+    llvm::BasicBlock* saved_loop_exit = context.current_loop_exit;
+    llvm::PHINode* saved_loop_phi = context.current_loop_phi;
+    llvm::BasicBlock* entry = llvm::BasicBlock::Create(context.context, "entry", body);
+    context.current_function_entry = entry;
+    context.builder.SetInsertPoint(entry);
+    auto arg = body->arg_begin();
+    llvm::Value* captures = context.builder.CreateBitCast(&*arg++, i8p->getPointerTo(), "captures");
+    llvm::Value* first = &*arg++;
+    llvm::Value* last = &*arg++;
+    first->setName("first");
+    last->setName("last");
+
+    //every variable in scope is passed in, and the ones the body doesn't
+    //use are left out once it's generated
+    struct capture {
+        llvm::Value* variable;
+        llvm::Instruction* slot;
+        llvm::Instruction* address;
+        llvm::Value* rebound;
+    };
+    std::vector<std::pair<ast::identifier, llvm::Value*>> visible;
+    context.variable_scopes.for_each_item([&](ast::identifier identifier, llvm::Value* variable) {
+        visible.emplace_back(identifier, variable);
+    });
+    std::vector<capture> captured;
+    context.variable_scopes.push_scope();
+    for (auto& [identifier, variable]: visible) {
+        llvm::Value* slot = context.builder.CreateInBoundsGEP(i8p, captures, llvm::ConstantInt::get(i64, captured.size()));
+        llvm::Value* address = context.builder.CreateLoad(slot);
+        llvm::Value* rebound = context.builder.CreateBitCast(address, variable->getType(), context.symbols_registry.c_str(identifier));
+        captured.push_back({variable, llvm::cast<llvm::Instruction>(slot), llvm::cast<llvm::Instruction>(address), rebound});
+        context.variable_scopes.push_item(identifier, std::move(rebound));
+    }
+    llvm::Value* outer_induction = *context.variable_scopes.find_item(for_loop.initial.identifier);
+    llvm::Value* body_start = context.builder.CreateLoad(outer_induction, "start");
+    llvm::AllocaInst* i = CreateEntryBlockAlloca(context, for_loop.initial.identifier, type);
+    context.variable_scopes.push_item(for_loop.initial.identifier, i);
+    llvm::Value* iteration = context.builder.CreateAlloca(i64, nullptr, "iteration");
+    context.builder.CreateStore(first, iteration);
+
+    //the runtime never hands out an empty range
+    llvm::BasicBlock* loop_bb = llvm::BasicBlock::Create(context.context, "cpuloop", body);
+    llvm::BasicBlock* done_bb = llvm::BasicBlock::Create(context.context, "cpudone", body);
+    context.current_loop_entry = nullptr;
+    context.current_loop_exit = nullptr;
+    context.current_loop_phi = nullptr;
+    context.builder.CreateBr(loop_bb);
+    context.builder.SetInsertPoint(loop_bb);
+    llvm::Value* k = context.builder.CreateLoad(iteration, "k");
+    llvm::Value* offset = context.builder.CreateMul(context.builder.CreateTrunc(k, type), step);
+    context.builder.CreateStore(context.builder.CreateAdd(body_start, offset), i);
+    std::invoke(*this, for_loop.block);
+    k = context.builder.CreateLoad(iteration, "k");
+    llvm::Value* next = context.builder.CreateAdd(k, llvm::ConstantInt::get(i64, 1));
+    context.builder.CreateStore(next, iteration);
+    context.builder.CreateCondBr(context.builder.CreateICmpULT(next, last), loop_bb, done_bb);
+    context.builder.SetInsertPoint(done_bb);
+    context.builder.CreateRetVoid();
+    context.variable_scopes.pop_scope();
+    llvm::verifyFunction(*body);
+
+    std::vector<llvm::Value*> used;
+    for (auto& c: captured) {
+        if (c.rebound != c.address && c.rebound->use_empty()) {
+            llvm::cast<llvm::Instruction>(c.rebound)->eraseFromParent();
+        }
+        if (c.address->use_empty()) {
+            c.address->eraseFromParent();
+            c.slot->eraseFromParent();
+            continue;
+        }
+        c.slot->setOperand(1, llvm::ConstantInt::get(i64, used.size()));
+        used.push_back(c.variable);
+    }
+
+    context.current_function_entry = saved_entry;
+    context.current_loop_entry = saved_loop_entry;
+    context.current_loop_exit = saved_loop_exit;
+    context.current_loop_phi = saved_loop_phi;
+    context.builder.SetInsertPoint(saved_entry, saved_entry->begin());
+    llvm::ArrayType* addresses_type = llvm::ArrayType::get(i8p, used.size());
+    llvm::Value* addresses = context.builder.CreateAlloca(addresses_type, nullptr, "captures");
+    context.builder.SetInsertPoint(saved_bb);
+    for (size_t c = 0; c < used.size(); c++) {
+        llvm::Value* slot = context.builder.CreateConstInBoundsGEP2_64(addresses_type, addresses, 0, c);
+        context.builder.CreateStore(context.builder.CreateBitCast(used[c], i8p), slot);
+    }
+    context.builder.CreateCall(parallel_for_function(context), {
+        count, llvm::ConstantInt::get(i64, cpu.grain), body, context.builder.CreateBitCast(addresses, i8p),
+    });
+    context.variable_scopes.pop_scope();
+    return nullptr;
+}
+
+static std::string host_features() {
+    llvm::StringMap<bool> host;
+    std::string features;
+    if (llvm::sys::getHostCPUFeatures(host)) {
+        for (auto& feature: host) {
+            features += (features.empty() ? "" : ",") + std::string(feature.second ? "+" : "-") + feature.first().str();
+        }
+    }
+    return features;
+}
+std::string resolve_target_cpu(const std::string& cpu) {
+    return cpu == "native" ? llvm::sys::getHostCPUName().str() : cpu;
+}
+std::string resolve_target_features(const std::string& features) {
+    return features == "native" ? host_features() : features;
+}
+
+struct isa_level {
+    const char* name;
+    //the features llvm should assume, and the bits of libgcc's
+    //__cpu_model.__cpu_features[0] the resolver checks for them
+    const char* features;
+    uint32_t cpu_model_bits;
+};
+
+//x86-64 psABI levels, spelt out as features rather than cpu names so older
+//llvm versions know them. cx16, lahf, lzcnt, movbe, f16c and xsave aren't
+//in __cpu_features[0], but come with every cpu that has the rest of the level
+static const isa_level isa_levels[] = {
+    {"x86-64-v2", "+cx16,+sahf,+popcnt,+sse3,+sse4.1,+sse4.2,+ssse3",
+        1u << 2 | 1u << 5 | 1u << 6 | 1u << 7 | 1u << 8},
+    {"x86-64-v3", "+cx16,+sahf,+popcnt,+sse3,+sse4.1,+sse4.2,+ssse3,"
+        "+avx,+avx2,+bmi,+bmi2,+f16c,+fma,+lzcnt,+movbe,+xsave",
+        1u << 2 | 1u << 5 | 1u << 6 | 1u << 7 | 1u << 8 |
+        1u << 9 | 1u << 10 | 1u << 14 | 1u << 16 | 1u << 17},
+    {"x86-64-v4", "+cx16,+sahf,+popcnt,+sse3,+sse4.1,+sse4.2,+ssse3,"
+        "+avx,+avx2,+bmi,+bmi2,+f16c,+fma,+lzcnt,+movbe,+xsave,"
+        "+avx512f,+avx512bw,+avx512cd,+avx512dq,+avx512vl",
+        1u << 2 | 1u << 5 | 1u << 6 | 1u << 7 | 1u << 8 |
+        1u << 9 | 1u << 10 | 1u << 14 | 1u << 16 | 1u << 17 |
+        1u << 15 | 1u << 20 | 1u << 21 | 1u << 22 | 1u << 23},
+};
+
+//clones f for an isa level, along with the cpu for bodies it hands to the
+//runtime, which are where its loops run
+static llvm::Function* clone_for_level(codegen_context_llvm& context, llvm::Function* f, const isa_level* level) {
+    llvm::ValueToValueMapTy vmap;
+    for (auto& bb: *f) {
+        for (auto& inst: bb) {
+            auto* call = llvm::dyn_cast<llvm::CallInst>(&inst);
+            llvm::Function* callee = call ? call->getCalledFunction() : nullptr;
+            if (callee && callee->getName() == "klrt_parallel_for") {
+                llvm::Function* body = llvm::cast<llvm::Function>(call->getArgOperand(2));
+                if (!vmap.count(body)) {
+                    vmap[body] = clone_for_level(context, body, level);
+                }
+            }
+        }
+    }
+    llvm::Function* variant = llvm::CloneFunction(f, vmap);
+    variant->setName(f->getName() + "." + level->name);
+    variant->setLinkage(llvm::Function::InternalLinkage);
+    variant->addFnAttr("target-cpu", "x86-64");
+    std::string base_features = context.target_features == "native" ? "" : context.target_features;
+    variant->addFnAttr("target-features", base_features.empty() ? level->features : base_features + "," + level->features);
+    return variant;
+}
+
+static void multiversion_exports(codegen_context_llvm& context) {
+    //each exported function gets a clone per isa level, the original is
+    //kept as the baseline, and the exported symbol becomes an ifunc whose
+    //resolver picks the best clone for the cpu once, at load time
+    std::vector<const isa_level*> levels;
+    for (auto& name: context.multiversion_levels) {
+        auto level = std::find_if(std::begin(isa_levels), std::end(isa_levels), [&](const isa_level& l) {
+            return name == l.name;
+        });
+        if (level == std::end(isa_levels)) {
+            error("unknown isa level", name, "for multiversioning, expected x86-64-v2, x86-64-v3 or x86-64-v4");
+        }
+        levels.push_back(level);
+    }
+    std::sort(levels.begin(), levels.end());
+    levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+
+    llvm::Module& module = *context.module;
+    llvm::Type* i32 = llvm::Type::getInt32Ty(context.context);
+    llvm::StructType* cpu_model_type = llvm::StructType::get(context.context, {
+        i32, i32, i32, llvm::ArrayType::get(i32, 1),
+    });
+    llvm::Constant* cpu_model = module.getOrInsertGlobal("__cpu_model", cpu_model_type);
+    llvm::FunctionCallee cpu_indicator_init = module.getOrInsertFunction("__cpu_indicator_init",
+        llvm::FunctionType::get(llvm::Type::getVoidTy(context.context), false));
+
+    std::vector<llvm::Function*> exports;
+    for (auto& f: module) {
+        if (!f.isDeclaration() && f.hasExternalLinkage()) {
+            exports.push_back(&f);
+        }
+    }
+    for (llvm::Function* f: exports) {
+        std::string name = f->getName().str();
+        std::vector<llvm::Function*> variants;
+        for (auto level: levels) {
+            variants.push_back(clone_for_level(context, f, level));
+        }
+        f->setName(name + ".default");
+        f->setLinkage(llvm::Function::InternalLinkage);
+
+        llvm::Function* resolver = llvm::Function::Create(
+            llvm::FunctionType::get(f->getType(), false),
+            llvm::Function::InternalLinkage, name + ".resolver", &module);
+        llvm::GlobalIFunc* ifunc = llvm::GlobalIFunc::create(
+            f->getFunctionType(), f->getAddressSpace(),
+            llvm::Function::ExternalLinkage, name, resolver, &module);
+        //calls from the rest of the module, and the clones, go through the ifunc too
+        f->replaceAllUsesWith(ifunc);
+
+        llvm::IRBuilder<> builder(llvm::BasicBlock::Create(context.context, "entry", resolver));
+        //resolvers run before constructors, so libgcc's cpu detection hasn't yet
+        builder.CreateCall(cpu_indicator_init);
+        llvm::Value* features = builder.CreateLoad(i32,
+            llvm::ConstantExpr::getInBoundsGetElementPtr(cpu_model_type, cpu_model, llvm::ArrayRef<llvm::Constant*>{
+                llvm::ConstantInt::get(i32, 0), llvm::ConstantInt::get(i32, 3), llvm::ConstantInt::get(i32, 0),
+            }), "features");
+        llvm::Value* selected = f;
+        for (size_t i = 0; i < levels.size(); i++) {
+            llvm::Value* bits = llvm::ConstantInt::get(i32, levels[i]->cpu_model_bits);
+            llvm::Value* supported = builder.CreateICmpEQ(builder.CreateAnd(features, bits), bits, levels[i]->name);
+            selected = builder.CreateSelect(supported, variants[i], selected);
+        }
+        builder.CreateRet(selected);
+    }
+}
+
+static std::vector<ast::function_def*> top_level_functions(codegen_context_llvm &context, ast::program &program) {
+    std::vector<ast::function_def*> functions;
+    for (auto& statement: program.statements) {
+        if (std::holds_alternative<ast::ptr<ast::function_def>>(statement.statement)) {
+            ast::function_def& function_def = *std::get<ast::ptr<ast::function_def>>(statement.statement);
+            context.function_defs.insert(function_def.identifier, &function_def);
+            functions.push_back(&function_def);
+        } else if (std::holds_alternative<ast::ptr<ast::type_def>>(statement.statement)) {
+            ast::type_def& type_def = *std::get<ast::ptr<ast::type_def>>(statement.statement);
+            context.type_defs.insert(type_def.user_type, &type_def.type);
+        }
+        //top level variables don't generate any code
+    }
+    return functions;
+}
+
+struct chunk_output {
+    llvm::SmallVector<char, 0> bitcode;
+    std::vector<ast::identifier> internal_functions;
+};
+
+//generates a run of functions into a module in its own LLVMContext, and hands it back as bitcode
+static chunk_output codegen_chunk(codegen_context_llvm &context, ast::function_def* const* begin, ast::function_def* const* end, bool optimize) {
+    codegen_context_llvm chunk{context.symbols_registry};
+    chunk.parent = &context;
+    chunk.separate_modules = true;
+    chunk.module = std::make_unique<llvm::Module>(context.module->getModuleIdentifier(), chunk.context);
+    chunk.module->setTargetTriple(context.module->getTargetTriple());
+    chunk.module->setDataLayout(context.module->getDataLayout());
+    llvm_codegen_fn codegen{chunk};
+    for (auto f = begin; f != end; f++) {
+        codegen.define_function(**f);
+    }
+    if (optimize) {
+        optimize_module(*chunk.module, context.target_machine.get(), context.opt_level);
+    }
+    chunk_output output;
+    llvm::raw_svector_ostream os(output.bitcode);
+    //keep use lists in order, so the printed IR matches serial mode exactly
+    llvm::WriteBitcodeToFile(*chunk.module, os, true);
+    output.internal_functions = std::move(chunk.internal_functions);
+    return output;
+}
+
+//one linker for all the chunks, since making one scans every type in the destination module
+static void link_chunk(codegen_context_llvm &context, llvm::Linker& linker, const chunk_output& output) {
+    auto chunk_module = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef(llvm::StringRef(output.bitcode.data(), output.bitcode.size()), "chunk"), context.context);
+    if (!chunk_module) {
+        error("couldn't read chunk bitcode", llvm::toString(chunk_module.takeError()));
+    }
+    if (linker.linkInModule(std::move(*chunk_module))) {
+        error("couldn't link chunk modules");
+    }
+}
+
+static void finish_linking(codegen_context_llvm &context, const std::vector<ast::function_def*>& functions, const std::vector<ast::identifier>& internal_functions) {
+    //only once everything is linked, or later chunks' declarations would
+    //no longer resolve to the definitions
+    for (auto identifier: internal_functions) {
+        context.module->getFunction(context.symbols_registry.c_str(identifier))->setLinkage(llvm::Function::InternalLinkage);
+    }
+
+    //put functions back in the serial order: top level functions in source
+    //order, then nested functions in the order they were defined
+    std::vector<llvm::Function*> order;
+    for (auto function_def: functions) {
+        order.push_back(context.module->getFunction(context.symbols_registry.c_str(function_def->identifier)));
+    }
+    std::unordered_set<llvm::Function*> top_level(order.begin(), order.end());
+    for (auto& f: *context.module) {
+        if (!top_level.count(&f)) {
+            order.push_back(&f);
+        }
+    }
+    for (auto f: order) {
+        f->removeFromParent();
+        context.module->getFunctionList().push_back(f);
+    }
+}
+
+static void codegen_llvm_parallel(codegen_context_llvm &context, ast::program &program, size_t jobs) {
+    //function bodies are generated in contiguous chunks, each into a module
+    //of its own, handed back as bitcode and linked in chunk order so the
+    //output doesn't depend on scheduling
+    std::vector<ast::function_def*> functions = top_level_functions(context, program);
+
+    size_t chunks = std::min(functions.size(), jobs * 4);
+    std::vector<std::promise<chunk_output>> promises(chunks);
+    std::vector<std::future<chunk_output>> futures;
+    for (auto& promise: promises) {
+        futures.push_back(promise.get_future());
+    }
+    std::thread generator([&]() {
+        parallel_for(chunks, jobs, [&](size_t i) {
+            try {
+                promises[i].set_value(codegen_chunk(context,
+                    functions.data() + functions.size() * i / chunks,
+                    functions.data() + functions.size() * (i + 1) / chunks, false));
+            } catch (...) {
+                promises[i].set_exception(std::current_exception());
+            }
+        });
+    });
+
+    //link each chunk as soon as it's ready, in order, while later chunks are
+    //still being generated. the first failing chunk's error is the one reported
+    std::vector<ast::identifier> internal_functions;
+    llvm::Linker linker(*context.module);
+    try {
+        for (auto& future: futures) {
+            chunk_output output = future.get();
+            link_chunk(context, linker, output);
+            internal_functions.insert(internal_functions.end(), output.internal_functions.begin(), output.internal_functions.end());
+        }
+    } catch (...) {
+        generator.join();
+        throw;
+    }
+    generator.join();
+    finish_linking(context, functions, internal_functions);
+}
+
+static void codegen_llvm_incremental(codegen_context_llvm &context, ast::program &program, const std::string& src_filename, size_t jobs) {
+    //each top level function is a chunk of its own, optimised on its own and
+    //kept as bitcode, so only functions whose hash changed are generated again
+    std::vector<ast::function_def*> functions = top_level_functions(context, program);
+    std::vector<std::string> hashes = hash_functions(program, {
+        KL_VERSION,
+        LLVM_VERSION_STRING,
+        context.target_machine->getTargetTriple().str(),
+        context.target_machine->getTargetCPU().str(),
+        context.target_machine->getTargetFeatureString().str(),
+        std::to_string(static_cast<int>(context.opt_level)),
+    });
+    incremental_manifest manifest(context.incremental_dir, src_filename);
+
+    std::vector<chunk_output> outputs(functions.size());
+    std::vector<size_t> changed;
+    for (size_t i = 0; i < functions.size(); i++) {
+        std::string name {context.symbols_registry.get(functions[i]->identifier)};
+        auto e = manifest.entries.find(name);
+        auto buffer = llvm::MemoryBuffer::getFile(manifest.bitcode_path(hashes[i]));
+        if (e == manifest.entries.end() || e->second.hash != hashes[i] || !buffer) {
+            changed.push_back(i);
+            continue;
+        }
+        outputs[i].bitcode.assign((*buffer)->getBufferStart(), (*buffer)->getBufferEnd());
+        for (auto& internal: e->second.internal_functions) {
+            outputs[i].internal_functions.push_back(context.symbols_registry.insert(internal));
+        }
+    }
+    parallel_for(changed.size(), jobs, [&](size_t c) {
+        size_t i = changed[c];
+        outputs[i] = codegen_chunk(context, &functions[i], &functions[i] + 1, true);
+        auto& bitcode = outputs[i].bitcode;
+        write_file_atomic(manifest.bitcode_path(hashes[i]), {bitcode.data(), bitcode.size()});
+    });
+    context.functions_reused = functions.size() - changed.size();
+    context.functions_generated = changed.size();
+
+    std::unordered_map<std::string, incremental_manifest::entry> entries;
+    std::vector<ast::identifier> internal_functions;
+    llvm::Linker linker(*context.module);
+    for (size_t i = 0; i < functions.size(); i++) {
+        link_chunk(context, linker, outputs[i]);
+        incremental_manifest::entry e {hashes[i], {}};
+        for (auto identifier: outputs[i].internal_functions) {
+            e.internal_functions.emplace_back(context.symbols_registry.get(identifier));
+            internal_functions.push_back(identifier);
+        }
+        entries.emplace(context.symbols_registry.get(functions[i]->identifier), std::move(e));
+    }
+    finish_linking(context, functions, internal_functions);
+    manifest.write(entries);
+}
+std::unique_ptr<llvm::TargetMachine> create_target_machine(const std::string& cpu, const std::string& features, optimization_level opt_level) {
+    //output is always for the host's triple, so only its target is set up, once per process
+    static std::once_flag initialized;
+    std::call_once(initialized, []() {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        llvm::InitializeNativeTargetAsmParser();
+    });
     auto TargetTriple = llvm::sys::getDefaultTargetTriple();
-    context.module->setTargetTriple(TargetTriple);
 
     std::string Error;
     auto Target = llvm::TargetRegistry::lookupTarget(TargetTriple, Error);
@@ -544,25 +1750,126 @@ void codegen_llvm(codegen_context_llvm &context, ast::program &program, const st
         error(Error);
     }
 
-    auto CPU = "generic";
-    auto Features = "";
+    std::string CPU = resolve_target_cpu(cpu);
+    std::string Features = resolve_target_features(features);
 
     llvm::TargetOptions opt;
-    auto RM = llvm::Optional<llvm::Reloc::Model>();
-    auto TheTargetMachine = Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM);
+    //position independent, so objects can go in PIEs and shared libraries
+    auto RM = llvm::Optional<llvm::Reloc::Model>(llvm::Reloc::PIC_);
+    llvm::CodeGenOpt::Level OL = llvm::CodeGenOpt::Default;
+    switch (opt_level) {
+        case optimization_level::O0: OL = llvm::CodeGenOpt::None; break;
+        case optimization_level::O1: OL = llvm::CodeGenOpt::Less; break;
+        case optimization_level::O2: OL = llvm::CodeGenOpt::Default; break;
+        case optimization_level::O3: OL = llvm::CodeGenOpt::Aggressive; break;
+        case optimization_level::Os: OL = llvm::CodeGenOpt::Default; break;
+    }
+    return std::unique_ptr<llvm::TargetMachine>(Target->createTargetMachine(TargetTriple, CPU, Features, opt, RM, llvm::None, OL));
+}
+void codegen_llvm(codegen_context_llvm &context, ast::program &program, const std::string& src_filename, size_t jobs) {
+    context.module = std::make_unique<llvm::Module>(src_filename, context.context);
 
-    context.module->setDataLayout(TheTargetMachine->createDataLayout());
+    if (!context.target_machine) {
+        context.target_machine = create_target_machine(context.target_cpu, context.target_features, context.opt_level);
+    }
+    auto TargetTriple = context.target_machine->getTargetTriple().str();
+    context.module->setTargetTriple(TargetTriple);
+    context.module->setDataLayout(context.target_machine->createDataLayout());
 
     context.module->addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
     std::unique_ptr<llvm::DIBuilder> DBuilder = std::make_unique<llvm::DIBuilder>(*context.module);
-    std::invoke(llvm_codegen_fn{context}, program);
+    if (!context.incremental_dir.empty()) {
+        codegen_llvm_incremental(context, program, src_filename, jobs);
+    } else if (jobs <= 1) {
+        std::invoke(llvm_codegen_fn{context}, program);
+    } else {
+        codegen_llvm_parallel(context, program, jobs);
+    }
     DBuilder->finalize();
 
+    if (!context.multiversion_levels.empty()) {
+        if (llvm::Triple(TargetTriple).getArch() != llvm::Triple::x86_64) {
+            error("multiversioning is only supported on x86-64, not", TargetTriple);
+        }
+        multiversion_exports(context);
+    }
+}
+
+void optimize_llvm(codegen_context_llvm &context) {
+    //incremental chunks were already optimised one function at a time
+    if (context.opt_level == optimization_level::O0 || !context.incremental_dir.empty()) {
+        return;
+    }
+    if (llvm::verifyModule(*context.module, &llvm::errs())) {
+        error("generated invalid IR, can't optimize it");
+    }
+    optimize_module(*context.module, context.target_machine.get(), context.opt_level);
+}
+void optimize_module(llvm::Module &module, llvm::TargetMachine *target_machine, optimization_level opt_level) {
+    llvm::PassBuilder::OptimizationLevel level = llvm::PassBuilder::OptimizationLevel::O2;
+    switch (opt_level) {
+        case optimization_level::O0: return;
+        case optimization_level::O1: level = llvm::PassBuilder::OptimizationLevel::O1; break;
+        case optimization_level::O2: level = llvm::PassBuilder::OptimizationLevel::O2; break;
+        case optimization_level::O3: level = llvm::PassBuilder::OptimizationLevel::O3; break;
+        case optimization_level::Os: level = llvm::PassBuilder::OptimizationLevel::Os; break;
+    }
+
+    time_scope scope("optimize");
+    //passes show up in --time-trace as scopes of their own
+    llvm::PassInstrumentationCallbacks callbacks;
+    if (llvm::timeTraceProfilerEnabled()) {
+        callbacks.registerBeforePassCallback([](llvm::StringRef pass, llvm::Any) {
+            llvm::timeTraceProfilerBegin("RunPass", pass);
+            return true;
+        });
+        callbacks.registerAfterPassCallback([](llvm::StringRef, auto&&...) {
+            llvm::timeTraceProfilerEnd();
+        });
+        callbacks.registerAfterPassInvalidatedCallback([](llvm::StringRef, auto&&...) {
+            llvm::timeTraceProfilerEnd();
+        });
+    }
+    //the target machine gives the passes the cost model and data layout we
+    //generate code for
+    llvm::PassBuilder pass_builder(target_machine, llvm::PipelineTuningOptions(), llvm::None, &callbacks);
+    llvm::LoopAnalysisManager lam;
+    llvm::FunctionAnalysisManager fam;
+    llvm::CGSCCAnalysisManager cgam;
+    llvm::ModuleAnalysisManager mam;
+    pass_builder.registerModuleAnalyses(mam);
+    pass_builder.registerCGSCCAnalyses(cgam);
+    pass_builder.registerFunctionAnalyses(fam);
+    pass_builder.registerLoopAnalyses(lam);
+    pass_builder.crossRegisterProxies(lam, fam, cgam, mam);
+    llvm::ModulePassManager mpm = pass_builder.buildPerModuleDefaultPipeline(level);
+    mpm.run(module, mam);
+}
+void emit_llvm(codegen_context_llvm &context, emit_kind kind, const std::string& filename) {
+    time_scope scope("emit");
     std::error_code EC;
-    llvm::raw_fd_ostream dest(ir_filename, EC, llvm::sys::fs::OpenFlags::F_None);
+    llvm::raw_fd_ostream dest(filename, EC,
+        kind == emit_kind::ir || kind == emit_kind::assembly ? llvm::sys::fs::OpenFlags::F_Text : llvm::sys::fs::OpenFlags::F_None);
     if (EC) {
         error("couldn't open file", EC.message());
     }
-    context.module->print(dest, nullptr);
+    switch (kind) {
+        case emit_kind::ir:
+            context.module->print(dest, nullptr);
+            break;
+        case emit_kind::bitcode:
+            llvm::WriteBitcodeToFile(*context.module, dest);
+            break;
+        case emit_kind::object:
+        case emit_kind::assembly: {
+            llvm::legacy::PassManager pass_manager;
+            auto file_type = kind == emit_kind::object ? llvm::CGFT_ObjectFile : llvm::CGFT_AssemblyFile;
+            if (context.target_machine->addPassesToEmitFile(pass_manager, dest, nullptr, file_type)) {
+                error("target can't emit a file of this type");
+            }
+            pass_manager.run(*context.module);
+            break;
+        }
+    }
     dest.flush();
 }
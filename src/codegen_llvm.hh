@@ -4,21 +4,62 @@
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/Target/TargetMachine.h>
 
 #include "scopes.hh"
 #include "ast.hh"
+#include "registry.hh"
+
+enum class optimization_level {
+    O0, O1, O2, O3, Os,
+};
+
+enum class emit_kind {
+    object, assembly, bitcode, ir,
+};
 
 struct codegen_context_llvm {
-    llvm::LLVMContext context;
+    //the context holding the top level declarations, when generating one
+    //chunk of functions into a module of its own
+    codegen_context_llvm* parent = nullptr;
+    //functions are given external linkage in chunk modules so they can be
+    //linked together, and internal_functions get their linkage back after
+    bool separate_modules = false;
+    std::vector<ast::identifier> internal_functions;
+    ::registry<ast::identifier, ast::function_def*> function_defs;
+    ::registry<ast::user_type, ast::type*> type_defs;
+    //owned separately so a finished module can be handed on with its context
+    std::unique_ptr<llvm::LLVMContext> owned_context = std::make_unique<llvm::LLVMContext>();
+    llvm::LLVMContext& context{*owned_context};
     llvm::IRBuilder<> builder{context};
     std::unique_ptr<llvm::Module> module;
-    ::scopes<ast::identifier, llvm::AllocaInst*> variable_scopes;
-    bi_registry<ast::identifier, std::string>& symbols_registry;
+    //created by codegen_llvm from the options below, unless one for them is given
+    std::unique_ptr<llvm::TargetMachine> target_machine;
+    optimization_level opt_level = optimization_level::O0;
+    //a cpu name and llvm feature string like +avx2,-fma, or native for the host's
+    std::string target_cpu = "generic";
+    std::string target_features;
+    //x86-64 isa levels each exported function is also compiled for
+    std::vector<std::string> multiversion_levels;
+    //where each top level function's bitcode is kept between builds, empty to build from scratch
+    std::string incremental_dir;
+    size_t functions_reused = 0;
+    size_t functions_generated = 0;
+    //each variable's alloca, or its address passed in, in a cpu for loop's outlined body
+    ::scopes<ast::identifier, llvm::Value*> variable_scopes;
+    interner<ast::identifier>& symbols_registry;
     llvm::BasicBlock* current_function_entry = NULL;
     llvm::BasicBlock* current_loop_exit = NULL;
     llvm::BasicBlock* current_loop_entry = NULL;
     llvm::PHINode* current_loop_phi = NULL;
-    codegen_context_llvm(bi_registry<ast::identifier, std::string>& sr): symbols_registry(sr) {}
+    codegen_context_llvm(interner<ast::identifier>& sr): symbols_registry(sr) {}
 };
 
-void codegen_llvm(codegen_context_llvm &context, ast::program &program, const std::string& src_filename, const std::string& ir_filename);
+std::unique_ptr<llvm::TargetMachine> create_target_machine(const std::string& cpu, const std::string& features, optimization_level opt_level);
+void codegen_llvm(codegen_context_llvm &context, ast::program &program, const std::string& src_filename, size_t jobs = 1);
+void optimize_llvm(codegen_context_llvm &context);
+//the cpu name and feature string an option stands for, with native replaced by the host's
+std::string resolve_target_cpu(const std::string& cpu);
+std::string resolve_target_features(const std::string& features);
+void optimize_module(llvm::Module &module, llvm::TargetMachine *target_machine, optimization_level opt_level);
+void emit_llvm(codegen_context_llvm &context, emit_kind kind, const std::string& filename);
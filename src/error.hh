@@ -2,11 +2,20 @@
 
 #include <string>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+//thrown by error, and reported by main, so that errors raised on worker
+//threads can be collected and reported in a deterministic order
+struct compile_error: std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
 
 template<typename ... Ts>
 [[noreturn]] static void error(Ts ... args) {
-    ((std::cerr << args << " "), ...) << std::endl;
-    exit(EXIT_FAILURE);
+    std::ostringstream s;
+    ((s << args << " "), ...);
+    throw compile_error(s.str());
 }
 
 template<typename ... Ts>
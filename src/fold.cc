@@ -0,0 +1,397 @@
+#include <cmath>
+#include <functional>
+#include <optional>
+#include <variant>
+
+#include "fold.hh"
+#include "timing.hh"
+
+static unsigned width(ast::primitive_type type) {
+    switch (type.value) {
+        case ast::primitive_type::u8:
+        case ast::primitive_type::i8:
+            return 8;
+        case ast::primitive_type::u16:
+        case ast::primitive_type::i16:
+            return 16;
+        case ast::primitive_type::u32:
+        case ast::primitive_type::i32:
+            return 32;
+        case ast::primitive_type::u64:
+        case ast::primitive_type::i64:
+            return 64;
+        default:
+            return 0;
+    }
+}
+static uint64_t wrap(uint64_t value, unsigned bits) {
+    return bits == 64 ? value : value & ((uint64_t{1} << bits) - 1);
+}
+static int64_t sign_extend(uint64_t value, unsigned bits) {
+    return static_cast<int64_t>(value << (64 - bits)) >> (64 - bits);
+}
+
+//the value of a literal as codegen emits it: integers cut to their width
+//and f32 rounded. f16, vectors and user types aren't folded
+struct constant {
+    ast::primitive_type type;
+    uint64_t integer = 0;
+    double floating = 0;
+    bool boolean = false;
+};
+
+static std::optional<constant> constant_of(ast::expression& expression) {
+    auto literal = std::get_if<ast::ptr<ast::literal>>(&expression.expression);
+    if (!literal || !(*literal)->type.is_primitive()) {
+        return std::nullopt;
+    }
+    auto& value = (*literal)->literal;
+    constant c {std::get<ast::primitive_type>((*literal)->type.type)};
+    if (c.type.is_vector()) {
+        return std::nullopt;
+    } else if (c.type.is_bool()) {
+        c.boolean = std::get<bool>(value);
+    } else if (c.type.is_integer()) {
+        c.integer = wrap(std::get<ast::literal_integer>(value).data, width(c.type));
+    } else if (c.type == ast::primitive_type{ast::primitive_type::f32} || c.type == ast::primitive_type{ast::primitive_type::f64}) {
+        double x = std::holds_alternative<double>(value) ? std::get<double>(value) : std::get<ast::literal_integer>(value).data;
+        c.floating = c.type == ast::primitive_type{ast::primitive_type::f32} ? static_cast<float>(x) : x;
+    } else {
+        return std::nullopt;
+    }
+    return c;
+}
+
+template<typename T>
+static bool compare(ast::binary_operator::op op, T l, T r) {
+    switch (op) {
+        case ast::binary_operator::C_EQ: return l == r;
+        case ast::binary_operator::C_NE: return l != r;
+        case ast::binary_operator::C_GT: return l > r;
+        case ast::binary_operator::C_GE: return l >= r;
+        case ast::binary_operator::C_LT: return l < r;
+        case ast::binary_operator::C_LE: return l <= r;
+        default: assert(false);
+    }
+    return false;
+}
+
+static std::optional<constant> fold_binary(ast::binary_operator::op op, constant l, constant r) {
+    constant c {l.type};
+    switch (op) {
+        case ast::binary_operator::C_EQ:
+        case ast::binary_operator::C_NE:
+        case ast::binary_operator::C_GT:
+        case ast::binary_operator::C_GE:
+        case ast::binary_operator::C_LT:
+        case ast::binary_operator::C_LE:
+            c.type = {ast::primitive_type::t_bool};
+            if (l.type.is_bool()) {
+                c.boolean = compare(op, l.boolean, r.boolean);
+            } else if (l.type.is_float()) {
+                //float comparisons are unordered, true if either side is nan
+                c.boolean = std::isnan(l.floating) || std::isnan(r.floating) || compare(op, l.floating, r.floating);
+            } else if (l.type.is_signed_integer()) {
+                c.boolean = compare(op, sign_extend(l.integer, width(l.type)), sign_extend(r.integer, width(r.type)));
+            } else {
+                c.boolean = compare(op, l.integer, r.integer);
+            }
+            return c;
+        case ast::binary_operator::L_AND:
+            c.boolean = l.boolean && r.boolean;
+            return c;
+        case ast::binary_operator::L_OR:
+            c.boolean = l.boolean || r.boolean;
+            return c;
+        default:
+            break;
+    }
+
+    if (l.type.is_float()) {
+        double x = 0;
+        switch (op) {
+            case ast::binary_operator::A_ADD: x = l.floating + r.floating; break;
+            case ast::binary_operator::A_SUB: x = l.floating - r.floating; break;
+            case ast::binary_operator::A_MUL: x = l.floating * r.floating; break;
+            case ast::binary_operator::A_DIV: x = l.floating / r.floating; break;
+            case ast::binary_operator::A_MOD: x = std::fmod(l.floating, r.floating); break;
+            default: return std::nullopt;
+        }
+        //rounding the exact double result to float is the same as float arithmetic
+        c.floating = l.type == ast::primitive_type{ast::primitive_type::f32} ? static_cast<float>(x) : x;
+        return c;
+    }
+
+    unsigned bits = width(l.type);
+    uint64_t x = l.integer;
+    uint64_t y = r.integer;
+    int64_t sx = sign_extend(x, bits);
+    int64_t sy = sign_extend(y, bits);
+    bool is_signed = l.type.is_signed_integer();
+    switch (op) {
+        case ast::binary_operator::A_ADD: c.integer = x + y; break;
+        case ast::binary_operator::A_SUB: c.integer = x - y; break;
+        case ast::binary_operator::A_MUL: c.integer = x * y; break;
+        case ast::binary_operator::A_DIV:
+        case ast::binary_operator::A_MOD:
+            //division by zero and the signed overflow are left for run time
+            if (y == 0 || (is_signed && sy == -1 && sx == sign_extend(uint64_t{1} << (bits - 1), bits))) {
+                return std::nullopt;
+            }
+            if (op == ast::binary_operator::A_DIV) {
+                c.integer = is_signed ? static_cast<uint64_t>(sx / sy) : x / y;
+            } else {
+                c.integer = is_signed ? static_cast<uint64_t>(sx % sy) : x % y;
+            }
+            break;
+        //shifts are logical and give poison from the width up, those aren't folded
+        case ast::binary_operator::B_SHL:
+            if (y >= bits) {
+                return std::nullopt;
+            }
+            c.integer = x << y;
+            break;
+        case ast::binary_operator::B_SHR:
+            if (y >= bits) {
+                return std::nullopt;
+            }
+            c.integer = x >> y;
+            break;
+        case ast::binary_operator::B_AND: c.integer = x & y; break;
+        case ast::binary_operator::B_XOR: c.integer = x ^ y; break;
+        case ast::binary_operator::B_OR: c.integer = x | y; break;
+        default: return std::nullopt;
+    }
+    c.integer = wrap(c.integer, bits);
+    return c;
+}
+
+static std::optional<constant> fold_unary(ast::unary_operator::op op, constant r) {
+    switch (op) {
+        case ast::unary_operator::B_NOT:
+            r.integer = wrap(~r.integer, width(r.type));
+            return r;
+        case ast::unary_operator::L_NOT:
+            r.boolean = !r.boolean;
+            return r;
+    }
+    return std::nullopt;
+}
+
+//which operand, if any, the operator gives back unchanged
+enum class identity {
+    none, left, right,
+};
+static identity find_identity(ast::binary_operator::op op, std::optional<constant> l, std::optional<constant> r) {
+    auto is = [](std::optional<constant>& c, uint64_t value) {
+        return c && c->type.is_integer() && c->integer == value;
+    };
+    auto is_bool = [](std::optional<constant>& c, bool value) {
+        return c && c->type.is_bool() && c->boolean == value;
+    };
+    switch (op) {
+        case ast::binary_operator::A_ADD:
+        case ast::binary_operator::B_OR:
+        case ast::binary_operator::B_XOR:
+            return is(r, 0) ? identity::left : is(l, 0) ? identity::right : identity::none;
+        case ast::binary_operator::A_SUB:
+        case ast::binary_operator::B_SHL:
+        case ast::binary_operator::B_SHR:
+            return is(r, 0) ? identity::left : identity::none;
+        case ast::binary_operator::A_MUL:
+            return is(r, 1) ? identity::left : is(l, 1) ? identity::right : identity::none;
+        case ast::binary_operator::A_DIV:
+            return is(r, 1) ? identity::left : identity::none;
+        case ast::binary_operator::L_AND:
+            return is_bool(r, true) ? identity::left : is_bool(l, true) ? identity::right : identity::none;
+        case ast::binary_operator::L_OR:
+            return is_bool(r, false) ? identity::left : is_bool(l, false) ? identity::right : identity::none;
+        default:
+            return identity::none;
+    }
+}
+
+struct fold_fn {
+    fold_context& context;
+    ast::arena& arena;
+
+    template<typename T>
+    void operator()(ast::ptr<T>& p) {
+        std::invoke(*this, *p);
+    }
+    template<typename T>
+    void operator()(std::optional<T>& o) {
+        if (o) {
+            std::invoke(*this, *o);
+        }
+    }
+    template<typename T>
+    void operator()(std::vector<T>& v) {
+        for (auto& t: v) {
+            std::invoke(*this, t);
+        }
+    }
+
+    void operator()(ast::statement& statement) {
+        std::visit(*this, statement.statement);
+    }
+    void operator()(ast::block& block) {
+        std::invoke(*this, block.statements);
+    }
+    void operator()(ast::function_def& function_def) {
+        std::invoke(*this, function_def.block);
+    }
+    void operator()(ast::variable_def& variable_def) {
+        std::invoke(*this, variable_def.expression);
+    }
+    void operator()(ast::type_def&) {
+    }
+    void operator()(ast::assignment& assignment) {
+        std::invoke(*this, assignment.accessor);
+        std::invoke(*this, assignment.expression);
+    }
+    void operator()(ast::s_return& s_return) {
+        std::invoke(*this, s_return.expression);
+    }
+    void operator()(ast::s_break& s_break) {
+        std::invoke(*this, s_break.expression);
+    }
+    void operator()(ast::s_continue&) {
+    }
+    void operator()(ast::schedule&) {
+    }
+    void operator()(ast::if_statement& if_statement) {
+        std::invoke(*this, if_statement.conditions);
+        std::invoke(*this, if_statement.blocks);
+    }
+    void operator()(ast::for_loop& for_loop) {
+        std::invoke(*this, for_loop.initial);
+        std::invoke(*this, for_loop.condition);
+        std::invoke(*this, for_loop.step);
+        std::invoke(*this, for_loop.stop);
+        std::invoke(*this, for_loop.block);
+    }
+    void operator()(ast::while_loop& while_loop) {
+        std::invoke(*this, while_loop.condition);
+        std::invoke(*this, while_loop.block);
+    }
+    void operator()(ast::switch_statement& switch_statement) {
+        std::invoke(*this, switch_statement.expression);
+        for (auto& case_statement: switch_statement.cases) {
+            std::invoke(*this, case_statement.block);
+        }
+    }
+    void operator()(ast::accessor& accessor) {
+        for (auto& field: accessor.fields) {
+            if (auto array_access = std::get_if<ast::array_access>(&field)) {
+                std::invoke(*this, *array_access);
+            }
+        }
+    }
+    void operator()(ast::identifier) {
+    }
+    void operator()(ast::literal&) {
+    }
+    void operator()(ast::function_call& function_call) {
+        std::invoke(*this, function_call.arguments);
+    }
+    void operator()(ast::binary_operator& binary_operator) {
+        std::invoke(*this, binary_operator.l);
+        std::invoke(*this, binary_operator.r);
+    }
+    void operator()(ast::unary_operator& unary_operator) {
+        std::invoke(*this, unary_operator.r);
+    }
+
+    //operands are folded first, so whole constant subexpressions collapse
+    void operator()(ast::expression& expression) {
+        std::visit(*this, expression.expression);
+        if (auto binary_operator = std::get_if<ast::ptr<ast::binary_operator>>(&expression.expression)) {
+            simplify(expression, **binary_operator);
+        } else if (auto unary_operator = std::get_if<ast::ptr<ast::unary_operator>>(&expression.expression)) {
+            if (auto r = constant_of((*unary_operator)->r)) {
+                if (auto c = fold_unary((*unary_operator)->unary_operator, *r)) {
+                    replace_with_literal(expression, *c);
+                }
+            }
+        } else if (auto if_statement = std::get_if<ast::ptr<ast::if_statement>>(&expression.expression)) {
+            prune(expression, **if_statement);
+        }
+    }
+
+    void replace_with_literal(ast::expression& expression, constant c) {
+        ast::literal l {};
+        if (c.type.is_bool()) {
+            l.literal = c.boolean;
+        } else if (c.type.is_integer()) {
+            l.literal = ast::literal_integer{c.integer};
+        } else {
+            l.literal = c.floating;
+        }
+        l.type = {c.type};
+        //kept explicit, so incremental hashes tell equal values of different types apart
+        l.explicit_type = l.type;
+        l.loc = expression.loc;
+        expression.expression = arena.make<ast::literal>(std::move(l));
+        expression.type = {c.type};
+        context.expressions_folded++;
+    }
+    void simplify(ast::expression& expression, ast::binary_operator& binary_operator) {
+        auto l = constant_of(binary_operator.l);
+        auto r = constant_of(binary_operator.r);
+        if (l && r) {
+            if (auto c = fold_binary(binary_operator.binary_operator, *l, *r)) {
+                replace_with_literal(expression, *c);
+            }
+            return;
+        }
+        //the operand dropped is a literal, so nothing it does is lost
+        switch (find_identity(binary_operator.binary_operator, l, r)) {
+            case identity::left:
+                expression = std::move(binary_operator.l);
+                context.identities_simplified++;
+                break;
+            case identity::right:
+                expression = std::move(binary_operator.r);
+                context.identities_simplified++;
+                break;
+            case identity::none:
+                break;
+        }
+    }
+    void prune(ast::expression& expression, ast::if_statement& if_statement) {
+        auto& conditions = if_statement.conditions;
+        auto& blocks = if_statement.blocks;
+        for (size_t i = 0; i < conditions.size();) {
+            auto c = constant_of(conditions[i]);
+            if (!c) {
+                i++;
+                continue;
+            }
+            context.branches_pruned++;
+            if (c->boolean) {
+                //taken whenever it's reached, so it becomes the else and nothing after it runs
+                conditions.erase(conditions.begin() + i, conditions.end());
+                blocks.erase(blocks.begin() + i + 1, blocks.end());
+            } else {
+                conditions.erase(conditions.begin() + i);
+                blocks.erase(blocks.begin() + i);
+            }
+        }
+        if (!conditions.empty()) {
+            return;
+        }
+        //only the else is left, or nothing at all
+        ast::block block {};
+        block.type = {ast::primitive_type{ast::primitive_type::t_void}};
+        if (!blocks.empty()) {
+            block = std::move(blocks.front());
+        }
+        expression.expression = arena.make<ast::block>(std::move(block));
+    }
+};
+
+void fold(fold_context &context, ast::program &program) {
+    time_scope scope("fold");
+    std::invoke(fold_fn{context, *program.arena}, program.statements);
+}
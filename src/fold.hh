@@ -0,0 +1,14 @@
+#pragma once
+
+#include "ast.hh"
+
+struct fold_context {
+    size_t expressions_folded = 0;
+    size_t identities_simplified = 0;
+    size_t branches_pruned = 0;
+};
+
+//replaces operators on literals with their value, x + 0, x * 1, x << 0 and
+//the like with x, and removes if branches behind constant conditions. runs
+//after typecheck, the values wrap and round as the inferred types do in codegen
+void fold(fold_context &context, ast::program &program);
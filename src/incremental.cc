@@ -0,0 +1,321 @@
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+
+#include "incremental.hh"
+#include "error.hh"
+
+struct hash_fn {
+    llvm::SHA1& sha1;
+    interner<ast::identifier>& symbols_registry;
+    //every function by name, for the signatures of the functions called
+    std::unordered_map<size_t, ast::function_def*>& function_defs;
+
+    template<typename T>
+    void add(T t) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        sha1.update(llvm::ArrayRef<uint8_t>(reinterpret_cast<const uint8_t*>(&t), sizeof(t)));
+    }
+    void add(std::string_view s) {
+        add(s.size());
+        sha1.update(llvm::StringRef(s.data(), s.size()));
+    }
+    template<typename... Ts>
+    void visit(std::variant<Ts...>& v) {
+        add(v.index());
+        std::visit(*this, v);
+    }
+    template<typename T>
+    void operator()(ast::ptr<T>& p) {
+        std::invoke(*this, *p);
+    }
+    template<typename T>
+    void operator()(std::optional<T>& o) {
+        add(o.has_value());
+        if (o) {
+            std::invoke(*this, *o);
+        }
+    }
+    template<typename T>
+    void operator()(std::vector<T>& v) {
+        add(v.size());
+        for (auto& t: v) {
+            std::invoke(*this, t);
+        }
+    }
+
+    void operator()(ast::identifier identifier) {
+        add(identifier.to_string(symbols_registry));
+    }
+    void operator()(ast::primitive_type primitive_type) {
+        add(primitive_type.value);
+        add(primitive_type.lanes);
+    }
+    void operator()(ast::user_type user_type) {
+        add(user_type.to_string(symbols_registry));
+    }
+    void operator()(ast::buffer_type buffer_type) {
+        add(buffer_type.element_type.value);
+    }
+    void operator()(ast::named_type& named_type) {
+        visit(named_type.type);
+    }
+    void operator()(std::unique_ptr<ast::struct_type>& struct_type) {
+        std::invoke(*this, struct_type->fields);
+    }
+    void operator()(std::unique_ptr<ast::array_type>& array_type) {
+        std::invoke(*this, array_type->element_type);
+        add(array_type->length);
+        add(array_type->layout.value);
+        add(array_type->layout.block);
+    }
+    void operator()(ast::type& type) {
+        visit(type.type_);
+    }
+    void operator()(ast::field& field) {
+        std::invoke(*this, field.type);
+        std::invoke(*this, field.identifier);
+    }
+
+    void operator()(ast::statement& statement) {
+        visit(statement.statement);
+    }
+    void operator()(ast::expression& expression) {
+        visit(expression.expression);
+    }
+    void operator()(ast::block& block) {
+        std::invoke(*this, block.statements);
+    }
+    void operator()(ast::if_statement& if_statement) {
+        std::invoke(*this, if_statement.conditions);
+        std::invoke(*this, if_statement.blocks);
+    }
+    void operator()(ast::for_loop& for_loop) {
+        std::invoke(*this, for_loop.initial);
+        std::invoke(*this, for_loop.condition);
+        std::invoke(*this, for_loop.step);
+        std::invoke(*this, for_loop.stop);
+        std::invoke(*this, for_loop.block);
+        std::invoke(*this, for_loop.simd);
+        std::invoke(*this, for_loop.cpu);
+    }
+    void operator()(ast::simd& simd) {
+        add(simd.lanes);
+    }
+    void operator()(ast::cpu& cpu) {
+        add(cpu.grain);
+    }
+    void operator()(ast::while_loop& while_loop) {
+        std::invoke(*this, while_loop.condition);
+        std::invoke(*this, while_loop.block);
+    }
+    void operator()(ast::switch_statement& switch_statement) {
+        std::invoke(*this, switch_statement.expression);
+        std::invoke(*this, switch_statement.cases);
+    }
+    void operator()(ast::case_statement& case_statement) {
+        std::invoke(*this, case_statement.cases);
+        std::invoke(*this, case_statement.block);
+    }
+    void operator()(ast::accessor& accessor) {
+        std::invoke(*this, accessor.identifier);
+        add(accessor.fields.size());
+        for (auto& field: accessor.fields) {
+            visit(field);
+        }
+    }
+    void operator()(ast::literal& literal) {
+        visit(literal.literal);
+        std::invoke(*this, literal.explicit_type);
+    }
+    void operator()(double d) {
+        add(d);
+    }
+    void operator()(ast::literal_integer i) {
+        add(i.data);
+    }
+    void operator()(bool b) {
+        add(b);
+    }
+    void operator()(ast::function_call& function_call) {
+        std::invoke(*this, function_call.identifier);
+        std::invoke(*this, function_call.arguments);
+        //the callee's signature decides how the call is generated, its body doesn't
+        auto f = function_defs.find(function_call.identifier.value);
+        add(f != function_defs.end());
+        if (f != function_defs.end()) {
+            std::invoke(*this, f->second->returntype);
+            std::invoke(*this, f->second->parameter_list);
+        }
+    }
+    void operator()(ast::binary_operator& binary_operator) {
+        add(binary_operator.binary_operator);
+        std::invoke(*this, binary_operator.l);
+        std::invoke(*this, binary_operator.r);
+    }
+    void operator()(ast::unary_operator& unary_operator) {
+        add(unary_operator.unary_operator);
+        std::invoke(*this, unary_operator.r);
+    }
+    void operator()(ast::function_def& function_def) {
+        add(function_def.to_export);
+        std::invoke(*this, function_def.identifier);
+        std::invoke(*this, function_def.returntype);
+        std::invoke(*this, function_def.parameter_list);
+        std::invoke(*this, function_def.block);
+    }
+    void operator()(ast::variable_def& variable_def) {
+        std::invoke(*this, variable_def.explicit_type);
+        std::invoke(*this, variable_def.identifier);
+        std::invoke(*this, variable_def.expression);
+    }
+    void operator()(ast::type_def& type_def) {
+        std::invoke(*this, type_def.user_type);
+        std::invoke(*this, type_def.type);
+    }
+    void operator()(ast::assignment& assignment) {
+        std::invoke(*this, assignment.accessor);
+        std::invoke(*this, assignment.expression);
+    }
+    void operator()(ast::s_return& s_return) {
+        std::invoke(*this, s_return.expression);
+    }
+    void operator()(ast::s_break& s_break) {
+        std::invoke(*this, s_break.expression);
+    }
+    void operator()(ast::s_continue&) {
+    }
+    //applied to the function it names before this, so that function's hash covers it
+    void operator()(ast::schedule&) {
+    }
+};
+
+//nested functions can be called too, so they're found by walking every block
+struct collect_functions_fn {
+    std::unordered_map<size_t, ast::function_def*>& function_defs;
+    void operator()(ast::statement_list& statements) {
+        for (auto& statement: statements) {
+            std::visit(*this, statement.statement);
+        }
+    }
+    void operator()(ast::ptr<ast::function_def>& function_def) {
+        function_defs.emplace(function_def->identifier.value, &*function_def);
+        std::invoke(*this, function_def->block.statements);
+    }
+    template<typename T>
+    void operator()(T&) {
+    }
+};
+
+std::vector<std::string> hash_functions(ast::program& program, const std::vector<std::string>& options) {
+    std::unordered_map<size_t, ast::function_def*> function_defs;
+    std::invoke(collect_functions_fn{function_defs}, program.statements);
+
+    //options and top level types are common to every function
+    llvm::SHA1 common;
+    hash_fn common_hash{common, program.symbols_registry, function_defs};
+    for (auto& option: options) {
+        common_hash.add(std::string_view(option));
+    }
+    for (auto& statement: program.statements) {
+        if (!std::holds_alternative<ast::ptr<ast::function_def>>(statement.statement)) {
+            std::invoke(common_hash, statement);
+        }
+    }
+    std::string prefix = common.final().str();
+
+    std::vector<std::string> hashes;
+    for (auto& statement: program.statements) {
+        if (std::holds_alternative<ast::ptr<ast::function_def>>(statement.statement)) {
+            llvm::SHA1 sha1;
+            sha1.update(prefix);
+            std::invoke(hash_fn{sha1, program.symbols_registry, function_defs}, statement);
+            hashes.push_back(llvm::toHex(sha1.final(), true));
+        }
+    }
+    return hashes;
+}
+
+bool write_file_atomic(const std::string& path, std::string_view data) {
+    //server workers can write the same file at once, so each write has a
+    //temporary of its own
+    static std::atomic<uint64_t> writes = 0;
+    std::string temporary = path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(writes++);
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), data.size());
+        if (!out.flush()) {
+            unlink(temporary.c_str());
+            return false;
+        }
+    }
+    if (rename(temporary.c_str(), path.c_str()) != 0) {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+incremental_manifest::incremental_manifest(const std::string& incremental_dir, const std::string& filename) {
+    if (mkdir(incremental_dir.c_str(), 0777) != 0 && errno != EEXIST) {
+        error("error: couldn't create incremental directory", incremental_dir);
+    }
+    //one directory per input file, named by its absolute path
+    llvm::SmallString<256> path(filename);
+    llvm::sys::fs::make_absolute(path);
+    llvm::SHA1 sha1;
+    sha1.update(path.str());
+    dir = incremental_dir + "/" + llvm::toHex(sha1.final(), true);
+    if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) {
+        error("error: couldn't create incremental directory", dir);
+    }
+
+    //one line per function: name, hash, then the functions it defines that are internal
+    std::ifstream in(dir + "/manifest");
+    for (std::string line; std::getline(in, line);) {
+        std::istringstream fields(line);
+        std::string name;
+        entry e;
+        fields >> name >> e.hash;
+        for (std::string internal; fields >> internal;) {
+            e.internal_functions.push_back(internal);
+        }
+        entries.emplace(name, std::move(e));
+    }
+}
+
+std::string incremental_manifest::bitcode_path(const std::string& hash) const {
+    return dir + "/" + hash + ".bc";
+}
+
+void incremental_manifest::write(const std::unordered_map<std::string, entry>& new_entries) {
+    std::ostringstream out;
+    std::unordered_set<std::string> used;
+    for (auto& [name, e]: new_entries) {
+        out << name << " " << e.hash;
+        for (auto& internal: e.internal_functions) {
+            out << " " << internal;
+        }
+        out << "\n";
+        used.insert(e.hash);
+    }
+    if (!write_file_atomic(dir + "/manifest", out.str())) {
+        error("error: couldn't write incremental manifest", dir + "/manifest");
+    }
+    for (auto& [name, e]: entries) {
+        if (!used.count(e.hash)) {
+            unlink(bitcode_path(e.hash).c_str());
+        }
+    }
+    entries = new_entries;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hh"
+
+//hashes of each top level function, covering its body, the functions nested
+//in it, the signatures of everything it calls, the program's top level types
+//and the given options. a function whose hash is unchanged generates the same code
+std::vector<std::string> hash_functions(ast::program& program, const std::vector<std::string>& options);
+
+//what was generated for one input file last time, kept in a directory of
+//its own with one bitcode file per top level function
+struct incremental_manifest {
+    struct entry {
+        std::string hash;
+        //functions the chunk defines that get internal linkage once linked
+        std::vector<std::string> internal_functions;
+    };
+    std::string dir;
+    std::unordered_map<std::string, entry> entries;
+
+    //reads the manifest for filename from the incremental directory, empty if there is none
+    incremental_manifest(const std::string& incremental_dir, const std::string& filename);
+
+    std::string bitcode_path(const std::string& hash) const;
+    //replaces the manifest on disk with entries and removes bitcode no entry uses
+    void write(const std::unordered_map<std::string, entry>& new_entries);
+};
+
+//writes data to a temporary file next to path and renames it into place
+bool write_file_atomic(const std::string& path, std::string_view data);
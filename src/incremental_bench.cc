@@ -0,0 +1,61 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include <llvm/Support/FileSystem.h>
+
+#include "bench.hh"
+#include "lexer.hh"
+#include "parser.hh"
+#include "typecheck.hh"
+#include "codegen_llvm.hh"
+
+struct build_result {
+    double seconds;
+    size_t reused;
+    size_t generated;
+};
+
+static build_result build(const std::string& filename, optimization_level opt_level, const std::string& incremental_dir) {
+    bench_timer t;
+    lexer_context lexer(filename);
+    parser_context parser(lexer);
+    auto program_ast = parser.parse_program(filename);
+    typecheck_context typecheck_context{program_ast.symbols_registry};
+    typecheck(typecheck_context, program_ast);
+    codegen_context_llvm codegen_context_llvm{program_ast.symbols_registry};
+    codegen_context_llvm.opt_level = opt_level;
+    codegen_context_llvm.incremental_dir = incremental_dir;
+    codegen_llvm(codegen_context_llvm, program_ast, filename);
+    optimize_llvm(codegen_context_llvm);
+    emit_llvm(codegen_context_llvm, emit_kind::object, filename + ".o");
+    return {t.seconds(), codegen_context_llvm.functions_reused, codegen_context_llvm.functions_generated};
+}
+
+static void report(const char* name, build_result r) {
+    printf("  %-22s %8.3f s, %zu functions reused, %zu generated\n", name, r.seconds, r.reused, r.generated);
+}
+
+int main(int argc, char *argv[]) {
+    size_t functions = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 5000;
+    std::string source = generate_functions(functions);
+    //the edit changes one constant in the middle function
+    std::string edited = source;
+    size_t f = edited.find("kernel_" + std::to_string(functions / 2) + "(");
+    edited.replace(edited.find("31u32", f), 5, "37u32");
+    std::string incremental_dir = std::string{P_tmpdir} + "/incremental_bench";
+
+    for (auto [level_name, level]: {std::pair{"-O0", optimization_level::O0}, std::pair{"-O2", optimization_level::O2}}) {
+        printf("%zu functions at %s\n", functions, level_name);
+        llvm::sys::fs::remove_directories(incremental_dir);
+        std::string filename = write_temp_source("incremental_bench", source);
+        report("full build", build(filename, level, ""));
+        report("incremental, cold", build(filename, level, incremental_dir));
+        report("incremental, no edit", build(filename, level, incremental_dir));
+        write_temp_source("incremental_bench", edited);
+        report("incremental, one edit", build(filename, level, incremental_dir));
+        report("full build, one edit", build(filename, level, ""));
+        std::remove(filename.c_str());
+        std::remove((filename + ".o").c_str());
+    }
+    llvm::sys::fs::remove_directories(incremental_dir);
+}
@@ -0,0 +1,77 @@
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "bench.hh"
+#include "ast.hh"
+#include "registry.hh"
+
+static size_t allocated_bytes = 0;
+
+void* operator new(size_t size) {
+    allocated_bytes += size;
+    if (void* p = std::malloc(size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+template<typename F>
+static void report(const char* name, const std::vector<std::string_view>& words, F&& insert) {
+    size_t bytes_before = allocated_bytes;
+    bench_timer insert_timer;
+    size_t check = 0;
+    for (auto w: words) {
+        check += insert(w).value;
+    }
+    double insert_s = insert_timer.seconds();
+    size_t bytes = allocated_bytes - bytes_before;
+
+    //every word is already present now, so this is pure lookup
+    bench_timer lookup_timer;
+    for (auto w: words) {
+        check -= insert(w).value;
+    }
+    double lookup_s = lookup_timer.seconds();
+
+    printf("%-12s insert %.3f s (%.1f ns/id), lookup %.3f s (%.1f ns/id), %.1f MB%s\n",
+        name, insert_s, insert_s / words.size() * 1e9, lookup_s, lookup_s / words.size() * 1e9,
+        bytes / 1e6, check == 0 ? "" : " MISMATCH");
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+    //unique identifiers laid out in one buffer, like the lexer sees them in the source
+    std::string source;
+    std::vector<size_t> offsets;
+    for (size_t i = 0; i < count; i++) {
+        offsets.push_back(source.size());
+        source += "symbol_" + std::to_string(i * 2654435761u % 1000000007u) + "_" + std::to_string(i);
+    }
+    offsets.push_back(source.size());
+    std::vector<std::string_view> words;
+    for (size_t i = 0; i < count; i++) {
+        words.emplace_back(source.data() + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    printf("%zu unique identifiers\n", count);
+
+    {
+        bi_registry<ast::identifier, std::string> registry;
+        report("bi_registry", words, [&](std::string_view w) {
+            return registry.insert(std::string{w});
+        });
+    }
+    {
+        interner<ast::identifier> interner;
+        report("interner", words, [&](std::string_view w) {
+            return interner.insert(w);
+        });
+    }
+}
@@ -0,0 +1,55 @@
+#include <cassert>
+#include <cstdio>
+#include <string>
+
+#include "kl.hh"
+
+int main(int argc, char *argv[]) {
+    std::string tests = argc > 1 ? argv[1] : "tests";
+    kl::jit jit;
+
+    auto fibonacci = jit.compile_file(tests + "/fib.kl").function<uint32_t(uint32_t)>("fibonacci");
+    assert(fibonacci(1) == 1);
+    assert(fibonacci(10) == 55);
+    assert(fibonacci(47) == 2971215073u);
+
+    auto gcd = jit.compile_file(tests + "/gcd.kl").function<uint32_t(uint32_t, uint32_t)>("gcd");
+    assert(gcd(100, 10) == 10);
+    assert(gcd(10, 100) == 10);
+    assert(gcd(1071, 462) == 21);
+
+    //the same source compiles once, and a different source can export the same name
+    assert(&jit.compile_file(tests + "/gcd.kl") == &jit.compile_file(tests + "/gcd.kl"));
+    assert(jit.cached_modules() == 2);
+    auto gcd_u64 = jit.compile_source(
+        "export fn u64 gcd(u64 x, u64 y) { while y != 0u64 { var t = y; y = x % t; x = t; }; return x; };"
+    ).function<uint64_t(uint64_t, uint64_t)>("gcd");
+    assert(gcd_u64(1ull << 40, 1ull << 20) == 1ull << 20);
+    assert(gcd(100, 10) == 10);
+
+    //the runtime's threads run cpu for loops in jit compiled code too
+    auto squares = jit.compile_source(
+        "type table = [u32 64];"
+        "export fn u32 squares() { var table s; cpu 4 for var i = 0u32; i < 64u32; i = i + 1u32 { s[i] = i * i; };"
+        " var total = 0u32; for var i = 0u32; i < 64u32; i = i + 1u32 { total = total + s[i]; }; return total; };"
+    ).function<uint32_t()>("squares");
+    assert(squares() == 85344);
+
+    bool threw = false;
+    try {
+        jit.compile_file(tests + "/fib.kl").function<uint64_t(uint64_t)>("fibonacci");
+    } catch (const compile_error&) {
+        threw = true;
+    }
+    assert(threw);
+    threw = false;
+    try {
+        jit.compile_source("export fn u32 f() { return undefined_variable; };");
+    } catch (const compile_error&) {
+        threw = true;
+    }
+    assert(threw);
+
+    printf("fibonacci(10) = %u, gcd(1071, 462) = %u\n", fibonacci(10), gcd(1071, 462));
+    return 0;
+}
@@ -0,0 +1,258 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <llvm/Config/llvm-config.h>
+
+#include "bench.hh"
+
+//the kernels from tests/, compiled by the compiler under test
+extern "C" {
+    uint32_t fibonacci(uint32_t);
+    uint32_t gcd(uint32_t, uint32_t);
+    double average(double, double);
+}
+
+//the same algorithms in c++. kl loops test their condition after the first
+//iteration, the sizes swept never make that differ from these
+__attribute__((noinline)) static uint32_t reference_fibonacci(uint32_t n) {
+    uint32_t a = 0;
+    uint32_t b = 1;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t t = b;
+        b = a + t;
+        a = t;
+    }
+    return a;
+}
+__attribute__((noinline)) static uint32_t reference_gcd(uint32_t x, uint32_t y) {
+    while (y != 0) {
+        uint32_t t = y;
+        y = x % t;
+        x = t;
+    }
+    return x;
+}
+__attribute__((noinline)) static double reference_average(double x, double y) {
+    double z = 1;
+    for (int i = 0; i < 10; i++) {
+        z = x;
+    }
+    return (z + y) * 0.5;
+}
+
+//cycles, instructions, cache misses and branch misses of this thread in
+//user space, read as one group. unavailable without perf_event_open, as in
+//most containers or with perf_event_paranoid set too high
+class perf_counters {
+private:
+    static constexpr uint64_t events[] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+    std::vector<int> fds;
+public:
+    static constexpr size_t count = sizeof(events) / sizeof(events[0]);
+    static constexpr const char* names[count] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+
+    perf_counters() {
+        for (auto event: events) {
+            perf_event_attr attr {};
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = event;
+            attr.disabled = fds.empty();
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            int fd = syscall(SYS_perf_event_open, &attr, 0, -1, fds.empty() ? -1 : fds.front(), 0);
+            if (fd < 0) {
+                for (int open_fd: fds) {
+                    close(open_fd);
+                }
+                fds.clear();
+                return;
+            }
+            fds.push_back(fd);
+        }
+    }
+    ~perf_counters() {
+        for (int fd: fds) {
+            close(fd);
+        }
+    }
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    bool available() const {
+        return !fds.empty();
+    }
+    void start() {
+        if (available()) {
+            ioctl(fds.front(), PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(fds.front(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+    //the counts since start, in the order of names
+    std::vector<uint64_t> stop() {
+        if (!available()) {
+            return {};
+        }
+        ioctl(fds.front(), PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        uint64_t values[count + 1] {};
+        if (read(fds.front(), values, sizeof(values)) != sizeof(values)) {
+            return {};
+        }
+        return std::vector<uint64_t>(values + 1, values + 1 + count);
+    }
+};
+
+struct result {
+    const char* kernel;
+    const char* implementation;
+    uint64_t size;
+    uint64_t calls;
+    double ns_per_call;
+    //the kernel's own unit of work per second, loop iterations or calls
+    double items_per_second;
+    std::vector<double> counters_per_call;
+};
+
+//calls f over the prepared inputs for at least min_seconds, after one warm up pass
+template<typename Input, typename F>
+static result measure(perf_counters& counters, const std::vector<Input>& inputs, uint64_t items_per_call, F&& f) {
+    constexpr double min_seconds = 0.05;
+    volatile decltype(f(inputs.front())) sink {};
+    for (auto& input: inputs) {
+        sink = sink + f(input);
+    }
+    result r {};
+    for (uint64_t rounds = 1;; rounds *= 2) {
+        counters.start();
+        bench_timer t;
+        for (uint64_t round = 0; round < rounds; round++) {
+            for (auto& input: inputs) {
+                sink = sink + f(input);
+            }
+        }
+        double s = t.seconds();
+        auto counts = counters.stop();
+        if (s < min_seconds) {
+            continue;
+        }
+        r.calls = rounds * inputs.size();
+        r.ns_per_call = s / r.calls * 1e9;
+        r.items_per_second = r.calls * items_per_call / s;
+        for (auto c: counts) {
+            r.counters_per_call.push_back(static_cast<double>(c) / r.calls);
+        }
+        return r;
+    }
+}
+
+template<typename Input, typename A, typename B>
+static void compare(std::vector<result>& results, perf_counters& counters, const char* kernel, uint64_t size,
+    const std::vector<Input>& inputs, uint64_t items_per_call, A&& kl, B&& reference) {
+    for (auto& input: inputs) {
+        if (kl(input) != reference(input)) {
+            std::fprintf(stderr, "%s: kl and reference results differ at size %lu\n", kernel, static_cast<unsigned long>(size));
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    for (auto [implementation, r]: {
+        std::pair{"kl", measure(counters, inputs, items_per_call, kl)},
+        std::pair{"reference", measure(counters, inputs, items_per_call, reference)},
+    }) {
+        r.kernel = kernel;
+        r.implementation = implementation;
+        r.size = size;
+        std::fprintf(stderr, "%-10s %-9s %10lu %10.2f ns/call %10.3g items/s",
+            kernel, implementation, static_cast<unsigned long>(size), r.ns_per_call, r.items_per_second);
+        for (size_t i = 0; i < r.counters_per_call.size(); i++) {
+            std::fprintf(stderr, " %10.2f %s", r.counters_per_call[i], perf_counters::names[i]);
+        }
+        std::fprintf(stderr, "\n");
+        results.push_back(std::move(r));
+    }
+}
+
+static void print_json(FILE* out, const std::vector<result>& results, bool have_counters) {
+    std::fprintf(out, "{\n  \"compiler\": \"%s\",\n  \"llvm\": \"%s\",\n  \"counters\": %s,\n  \"results\": [\n",
+        KL_VERSION, LLVM_VERSION_STRING, have_counters ? "true" : "false");
+    for (size_t i = 0; i < results.size(); i++) {
+        auto& r = results[i];
+        std::fprintf(out, "    {\"kernel\": \"%s\", \"implementation\": \"%s\", \"size\": %lu, \"calls\": %lu, "
+            "\"ns_per_call\": %.4f, \"items_per_second\": %.6g",
+            r.kernel, r.implementation, static_cast<unsigned long>(r.size), static_cast<unsigned long>(r.calls),
+            r.ns_per_call, r.items_per_second);
+        for (size_t c = 0; c < perf_counters::count; c++) {
+            if (c < r.counters_per_call.size()) {
+                std::fprintf(out, ", \"%s\": %.4f", perf_counters::names[c], r.counters_per_call[c]);
+            } else {
+                std::fprintf(out, ", \"%s\": null", perf_counters::names[c]);
+            }
+        }
+        std::fprintf(out, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+}
+
+//runs each kernel from tests/ against its c++ reference over a sweep of sizes.
+//a readable table goes to stderr, and json to the file given or stdout
+int main(int argc, char *argv[]) {
+    perf_counters counters;
+    if (!counters.available()) {
+        std::fprintf(stderr, "perf_event_open unavailable, hardware counters not recorded\n");
+    }
+    std::vector<result> results;
+    std::mt19937 rng(1);
+
+    for (uint32_t n: {1u, 10u, 100u, 1000u, 10000u}) {
+        //n loop iterations per call
+        std::vector<uint32_t> inputs(256, n);
+        compare(results, counters, "fibonacci", n, inputs, n,
+            [](uint32_t input) { return fibonacci(input); },
+            [](uint32_t input) { return reference_fibonacci(input); });
+    }
+    for (uint32_t range: {100u, 10000u, 1000000u, 1000000000u}) {
+        //operands up to range, so the number of iterations grows with its log
+        std::uniform_int_distribution<uint32_t> operand(1, range);
+        std::vector<std::pair<uint32_t, uint32_t>> inputs(1024);
+        for (auto& input: inputs) {
+            input = {operand(rng), operand(rng)};
+        }
+        compare(results, counters, "gcd", range, inputs, 1,
+            [](auto& input) { return gcd(input.first, input.second); },
+            [](auto& input) { return reference_gcd(input.first, input.second); });
+    }
+    {
+        std::uniform_real_distribution<double> operand(-1e6, 1e6);
+        std::vector<std::pair<double, double>> inputs(1024);
+        for (auto& input: inputs) {
+            input = {operand(rng), operand(rng)};
+        }
+        compare(results, counters, "average", 1, inputs, 1,
+            [](auto& input) { return average(input.first, input.second); },
+            [](auto& input) { return reference_average(input.first, input.second); });
+    }
+
+    FILE* out = stdout;
+    if (argc > 1 && !(out = std::fopen(argv[1], "w"))) {
+        std::fprintf(stderr, "couldn't open %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    print_json(out, results, counters.available());
+    if (out != stdout) {
+        std::fclose(out);
+    }
+}
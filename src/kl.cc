@@ -0,0 +1,167 @@
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/ADT/StringExtras.h>
+
+#include "kl.hh"
+#include "klrt.hh"
+#include "lexer.hh"
+#include "parser.hh"
+#include "schedule.hh"
+#include "typecheck.hh"
+#include "fold.hh"
+
+namespace kl {
+
+std::string signature::to_string() const {
+    std::string s = ast::primitive_type{returntype}.to_string() + "(";
+    for (size_t i = 0; i < parameter_types.size(); i++) {
+        s += (i ? ", " : "") + ast::primitive_type{parameter_types[i]}.to_string();
+    }
+    return s + ")";
+}
+
+static void check(llvm::Error e) {
+    if (e) {
+        error("jit error:", llvm::toString(std::move(e)));
+    }
+}
+template<typename T>
+static T check(llvm::Expected<T> e) {
+    if (!e) {
+        error("jit error:", llvm::toString(e.takeError()));
+    }
+    return std::move(*e);
+}
+
+struct jit::impl {
+    optimization_level opt_level;
+    std::unique_ptr<llvm::orc::LLLazyJIT> lljit;
+    //used for the per function optimisation, tuned for the host like the jit's own
+    std::unique_ptr<llvm::TargetMachine> target_machine;
+    //compiled sources keyed by the sha1 of their text
+    std::unordered_map<std::string, std::unique_ptr<kl::module>> cache;
+    std::mutex mutex;
+};
+
+jit::jit(optimization_level opt_level): p(std::make_unique<impl>()) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    p->opt_level = opt_level;
+    p->lljit = check(llvm::orc::LLLazyJITBuilder().create());
+    //split modules into one partition per function, so only what is called is compiled
+    p->lljit->setPartitionFunction(llvm::orc::CompileOnDemandLayer::compileRequested);
+    p->target_machine = check(check(llvm::orc::JITTargetMachineBuilder::detectHost()).createTargetMachine());
+    //partitions are optimised as they are materialised, which is the first call
+    //of a function rather than when the source is added
+    impl* i = p.get();
+    p->lljit->getIRTransformLayer().setTransform(
+        [i](llvm::orc::ThreadSafeModule tsm, const llvm::orc::MaterializationResponsibility&) {
+            tsm.withModuleDo([i](llvm::Module& m) {
+                optimize_module(m, i->target_machine.get(), i->opt_level);
+            });
+            return llvm::Expected<llvm::orc::ThreadSafeModule>(std::move(tsm));
+        }
+    );
+}
+jit::~jit() = default;
+
+module& jit::compile(const std::string& source, const std::string& filename) {
+    llvm::SHA1 sha1;
+    sha1.update(source);
+    std::string key = llvm::toHex(sha1.final());
+    std::lock_guard<std::mutex> lock(p->mutex);
+    if (auto m = p->cache.find(key); m != p->cache.end()) {
+        return *m->second;
+    }
+
+    lexer_context lexer(source_string{source});
+    parser_context parser(lexer);
+    auto program_ast = parser.parse_program(filename);
+    schedule(program_ast);
+
+    typecheck_context typecheck_context{program_ast.symbols_registry};
+    typecheck(typecheck_context, program_ast);
+    fold_context fold_context;
+    fold(fold_context, program_ast);
+
+    codegen_context_llvm codegen_context_llvm{program_ast.symbols_registry};
+    codegen_context_llvm.target_cpu = "native";
+    codegen_context_llvm.target_features = "native";
+    codegen_llvm(codegen_context_llvm, program_ast, filename);
+
+    auto& dylib = p->lljit->getExecutionSession().createJITDylib("kl." + key);
+    //cpu for loops call into the runtime, which libkl links with
+    llvm::orc::MangleAndInterner mangle(p->lljit->getExecutionSession(), p->lljit->getDataLayout());
+    check(dylib.define(llvm::orc::absoluteSymbols({
+        {mangle("klrt_parallel_for"), llvm::JITEvaluatedSymbol(
+            llvm::pointerToJITTargetAddress(&klrt_parallel_for), llvm::JITSymbolFlags::Exported)},
+    })));
+    check(p->lljit->addLazyIRModule(dylib, llvm::orc::ThreadSafeModule(
+        std::move(codegen_context_llvm.module), std::move(codegen_context_llvm.owned_context))));
+
+    std::unique_ptr<module> m {new module(*this, dylib)};
+    for (auto& statement: program_ast.statements) {
+        if (!std::holds_alternative<ast::ptr<ast::function_def>>(statement.statement)) {
+            continue;
+        }
+        ast::function_def& function_def = *std::get<ast::ptr<ast::function_def>>(statement.statement);
+        if (!function_def.to_export) {
+            continue;
+        }
+        //only functions of primitive types can be called from c++
+        signature s {};
+        bool primitive = function_def.returntype.is_primitive();
+        if (primitive) {
+            s.returntype = std::get<ast::primitive_type>(function_def.returntype.type);
+        }
+        for (auto& parameter: function_def.parameter_list) {
+            primitive = primitive && parameter.type.is_primitive();
+            if (primitive) {
+                s.parameter_types.push_back(std::get<ast::primitive_type>(parameter.type.type));
+            }
+        }
+        if (primitive) {
+            m->exports.emplace(std::string{function_def.identifier.to_string(program_ast.symbols_registry)}, s);
+        }
+    }
+    return *p->cache.emplace(key, std::move(m)).first->second;
+}
+
+module& jit::compile_source(const std::string& source) {
+    return compile(source, "<source>");
+}
+module& jit::compile_file(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        error("error: couldn't open input file", filename);
+    }
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    return compile(ss.str(), filename);
+}
+size_t jit::cached_modules() const {
+    std::lock_guard<std::mutex> lock(p->mutex);
+    return p->cache.size();
+}
+
+void* module::address(const std::string& name, const signature& s) {
+    auto e = exports.find(name);
+    if (e == exports.end()) {
+        error("no exported function", name);
+    }
+    if (!(e->second == s)) {
+        error("function", name, "has type", e->second.to_string(), "not", s.to_string());
+    }
+    auto symbol = check(owner.p->lljit->lookup(dylib, name));
+    return reinterpret_cast<void*>(static_cast<uintptr_t>(symbol.getAddress()));
+}
+
+}
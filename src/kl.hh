@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "error.hh"
+#include "ast.hh"
+#include "codegen_llvm.hh"
+
+namespace llvm::orc {
+    class JITDylib;
+}
+
+//embedding api: compiles kl source in process and hands back pointers to
+//its exported functions
+//
+//    kl::jit jit;
+//    auto fibonacci = jit.compile_file("fib.kl").function<uint32_t(uint32_t)>("fibonacci");
+//    fibonacci(10);
+namespace kl {
+    //the kl type each c++ argument and return type corresponds to
+    template<typename T> struct kl_type;
+    template<> struct kl_type<void>     { static constexpr auto value = ast::primitive_type::t_void; };
+    template<> struct kl_type<bool>     { static constexpr auto value = ast::primitive_type::t_bool; };
+    template<> struct kl_type<uint8_t>  { static constexpr auto value = ast::primitive_type::u8; };
+    template<> struct kl_type<uint16_t> { static constexpr auto value = ast::primitive_type::u16; };
+    template<> struct kl_type<uint32_t> { static constexpr auto value = ast::primitive_type::u32; };
+    template<> struct kl_type<uint64_t> { static constexpr auto value = ast::primitive_type::u64; };
+    template<> struct kl_type<int8_t>   { static constexpr auto value = ast::primitive_type::i8; };
+    template<> struct kl_type<int16_t>  { static constexpr auto value = ast::primitive_type::i16; };
+    template<> struct kl_type<int32_t>  { static constexpr auto value = ast::primitive_type::i32; };
+    template<> struct kl_type<int64_t>  { static constexpr auto value = ast::primitive_type::i64; };
+    template<> struct kl_type<float>    { static constexpr auto value = ast::primitive_type::f32; };
+    template<> struct kl_type<double>   { static constexpr auto value = ast::primitive_type::f64; };
+
+    struct signature {
+        ast::primitive_type returntype;
+        std::vector<ast::primitive_type> parameter_types;
+        bool operator==(const signature& s) const {
+            return returntype == s.returntype && parameter_types == s.parameter_types;
+        }
+        std::string to_string() const;
+    };
+
+    template<typename F> struct signature_of;
+    template<typename R, typename... Args> struct signature_of<R(Args...)> {
+        static signature get() {
+            return {{kl_type<R>::value}, {ast::primitive_type{kl_type<Args>::value}...}};
+        }
+    };
+
+    class jit;
+
+    //one compiled source. its functions are only optimised and compiled to
+    //machine code the first time they are called
+    class module {
+        friend class jit;
+        jit& owner;
+        //the jit dylib holding this source's symbols, so sources can export the same names
+        llvm::orc::JITDylib& dylib;
+        std::unordered_map<std::string, signature> exports;
+        module(jit& owner, llvm::orc::JITDylib& dylib): owner(owner), dylib(dylib) {}
+        void* address(const std::string& name, const signature& s);
+    public:
+        module(const module&) = delete;
+        module& operator=(const module&) = delete;
+
+        //a pointer to the exported function name, which must have the kl
+        //types matching F, e.g. function<uint32_t(uint32_t, uint32_t)>("gcd")
+        template<typename F>
+        F* function(const std::string& name) {
+            return reinterpret_cast<F*>(address(name, signature_of<F>::get()));
+        }
+    };
+
+    class jit {
+        friend class module;
+        struct impl;
+        std::unique_ptr<impl> p;
+        module& compile(const std::string& source, const std::string& filename);
+    public:
+        explicit jit(optimization_level opt_level = optimization_level::O2);
+        ~jit();
+        jit(const jit&) = delete;
+        jit& operator=(const jit&) = delete;
+
+        //compile errors are thrown as compile_error. compiling the same
+        //source again returns the module already compiled for it
+        module& compile_source(const std::string& source);
+        module& compile_file(const std::string& filename);
+
+        size_t cached_modules() const;
+    };
+}
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "klrt.hh"
+
+namespace {
+
+struct loop {
+    void (*body)(void*, uint64_t, uint64_t);
+    void* context;
+    uint64_t grain;
+    //iterations that haven't finished, the loop is done at zero
+    std::atomic<uint64_t> remaining;
+};
+
+struct task {
+    loop* l;
+    uint64_t first;
+    uint64_t last;
+};
+
+//a thread's ranges. it takes the last one, the smallest and most recently
+//split off, and other threads steal the first, the largest
+struct task_deque {
+    std::mutex mutex;
+    std::deque<task> tasks;
+};
+
+class pool {
+private:
+    //one per thread of the pool, and deques[0] for the threads calling into it
+    std::vector<std::unique_ptr<task_deque>> deques;
+    std::vector<std::thread> threads;
+    std::atomic<bool> stopping {false};
+    //idle threads sleep until there is something to steal
+    std::atomic<size_t> queued {0};
+    std::atomic<size_t> sleeping {0};
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+
+    static thread_local size_t self;
+
+    void push(const task& t) {
+        {
+            std::lock_guard<std::mutex> lock(deques[self]->mutex);
+            deques[self]->tasks.push_back(t);
+            //counted before it can be taken, so queued never goes below zero
+            queued++;
+        }
+        if (sleeping.load() > 0) {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            wake.notify_one();
+        }
+    }
+    bool pop(task& t) {
+        task_deque& d = *deques[self];
+        std::lock_guard<std::mutex> lock(d.mutex);
+        if (d.tasks.empty()) {
+            return false;
+        }
+        t = d.tasks.back();
+        d.tasks.pop_back();
+        queued--;
+        return true;
+    }
+    bool steal(task& t) {
+        //starting from a different victim on each thread spreads the thieves out
+        static thread_local uint32_t seed = static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id())) | 1;
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        for (size_t i = 0; i < deques.size(); i++) {
+            size_t victim = (seed + i) % deques.size();
+            if (victim == self) {
+                continue;
+            }
+            task_deque& d = *deques[victim];
+            std::lock_guard<std::mutex> lock(d.mutex);
+            if (!d.tasks.empty()) {
+                t = d.tasks.front();
+                d.tasks.pop_front();
+                queued--;
+                return true;
+            }
+        }
+        return false;
+    }
+    //splits off the top half of the range until it's at most the grain, so
+    //idle threads have something large to steal, then runs what's left
+    void run(task t) {
+        while (t.last - t.first > t.l->grain) {
+            uint64_t middle = t.first + (t.last - t.first) / 2;
+            push({t.l, middle, t.last});
+            t.last = middle;
+        }
+        t.l->body(t.l->context, t.first, t.last);
+        t.l->remaining.fetch_sub(t.last - t.first, std::memory_order_release);
+    }
+    bool run_one() {
+        task t;
+        if (pop(t) || steal(t)) {
+            run(t);
+            return true;
+        }
+        return false;
+    }
+    void work(size_t index) {
+        self = index;
+        while (!stopping.load()) {
+            bool found = false;
+            for (int spin = 0; spin < 64 && !found; spin++) {
+                found = run_one();
+                if (!found) {
+                    std::this_thread::yield();
+                }
+            }
+            if (found) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleeping++;
+            wake.wait(lock, [this]() {
+                return stopping.load() || queued.load() > 0;
+            });
+            sleeping--;
+        }
+    }
+public:
+    const uint32_t workers;
+
+    pool(uint32_t workers): workers(std::max<uint32_t>(workers, 1)) {
+        for (uint32_t i = 0; i < this->workers; i++) {
+            deques.push_back(std::make_unique<task_deque>());
+        }
+        for (uint32_t i = 1; i < this->workers; i++) {
+            threads.emplace_back(&pool::work, this, i);
+        }
+    }
+    ~pool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread: threads) {
+            thread.join();
+        }
+    }
+    void parallel_for(uint64_t count, uint64_t grain, void (*body)(void*, uint64_t, uint64_t), void* context) {
+        if (grain == 0) {
+            grain = std::max<uint64_t>(count / (workers * 8), 1);
+        }
+        if (workers == 1 || count <= grain) {
+            body(context, 0, count);
+            return;
+        }
+        loop l {body, context, grain, {count}};
+        run({&l, 0, count});
+        //waiting threads run other ranges, of this loop or any other, so
+        //nested loops don't leave threads blocked
+        while (l.remaining.load(std::memory_order_acquire) != 0) {
+            if (!run_one()) {
+                std::this_thread::yield();
+            }
+        }
+    }
+};
+
+thread_local size_t pool::self = 0;
+
+std::mutex pool_mutex;
+std::atomic<pool*> current_pool {nullptr};
+
+uint32_t default_workers() {
+    if (const char* workers = std::getenv("KLRT_WORKERS")) {
+        return std::max(std::atoi(workers), 1);
+    }
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+pool& get_pool() {
+    pool* p = current_pool.load(std::memory_order_acquire);
+    if (!p) {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        p = current_pool.load();
+        if (!p) {
+            p = new pool(default_workers());
+            current_pool.store(p, std::memory_order_release);
+        }
+    }
+    return *p;
+}
+
+}
+
+extern "C" {
+
+void klrt_parallel_for(uint64_t count, uint64_t grain, void (*body)(void*, uint64_t, uint64_t), void* context) {
+    if (count == 0) {
+        return;
+    }
+    get_pool().parallel_for(count, grain, body, context);
+}
+
+uint32_t klrt_workers() {
+    return get_pool().workers;
+}
+
+void klrt_set_workers(uint32_t workers) {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    delete current_pool.exchange(new pool(workers));
+}
+
+}
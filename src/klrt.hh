@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+//the runtime library kernels link with, for cpu for loops
+extern "C" {
+    //runs body(context, first, last) over ranges covering the iterations 0
+    //to count, on the calling thread and the pool's, and returns once all of
+    //them have run. ranges are split in half until they're at most grain
+    //iterations, 0 picks a grain giving each thread a few ranges. loops can
+    //be nested, a thread waiting for one runs other ranges in the meantime
+    void klrt_parallel_for(uint64_t count, uint64_t grain, void (*body)(void*, uint64_t, uint64_t), void* context);
+    //the number of threads loops run on, including the one calling them,
+    //from KLRT_WORKERS or the number of cpus
+    uint32_t klrt_workers();
+    //replaces the pool with one of this many threads. not while a loop runs
+    void klrt_set_workers(uint32_t workers);
+}
@@ -1,176 +1,284 @@
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <optional>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <cassert>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "lexer.hh"
 #include "error.hh"
 #include "ast.hh"
 #include "tokens.hh"
 
-bool lexer_context::lex_string(std::string s, bool word_boundary) {
-    backtrack_point bp(in);
-    if (!std::equal(
-        s.begin(), s.end(),
-        std::istreambuf_iterator<char>(in)
-    )) {
-        return false;
+source_buffer::source_buffer(std::string filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error("error: couldn't open input file", filename);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED) {
+            madvise(m, st.st_size, MADV_SEQUENTIAL);
+            mapping = m;
+            data = static_cast<const char*>(m);
+            size = st.st_size;
+        }
+    }
+    close(fd);
+    if (!mapping) {
+        std::ifstream in(filename, std::ios::binary);
+        std::ostringstream ss;
+        ss << in.rdbuf();
+        owned = ss.str();
+        data = owned.data();
+        size = owned.size();
     }
-    char c = in.peek();
-    if (word_boundary && (std::isalnum(c) || c == '_')) {
+}
+source_buffer::source_buffer(source_string source) {
+    owned = std::move(source.text);
+    data = owned.data();
+    size = owned.size();
+}
+source_buffer::~source_buffer() {
+    if (mapping) {
+        munmap(mapping, size);
+    }
+}
+
+bool lexer_context::lex_string(std::string_view s, bool word_boundary) {
+    if (source.size - pos < s.size() || std::memcmp(source.data + pos, s.data(), s.size()) != 0) {
         return false;
     }
-    bp.disable();
+    if (word_boundary && pos + s.size() < source.size) {
+        char c = source.data[pos + s.size()];
+        if (std::isalnum(c) || c == '_') {
+            return false;
+        }
+    }
+    pos += s.size();
     return true;
 }
-std::optional<std::string> lexer_context::lex_word() {
-    if (!std::isalpha(in.peek())) {
+std::optional<std::string_view> lexer_context::lex_word() {
+    if (!std::isalpha(peek())) {
         return std::nullopt;
     }
-    std::string s;
-    for (char c = in.peek(); std::isalnum(c) || c == '_'; c = in.peek()) {
-        in.get();
-        s += c;
+    size_t start = pos;
+    for (char c = peek(); std::isalnum(c) || c == '_'; c = peek()) {
+        pos++;
     }
-    return {s};
+    return {source.view().substr(start, pos - start)};
 }
-bool lexer_context::lex_keyword(std::string keyword) {
-    return lex_string(keyword, true);
+namespace {
+
+//every word the lexer gives a meaning to, classified in one lookup by a
+//perfect hash that is searched for at compile time
+enum class word_kind {
+    keyword, reserved, primitive_type, literal_bool,
+};
+struct word_info {
+    std::string_view text;
+    word_kind kind;
+    token_type token {};
+    ast::primitive_type::e type {};
+    bool value {};
+};
+constexpr word_info words[] = {
+    {"var",      word_kind::keyword, token_type::VAR},
+    {"if",       word_kind::keyword, token_type::IF},
+    {"elif",     word_kind::keyword, token_type::ELIF},
+    {"else",     word_kind::keyword, token_type::ELSE},
+    {"for",      word_kind::keyword, token_type::FOR},
+    {"while",    word_kind::keyword, token_type::WHILE},
+    {"simd",     word_kind::keyword, token_type::SIMD},
+    {"cpu",      word_kind::keyword, token_type::CPU},
+    {"fn",       word_kind::keyword, token_type::FUNCTION},
+    {"return",   word_kind::keyword, token_type::RETURN},
+    {"break",    word_kind::keyword, token_type::BREAK},
+    {"continue", word_kind::keyword, token_type::CONTINUE},
+    {"switch",   word_kind::keyword, token_type::SWITCH},
+    {"case",     word_kind::keyword, token_type::CASE},
+    {"import",   word_kind::keyword, token_type::IMPORT},
+    {"export",   word_kind::keyword, token_type::EXPORT},
+    {"struct",   word_kind::keyword, token_type::STRUCT},
+    {"type",     word_kind::keyword, token_type::TYPE},
+    {"schedule", word_kind::keyword, token_type::SCHEDULE},
+
+    {"const",    word_kind::reserved},
+    {"auto",     word_kind::reserved},
+    {"sizeof",   word_kind::reserved},
+    {"offsetof", word_kind::reserved},
+    {"typeof",   word_kind::reserved},
+    {"static",   word_kind::reserved},
+    {"repl",     word_kind::reserved},
+    {"gpu",      word_kind::reserved},
+    {"fpga",     word_kind::reserved},
+    {"f8",       word_kind::reserved},
+
+    {"void",     word_kind::primitive_type, {}, ast::primitive_type::t_void},
+    {"bool",     word_kind::primitive_type, {}, ast::primitive_type::t_bool},
+    {"u8",       word_kind::primitive_type, {}, ast::primitive_type::u8},
+    {"u16",      word_kind::primitive_type, {}, ast::primitive_type::u16},
+    {"u32",      word_kind::primitive_type, {}, ast::primitive_type::u32},
+    {"u64",      word_kind::primitive_type, {}, ast::primitive_type::u64},
+    {"i8",       word_kind::primitive_type, {}, ast::primitive_type::i8},
+    {"i16",      word_kind::primitive_type, {}, ast::primitive_type::i16},
+    {"i32",      word_kind::primitive_type, {}, ast::primitive_type::i32},
+    {"i64",      word_kind::primitive_type, {}, ast::primitive_type::i64},
+    {"f16",      word_kind::primitive_type, {}, ast::primitive_type::f16},
+    {"f32",      word_kind::primitive_type, {}, ast::primitive_type::f32},
+    {"f64",      word_kind::primitive_type, {}, ast::primitive_type::f64},
+
+    {"true",     word_kind::literal_bool, {}, {}, true},
+    {"false",    word_kind::literal_bool, {}, {}, false},
+};
+constexpr size_t num_words = sizeof(words) / sizeof(words[0]);
+constexpr size_t word_table_size = 256;
+static_assert(num_words < word_table_size, "word table too small");
+
+constexpr uint32_t hash_word(std::string_view s, uint32_t seed) {
+    uint32_t h = seed;
+    for (char c: s) {
+        h = (h ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return h;
 }
-std::optional<token_type> lexer_context::lex_any_keyword() {
-    if (false) {
-    } else if (lex_keyword("var")) {
-        return token_type::VAR;
-    } else if (lex_keyword("if")) {
-        return token_type::IF;
-    } else if (lex_keyword("elif")) {
-        return token_type::ELIF;
-    } else if (lex_keyword("else")) {
-        return token_type::ELSE;
-    } else if (lex_keyword("for")) {
-        return token_type::FOR;
-    } else if (lex_keyword("while")) {
-        return token_type::WHILE;
-    } else if (lex_keyword("fn")) {
-        return token_type::FUNCTION;
-    } else if (lex_keyword("return")) {
-        return token_type::RETURN;
-    } else if (lex_keyword("break")) {
-        return token_type::BREAK;
-    } else if (lex_keyword("continue")) {
-        return token_type::CONTINUE;
-    } else if (lex_keyword("switch")) {
-        return token_type::SWITCH;
-    } else if (lex_keyword("case")) {
-        return token_type::CASE;
-    } else if (lex_keyword("import")) {
-        return token_type::IMPORT;
-    } else if (lex_keyword("export")) {
-        return token_type::EXPORT;
-    } else if (lex_keyword("struct")) {
-        return token_type::STRUCT;
-    } else if (lex_keyword("type")) {
-        return token_type::TYPE;
-    } else {
-        return std::nullopt;
+constexpr uint32_t find_word_seed() {
+    for (uint32_t seed = 2166136261u; ; seed++) {
+        bool used[word_table_size] = {};
+        bool collision = false;
+        for (auto& w: words) {
+            size_t i = hash_word(w.text, seed) % word_table_size;
+            collision |= used[i];
+            used[i] = true;
+        }
+        if (!collision) {
+            return seed;
+        }
+    }
+}
+constexpr uint32_t word_seed = find_word_seed();
+
+struct word_table {
+    //index + 1 into words, 0 for an empty slot
+    uint8_t slots[word_table_size];
+};
+constexpr word_table make_word_table() {
+    word_table t {};
+    for (size_t i = 0; i < num_words; i++) {
+        t.slots[hash_word(words[i].text, word_seed) % word_table_size] = i + 1;
+    }
+    return t;
+}
+constexpr word_table word_lookup = make_word_table();
+
+const word_info* find_word(std::string_view s) {
+    uint8_t slot = word_lookup.slots[hash_word(s, word_seed) % word_table_size];
+    if (slot != 0 && words[slot - 1].text == s) {
+        return &words[slot - 1];
     }
+    return nullptr;
 }
-void lexer_context::lex_reserved_keyword() {
-    if (false) {
-    } else if (lex_keyword("const")) {
-        error("error, use of reserved keyword const");
-    } else if (lex_keyword("auto")) {
-        error("error, use of reserved keyword auto");
-    } else if (lex_keyword("sizeof")) {
-        error("error, use of reserved keyword sizeof");
-    } else if (lex_keyword("offsetof")) {
-        error("error, use of reserved keyword offsetof");
-    } else if (lex_keyword("typeof")) {
-        error("error, use of reserved keyword typeof");
-    } else if (lex_keyword("static")) {
-        error("error, use of reserved keyword static");
-    } else if (lex_keyword("repl")) {
-        error("error, use of reserved keyword repl");
-    } else if (lex_keyword("cpu")) {
-        error("error, use of reserved keyword cpu");
-    } else if (lex_keyword("simd")) {
-        error("error, use of reserved keyword simd");
-    } else if (lex_keyword("gpu")) {
-        error("error, use of reserved keyword gpu");
-    } else if (lex_keyword("fpga")) {
-        error("error, use of reserved keyword fpga");
-    } else if (lex_keyword("f8")) {
-        error("error, use of reserved keyword f8");
+
+//vector types are a primitive type and a number of lanes, like f32x4 or u8x32,
+//so they're recognised by their parts rather than each being in the table
+std::optional<ast::primitive_type> find_vector_type(std::string_view s) {
+    if (!std::isdigit(s.back())) {
+        return std::nullopt;
+    }
+    size_t x = s.rfind('x');
+    if (x == std::string_view::npos || x + 1 == s.size()) {
+        return std::nullopt;
+    }
+    const word_info* w = find_word(s.substr(0, x));
+    if (!w || w->kind != word_kind::primitive_type || w->type == ast::primitive_type::t_void) {
+        return std::nullopt;
+    }
+    size_t lanes = 0;
+    for (char c: s.substr(x + 1)) {
+        if (!std::isdigit(c) || lanes > 64) {
+            return std::nullopt;
+        }
+        lanes = lanes * 10 + (c - '0');
+    }
+    if (lanes < 2 || lanes > 64 || (lanes & (lanes - 1)) != 0) {
+        error("error, vector types have 2, 4, 8, 16, 32 or 64 lanes. got", s);
     }
+    return ast::primitive_type{w->type, static_cast<uint8_t>(lanes)};
 }
-std::optional<std::string> lexer_context::lex_identifier() {
-    return lex_word();
+
 }
-std::optional<ast::primitive_type> lexer_context::lex_primitive_type() {
-    if (false) {
-    } else if (lex_keyword("void")) {
-        return ast::primitive_type{ast::primitive_type::t_void};
-    } else if (lex_keyword("bool")) {
-        return ast::primitive_type{ast::primitive_type::t_bool};
-    } else if (lex_keyword("u8")) {
-        return ast::primitive_type{ast::primitive_type::u8};
-    } else if (lex_keyword("u16")) {
-        return ast::primitive_type{ast::primitive_type::u16};
-    } else if (lex_keyword("u32")) {
-        return ast::primitive_type{ast::primitive_type::u32};
-    } else if (lex_keyword("u64")) {
-        return ast::primitive_type{ast::primitive_type::u64};
-    } else if (lex_keyword("i8")) {
-        return ast::primitive_type{ast::primitive_type::i8};
-    } else if (lex_keyword("i16")) {
-        return ast::primitive_type{ast::primitive_type::i16};
-    } else if (lex_keyword("i32")) {
-        return ast::primitive_type{ast::primitive_type::i32};
-    } else if (lex_keyword("i64")) {
-        return ast::primitive_type{ast::primitive_type::i64};
-    } else if (lex_keyword("f16")) {
-        return ast::primitive_type{ast::primitive_type::f16};
-    } else if (lex_keyword("f32")) {
-        return ast::primitive_type{ast::primitive_type::f32};
-    } else if (lex_keyword("f64")) {
-        return ast::primitive_type{ast::primitive_type::f64};
-    } else {
+
+std::optional<token_type> lexer_context::lex_word_token() {
+    std::optional<std::string_view> s = lex_word();
+    if (!s) {
         return std::nullopt;
     }
+    const word_info* w = find_word(s.value());
+    if (!w) {
+        if (auto vector_type = find_vector_type(s.value())) {
+            current_param = vector_type.value();
+            return token_type::PRIMITIVE_TYPE;
+        }
+        current_param = symbols_registry.insert(s.value());
+        return token_type::IDENTIFIER;
+    }
+    switch (w->kind) {
+        case word_kind::keyword:
+            return w->token;
+        case word_kind::reserved:
+            error("error, use of reserved keyword", w->text);
+        case word_kind::primitive_type:
+            current_param = ast::primitive_type{w->type};
+            return token_type::PRIMITIVE_TYPE;
+        case word_kind::literal_bool:
+            current_param = w->value;
+            return token_type::LITERAL_BOOL;
+    }
+    assert(false);
 }
 std::optional<ast::literal_integer> lexer_context::lex_literal_integer() {
-    backtrack_point bp(in);
+    backtrack_point bp(pos);
     //parse sign
     bool positive = true;
-    char c = in.peek();
+    char c = peek();
     if (c == '+') {
-        in.get();
+        get();
     } else if (c == '-') {
         positive = false;
-        in.get();
+        get();
     }
-    if (!std::isdigit(in.peek())) {
+    if (!std::isdigit(peek())) {
         return std::nullopt;
     }
     //parse base
     uint8_t base = 10;
-    c = in.peek();
+    c = peek();
     if (c == '0') {
-        in.get();
-        c = in.peek();
+        get();
+        c = peek();
         if (c == 'b' || c == 'B') {
             base =  2;
-            in.get();
+            get();
         } else if (c == 'o' || c == 'O') {
             base =  8;
-            in.get();
+            get();
         } else if (c == 'x' || c == 'X') {
             base = 16;
-            in.get();
+            get();
         }
     }
     //parse digits
     uint64_t value = 0;
-    while (!in.eof()) {
-        c = in.peek();
+    while (!eof()) {
+        c = peek();
         if (base <= 10 && c >= '0' && c <= '0' + base - 1) {
             value *= base;
             value += c - '0';
@@ -187,7 +295,7 @@ std::optional<ast::literal_integer> lexer_context::lex_literal_integer() {
         } else {
             break;
         }
-        in.get();
+        get();
     }
     if (c == '.') {
         return std::nullopt;
@@ -195,128 +303,109 @@ std::optional<ast::literal_integer> lexer_context::lex_literal_integer() {
     bp.disable();
     return {ast::literal_integer{positive ? value : -value}};
 }
-std::optional<bool> lexer_context::lex_literal_bool() {
-    if (lex_keyword("true")) {
-        return {true};
-    } else if (lex_keyword("false")) {
-        return {false};
-    }
-    return std::nullopt;
-}
 std::optional<double> lexer_context::lex_literal_float() {
-    backtrack_point bp(in);
-    double d;
-    in >> d;
-    if (!in.fail()) {
-        bp.disable();
-        return {d};
-    }
-    in.clear();
-    return std::nullopt;
-}
-std::optional<token_type> lexer_context::lex_any_char() {
-    if (false) {
-    } else if (lex_string(";")) {
-        return {token_type::SEMICOLON};
-    } else if (lex_string(",")) {
-        return {token_type::COMMA};
-    } else if (lex_string("(")) {
-        return {token_type::OPEN_R_BRACKET};
-    } else if (lex_string(")")) {
-        return {token_type::CLOSE_R_BRACKET};
-    } else if (lex_string("[")) {
-        return {token_type::OPEN_S_BRACKET};
-    } else if (lex_string("]")) {
-        return {token_type::CLOSE_S_BRACKET};
-    } else if (lex_string("{")) {
-        return {token_type::OPEN_C_BRACKET};
-    } else if (lex_string("}")) {
-        return {token_type::CLOSE_C_BRACKET};
-    } else if (lex_string(".")) {
-        return {token_type::OP_ACCESS};
-    } else if (lex_string("=")) {
-        return {token_type::OP_ASSIGN};
-    } else {
+    //scan the span of a decimal float, then hand a copy of just that span to
+    //strtod, as the mapping isn't null terminated
+    size_t start = pos;
+    size_t end = pos;
+    auto digits = [&]() {
+        size_t d = end;
+        while (end < source.size && std::isdigit(source.data[end])) {
+            end++;
+        }
+        return end - d;
+    };
+    if (end < source.size && (source.data[end] == '+' || source.data[end] == '-')) {
+        end++;
+    }
+    size_t n = digits();
+    if (end < source.size && source.data[end] == '.') {
+        end++;
+        n += digits();
+    }
+    if (n == 0) {
         return std::nullopt;
     }
+    if (end < source.size && (source.data[end] == 'e' || source.data[end] == 'E')) {
+        size_t mantissa_end = end++;
+        if (end < source.size && (source.data[end] == '+' || source.data[end] == '-')) {
+            end++;
+        }
+        if (digits() == 0) {
+            end = mantissa_end;
+        }
+    }
+    std::string s{source.data + start, end - start};
+    pos = end;
+    return {std::strtod(s.c_str(), nullptr)};
 }
-std::optional<token_type> lexer_context::lex_operator() {
-    if (false) {
-    } else if (lex_string("+")) {
-        return {token_type::OP_A_ADD};
-    } else if (lex_string("-")) {
-        return {token_type::OP_A_SUB};
-    } else if (lex_string("*")) {
-        return {token_type::OP_A_MUL};
-    } else if (lex_string("/")) {
-        return {token_type::OP_A_DIV};
-    } else if (lex_string("%")) {
-        return {token_type::OP_A_MOD};
-
-    } else if (lex_string("|")) {
-        return {token_type::OP_B_OR};
-    } else if (lex_string("^")) {
-        return {token_type::OP_B_XOR};
-    } else if (lex_string("~")) {
-        return {token_type::OP_B_NOT};
-    } else if (lex_string("<<")) {
-        return {token_type::OP_B_SHL};
-    } else if (lex_string(">>")) {
-        return {token_type::OP_B_SHR};
-
-    } else if (lex_string("&&")) {
-        return {token_type::OP_L_AND};
-    } else if (lex_string("||")) {
-        return {token_type::OP_L_OR};
-
-    } else if (lex_string("==")) {
-        return {token_type::OP_C_EQ};
-    } else if (lex_string("!=")) {
-        return {token_type::OP_C_NE};
-    } else if (lex_string(">=")) {
-        return {token_type::OP_C_GE};
-    } else if (lex_string(">")) {
-        return {token_type::OP_C_GT};
-    } else if (lex_string("<=")) {
-        return {token_type::OP_C_LE};
-    } else if (lex_string("<")) {
-        return {token_type::OP_C_LT};
-
-    } else if (lex_string("&")) {
-        return {token_type::OP_B_AND};
-    } else if (lex_string("!")) {
-        return {token_type::OP_L_NOT};
-    } else {
-        return std::nullopt;
+std::optional<token_type> lexer_context::lex_punctuation() {
+    //longest match over the operator and punctuation characters, deciding
+    //on at most one character of lookahead
+    char c = peek();
+    char n = pos + 1 < source.size ? source.data[pos + 1] : '\0';
+    auto one = [this](token_type t) {
+        pos += 1;
+        return std::optional<token_type>{t};
+    };
+    auto two = [this](token_type t) {
+        pos += 2;
+        return std::optional<token_type>{t};
+    };
+    switch (c) {
+        case ';': return one(token_type::SEMICOLON);
+        case ',': return one(token_type::COMMA);
+        case '(': return one(token_type::OPEN_R_BRACKET);
+        case ')': return one(token_type::CLOSE_R_BRACKET);
+        case '[': return one(token_type::OPEN_S_BRACKET);
+        case ']': return one(token_type::CLOSE_S_BRACKET);
+        case '{': return one(token_type::OPEN_C_BRACKET);
+        case '}': return one(token_type::CLOSE_C_BRACKET);
+        case '.': return one(token_type::OP_ACCESS);
+        case '+': return one(token_type::OP_A_ADD);
+        case '-': return one(token_type::OP_A_SUB);
+        case '*': return one(token_type::OP_A_MUL);
+        case '/': return one(token_type::OP_A_DIV);
+        case '%': return one(token_type::OP_A_MOD);
+        case '^': return one(token_type::OP_B_XOR);
+        case '~': return one(token_type::OP_B_NOT);
+        case '|': return n == '|' ? two(token_type::OP_L_OR) : one(token_type::OP_B_OR);
+        case '&': return n == '&' ? two(token_type::OP_L_AND) : one(token_type::OP_B_AND);
+        case '=': return n == '=' ? two(token_type::OP_C_EQ) : one(token_type::OP_ASSIGN);
+        case '!': return n == '=' ? two(token_type::OP_C_NE) : one(token_type::OP_L_NOT);
+        case '<':
+            if (n == '<') {
+                return two(token_type::OP_B_SHL);
+            }
+            return n == '=' ? two(token_type::OP_C_LE) : one(token_type::OP_C_LT);
+        case '>':
+            if (n == '>') {
+                return two(token_type::OP_B_SHR);
+            }
+            return n == '=' ? two(token_type::OP_C_GE) : one(token_type::OP_C_GT);
+        default:
+            return std::nullopt;
     }
 }
 bool lexer_context::lex_whitespace() {
-    std::ios::pos_type p0 = in.tellg();
-    in >> std::ws;
-    std::ios::pos_type p1 = in.tellg();
-    return p1 > p0;
+    size_t p0 = pos;
+    while (!eof() && std::isspace(peek())) {
+        pos++;
+    }
+    return pos > p0;
 }
 bool lexer_context::lex_comment() {
     if (lex_string("//")) {
-        in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        const void* nl = std::memchr(source.data + pos, '\n', source.size - pos);
+        pos = nl ? static_cast<const char*>(nl) - source.data + 1 : source.size;
         return true;
     } else if (lex_string("/*")) {
-        std::string end = "*/";
-        auto end_it = std::istreambuf_iterator<char>();
-        auto it = std::search(
-            std::istreambuf_iterator<char>(in), end_it,
-            end.begin(), end.end()
-        );
-        if (it == end_it) {
+        size_t end = source.view().find("*/", pos);
+        if (end == std::string_view::npos) {
             error("didn't get a matching close comment */");
-        } else {
-            it++;
-            return true;
         }
-    }
-    if (in.fail()) {
-        in.clear();
-        in.peek();
+        pos = end + 2;
+        return true;
     }
     return false;
 }
@@ -324,43 +413,63 @@ void lexer_context::lex_space() {
     while (lex_whitespace() || lex_comment()) {}
 }
 token_type lexer_context::yylex() {
-    std::optional<std::string> s;
-    std::optional<ast::primitive_type> type;
-    std::optional<bool> literal_bool;
     std::optional<ast::literal_integer> literal_integer;
     std::optional<double> literal_float;
     std::optional<token_type> tok;
 
     lex_space();
-    if (in.eof()) {
+    token_start = pos;
+    if (eof()) {
         return token_type::T_EOF;
     }
-    lex_reserved_keyword();
-    if (false) {
-    } else if ((tok = lex_any_keyword())) {
-        return tok.value();
-    } else if ((type = lex_primitive_type())) {
-        current_param = type.value();
-        return token_type::PRIMITIVE_TYPE;
-    } else if ((literal_bool = lex_literal_bool())) {
-        current_param = literal_bool.value();
-        return token_type::LITERAL_BOOL;
-    } else if ((literal_integer = lex_literal_integer())) {
-        current_param = literal_integer.value();
-        return token_type::LITERAL_INTEGER;
-    } else if ((literal_float = lex_literal_float())) {
-        current_param = literal_float.value();
-        return token_type::LITERAL_FLOAT;
-    } else if ((s = lex_identifier())) {
-        current_param = symbols_registry.insert(s.value());
-        return token_type::IDENTIFIER;
-    } else if ((tok = lex_operator())) {
-        return tok.value();
-    } else if ((tok = lex_any_char())) {
+    char c = peek();
+    if (std::isalpha(c)) {
+        return lex_word_token().value();
+    }
+    if (std::isdigit(c) || c == '+' || c == '-' || c == '.') {
+        if ((literal_integer = lex_literal_integer())) {
+            current_param = literal_integer.value();
+            return token_type::LITERAL_INTEGER;
+        } else if ((literal_float = lex_literal_float())) {
+            current_param = literal_float.value();
+            return token_type::LITERAL_FLOAT;
+        }
+    }
+    if ((tok = lex_punctuation())) {
         return tok.value();
-    } else {
-        std::string s;
-        in >> s;
-        error("error: unknown input", s);
     }
+    std::string_view rest = source.view().substr(pos);
+    error("error: unknown input", rest.substr(0, rest.find_first_of(" \t\r\n")));
+}
+token_stream lexer_context::tokenize() {
+    token_stream tokens;
+    //generous guess of one token per three bytes, to avoid regrowth
+    size_t guess = source.size / 3 + 1;
+    tokens.kinds.reserve(guess);
+    tokens.payloads.reserve(guess);
+    tokens.offsets.reserve(guess);
+    tokens.params.push_back({});
+    while (true) {
+        token_type t = yylex();
+        uint32_t payload = 0;
+        switch (t) {
+            case token_type::PRIMITIVE_TYPE:
+            case token_type::LITERAL_BOOL:
+            case token_type::LITERAL_INTEGER:
+            case token_type::LITERAL_FLOAT:
+            case token_type::IDENTIFIER:
+                payload = tokens.params.size();
+                tokens.params.push_back(current_param);
+                break;
+            default:
+                break;
+        }
+        tokens.kinds.push_back(t);
+        tokens.payloads.push_back(payload);
+        tokens.offsets.push_back(token_start);
+        if (t == token_type::T_EOF) {
+            break;
+        }
+    }
+    return tokens;
 }
@@ -1,58 +1,99 @@
 #pragma once
 
 #include <iostream>
-#include <fstream>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "error.hh"
 #include "ast.hh"
 #include "tokens.hh"
 
+//source text held in memory rather than read from a file
+struct source_string {
+    std::string text;
+};
+
+struct source_buffer {
+    //the whole input, either mmapped from a file or owned in memory
+    //(for inputs that can't be mapped, like pipes or empty files)
+    const char* data = nullptr;
+    size_t size = 0;
+    void* mapping = nullptr;
+    std::string owned;
+
+    source_buffer(std::string filename);
+    source_buffer(source_string source);
+    source_buffer(const source_buffer&) = delete;
+    source_buffer& operator=(const source_buffer&) = delete;
+    ~source_buffer();
+
+    std::string_view view() const {
+        return {data, size};
+    }
+};
+
+using param_type = std::variant<ast::primitive_type, ast::identifier, bool, ast::literal_integer, double>;
+
+struct token_stream {
+    //the whole token stream of a file as parallel arrays, indexed by token
+    std::vector<token_type> kinds;
+    //index into params, 0 for tokens without a parameter
+    std::vector<uint32_t> payloads;
+    //offset of the start of the token in the source
+    std::vector<uint32_t> offsets;
+    std::vector<param_type> params;
+
+    size_t size() const {
+        return kinds.size();
+    }
+};
+
 struct lexer_context {
-    using param_type = std::variant<ast::primitive_type, ast::identifier, bool, ast::literal_integer, double>;
-    std::ifstream in;
-    bi_registry<ast::identifier, std::string> symbols_registry;
+    source_buffer source;
+    size_t pos = 0;
+    size_t token_start = 0;
+    interner<ast::identifier> symbols_registry;
     param_type current_param {};
 
-    lexer_context(std::string filename): in(std::ifstream(filename, std::ios::binary)) {
-        in >> std::noskipws;
-        in.exceptions(std::istream::badbit);
-    }
+    lexer_context(std::string filename): source(filename) {}
+    lexer_context(source_string source): source(std::move(source)) {}
 
     struct backtrack_point {
-        std::optional<std::ios::pos_type> p;
-        std::ifstream& in_;
-        backtrack_point(std::ifstream& in): in_(in) {
-            p = {in_.tellg()};
-        }
+        size_t p;
+        bool enabled = true;
+        size_t& pos_;
+        backtrack_point(size_t& pos): p(pos), pos_(pos) {}
         void disable() {
-            p = std::nullopt;
+            enabled = false;
         }
         ~backtrack_point() {
-            if (p) {
-                in_.clear();
-                in_.seekg(*p);
-                if (in_.tellg() != p) {
-                    error("error: failed to backtrack in input stream");
-                }
+            if (enabled) {
+                pos_ = p;
             }
         }
     };
 
-    bool lex_string(std::string s, bool word_boundary = false);
-    std::optional<std::string> lex_word();
-    bool lex_keyword(std::string keyword);
-    std::optional<token_type> lex_any_keyword();
-    void lex_reserved_keyword();
-    std::optional<std::string> lex_identifier();
-    std::optional<ast::primitive_type> lex_primitive_type();
-    std::optional<bool> lex_literal_bool();
+    bool eof() const {
+        return pos >= source.size;
+    }
+    char peek() const {
+        return eof() ? '\0' : source.data[pos];
+    }
+    char get() {
+        return eof() ? '\0' : source.data[pos++];
+    }
+
+    bool lex_string(std::string_view s, bool word_boundary = false);
+    std::optional<std::string_view> lex_word();
+    std::optional<token_type> lex_word_token();
     std::optional<ast::literal_integer> lex_literal_integer();
     std::optional<double> lex_literal_float();
-    std::optional<token_type> lex_any_char();
-    std::optional<token_type> lex_operator();
+    std::optional<token_type> lex_punctuation();
     bool lex_whitespace();
     bool lex_comment();
     void lex_space();
     token_type yylex();
+    token_stream tokenize();
 };
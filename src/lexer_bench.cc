@@ -0,0 +1,26 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "bench.hh"
+#include "lexer.hh"
+
+int main(int argc, char *argv[]) {
+    size_t functions = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000;
+    std::string source = generate_functions(functions);
+    std::string filename = write_temp_source("lexer_bench", source);
+
+    double best = 1e9;
+    size_t tokens = 0;
+    for (int run = 0; run < 5; run++) {
+        bench_timer t;
+        lexer_context lexer(filename);
+        token_stream stream = lexer.tokenize();
+        tokens = stream.size() - 1;
+        best = std::min(best, t.seconds());
+    }
+    std::remove(filename.c_str());
+
+    double mb = source.size() / 1e6;
+    printf("lexed %.1f MB, %zu tokens in %.3f s: %.1f MB/s, %.2f Mtokens/s\n",
+        mb, tokens, best, mb / best, tokens / best / 1e6);
+}
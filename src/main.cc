@@ -1,27 +1,291 @@
 #include "parser.hh"
+#include "schedule.hh"
+#include "clone.hh"
 #include "typecheck.hh"
+#include "fold.hh"
 #include "codegen_llvm.hh"
 #include "codegen_spirv.hh"
 #include "error.hh"
 #include "lexer.hh"
+#include "cache.hh"
+#include "server.hh"
+#include "timing.hh"
 
-int main(int argc, char *argv[]) {
-    std::vector<std::string> args;
-    args.assign(argv, argv + argc);
-    if (args.size() != 3) {
-        error("usage:", args[0], "input.kl output.ir");
+#include <utility>
+
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+
+static void usage(const std::string& name) {
+    error("usage:", name, "[-j jobs] [-O0|-O1|-O2|-O3|-Os] [--emit=obj|asm|bc|ll] "
+        "[--target-cpu=cpu|native] [--target-features=features|native] [--multiversion=levels] "
+        "[--cache-dir=dir [--cache-stats]] [--incremental=dir] [--time-report] [--time-trace=file.json [--time-trace-granularity=us]] [--fold-report] input.kl output\n"
+        "      ", name, "--server[=socket] [-j workers]");
+}
+
+struct compile_options {
+    std::vector<std::string> files;
+    size_t jobs = 1;
+    optimization_level opt_level = optimization_level::O0;
+    emit_kind emit = emit_kind::ir;
+    std::string target_cpu = "generic";
+    std::string target_features;
+    std::vector<std::string> multiversion_levels;
+    std::string cache_dir;
+    std::string incremental_dir;
+    bool cache_stats = false;
+    bool time_report = false;
+    bool fold_report = false;
+    std::string time_trace;
+    //scopes shorter than this many microseconds are left out of the trace
+    unsigned time_trace_granularity = 0;
+    //serve compile requests from this unix socket, or from stdin if it's empty
+    bool server = false;
+    std::string server_socket;
+};
+
+static compile_options parse_options(const std::vector<std::string>& args) {
+    compile_options options;
+    for (size_t i = 1; i < args.size(); i++) {
+        if (args[i] == "--server") {
+            options.server = true;
+        } else if (args[i].rfind("--server=", 0) == 0) {
+            options.server = true;
+            options.server_socket = args[i].substr(args[i].find('=') + 1);
+        } else if (args[i].rfind("--cache-dir=", 0) == 0) {
+            options.cache_dir = args[i].substr(args[i].find('=') + 1);
+        } else if (args[i].rfind("--incremental=", 0) == 0) {
+            options.incremental_dir = args[i].substr(args[i].find('=') + 1);
+        } else if (args[i] == "--fold-report") {
+            options.fold_report = true;
+        } else if (args[i] == "--time-report") {
+            options.time_report = true;
+        } else if (args[i].rfind("--time-trace-granularity=", 0) == 0) {
+            options.time_trace_granularity = std::stoul(args[i].substr(args[i].find('=') + 1));
+        } else if (args[i].rfind("--time-trace=", 0) == 0) {
+            options.time_trace = args[i].substr(args[i].find('=') + 1);
+        } else if (args[i] == "--cache-stats") {
+            options.cache_stats = true;
+        } else if (args[i].rfind("--target-cpu=", 0) == 0) {
+            options.target_cpu = args[i].substr(args[i].find('=') + 1);
+        } else if (args[i].rfind("--target-features=", 0) == 0) {
+            options.target_features = args[i].substr(args[i].find('=') + 1);
+        } else if (args[i].rfind("--multiversion=", 0) == 0) {
+            std::stringstream levels(args[i].substr(args[i].find('=') + 1));
+            for (std::string level; std::getline(levels, level, ',');) {
+                options.multiversion_levels.push_back(level);
+            }
+        } else if (args[i] == "--emit=obj") {
+            options.emit = emit_kind::object;
+        } else if (args[i] == "--emit=asm") {
+            options.emit = emit_kind::assembly;
+        } else if (args[i] == "--emit=bc") {
+            options.emit = emit_kind::bitcode;
+        } else if (args[i] == "--emit=ll") {
+            options.emit = emit_kind::ir;
+        } else if (args[i] == "-O0") {
+            options.opt_level = optimization_level::O0;
+        } else if (args[i] == "-O1") {
+            options.opt_level = optimization_level::O1;
+        } else if (args[i] == "-O2") {
+            options.opt_level = optimization_level::O2;
+        } else if (args[i] == "-O3") {
+            options.opt_level = optimization_level::O3;
+        } else if (args[i] == "-Os") {
+            options.opt_level = optimization_level::Os;
+        } else if (args[i] == "-j" && i + 1 < args.size()) {
+            options.jobs = std::stoul(args[++i]);
+        } else if (args[i].rfind("-j", 0) == 0 && args[i].size() > 2) {
+            options.jobs = std::stoul(args[i].substr(2));
+        } else if (args[i].rfind("-", 0) == 0) {
+            usage(args[0]);
+        } else {
+            options.files.push_back(args[i]);
+        }
+    }
+    if (options.jobs == 0) {
+        usage(args[0]);
     }
+    return options;
+}
 
-    lexer_context lexer(args[1]);
+//kept per thread, so a server worker only creates a target machine the
+//first time it sees each target and optimisation level
+static std::unordered_map<std::string, std::unique_ptr<llvm::TargetMachine>>& target_machines() {
+    static thread_local std::unordered_map<std::string, std::unique_ptr<llvm::TargetMachine>> machines;
+    return machines;
+}
+
+//the instructions codegen generates for a copy of the program made before
+//folding, which changes the ast in place
+static size_t unfolded_instructions(ast::program& unfolded, interner<ast::identifier>& symbols_registry,
+    const std::string& input, const compile_options& options) {
+    auto report = std::exchange(time_report::active(), nullptr);
+    codegen_context_llvm codegen_context_llvm{symbols_registry};
+    codegen_context_llvm.target_cpu = options.target_cpu;
+    codegen_context_llvm.target_features = options.target_features;
+    codegen_context_llvm.multiversion_levels = options.multiversion_levels;
+    codegen_llvm(codegen_context_llvm, unfolded, input, options.jobs);
+    time_report::active() = report;
+    return codegen_context_llvm.module->getInstructionCount();
+}
+
+static void compile_file(const std::string& name, const compile_options& options) {
+    if (options.files.empty() && options.cache_stats && !options.cache_dir.empty()) {
+        auto stats = compile_cache(options.cache_dir).stats();
+        std::cout << "cache: " << stats.hits << " hits, " << stats.misses << " misses" << std::endl;
+        return;
+    }
+    if (options.files.size() != 2) {
+        usage(name);
+    }
+    const std::string& input = options.files[0];
+    const std::string& output = options.files[1];
+
+    //the output only depends on the source and these, not on -j. the input's
+    //path is one of them, it names the module and ends up in the object file
+    std::optional<compile_cache> cache;
+    std::string cache_key;
+    if (!options.cache_dir.empty()) {
+        cache.emplace(options.cache_dir);
+        llvm::SmallString<256> path(input);
+        llvm::sys::fs::make_absolute(path);
+        std::string levels;
+        for (auto& level: options.multiversion_levels) {
+            levels += level + ",";
+        }
+        cache_key = cache->key({
+            KL_VERSION,
+            LLVM_VERSION_STRING,
+            llvm::sys::getDefaultTargetTriple(),
+            resolve_target_cpu(options.target_cpu),
+            resolve_target_features(options.target_features),
+            std::to_string(static_cast<int>(options.opt_level)),
+            std::to_string(static_cast<int>(options.emit)),
+            levels,
+            path.str().str(),
+        }, source_buffer(input).view());
+        bool hit = cache->fetch(cache_key, output);
+        if (options.cache_stats) {
+            std::cerr << "cache: " << (hit ? "hit" : "miss") << " " << cache_key << std::endl;
+        }
+        if (hit) {
+            return;
+        }
+    }
+
+    std::optional<lexer_context> lexer;
+    {
+        time_scope scope("read source");
+        lexer.emplace(input);
+    }
 
-    parser_context parser(lexer);
-    auto program_ast = parser.parse_program(args[1]);
+    parser_context parser(*lexer);
+    auto program_ast = parser.parse_program(input);
+    schedule(program_ast);
 
     typecheck_context typecheck_context{program_ast.symbols_registry};
-    typecheck(typecheck_context, program_ast);
+    {
+        time_scope scope("typecheck");
+        typecheck(typecheck_context, program_ast, options.jobs);
+    }
+    //incremental builds link already optimised functions, there's nothing to compare them with
+    std::optional<ast::program> unfolded;
+    if (options.fold_report && options.incremental_dir.empty()) {
+        unfolded.emplace();
+        clone_fn clone {*unfolded->arena, true};
+        unfolded->statements = clone(program_ast.statements);
+    }
+    fold_context fold_context;
+    fold(fold_context, program_ast);
 
+    auto& target_machine = target_machines()[options.target_cpu + " " + options.target_features + " " + std::to_string(static_cast<int>(options.opt_level))];
     codegen_context_llvm codegen_context_llvm{program_ast.symbols_registry};
-    codegen_llvm(codegen_context_llvm, program_ast, args[1], args[2]);
+    codegen_context_llvm.opt_level = options.opt_level;
+    codegen_context_llvm.target_cpu = options.target_cpu;
+    codegen_context_llvm.target_features = options.target_features;
+    codegen_context_llvm.multiversion_levels = options.multiversion_levels;
+    codegen_context_llvm.incremental_dir = options.incremental_dir;
+    codegen_context_llvm.target_machine = std::move(target_machine);
+    {
+        time_scope scope("codegen");
+        codegen_llvm(codegen_context_llvm, program_ast, input, options.jobs);
+    }
+    if (options.fold_report) {
+        std::cerr << "fold: " << fold_context.expressions_folded << " expressions folded, "
+            << fold_context.identities_simplified << " identities simplified, "
+            << fold_context.branches_pruned << " branches pruned";
+        if (unfolded) {
+            size_t before = unfolded_instructions(*unfolded, program_ast.symbols_registry, input, options);
+            size_t after = codegen_context_llvm.module->getInstructionCount();
+            //folding could leave more than it started with, though it shouldn't
+            auto removed = static_cast<int64_t>(before) - static_cast<int64_t>(after);
+            std::cerr << ", " << removed << " of " << before << " instructions removed";
+        }
+        std::cerr << std::endl;
+    }
+    optimize_llvm(codegen_context_llvm);
+    emit_llvm(codegen_context_llvm, options.emit, output);
+    target_machine = std::move(codegen_context_llvm.target_machine);
+    if (cache) {
+        cache->store(cache_key, output);
+    }
+}
+
+static void compile(const std::string& name, const compile_options& options) {
+    time_report report;
+    if (options.time_report) {
+        time_report::active() = &report;
+    }
+    if (!options.time_trace.empty()) {
+        llvm::timeTraceProfilerInitialize(options.time_trace_granularity, name);
+    }
+    try {
+        time_scope scope("total");
+        compile_file(name, options);
+    } catch (...) {
+        time_report::active() = nullptr;
+        if (llvm::timeTraceProfilerEnabled()) {
+            llvm::timeTraceProfilerCleanup();
+        }
+        throw;
+    }
+    time_report::active() = nullptr;
+    if (options.time_report) {
+        report.print(stderr);
+    }
+    if (!options.time_trace.empty()) {
+        std::error_code EC;
+        llvm::raw_fd_ostream trace(options.time_trace, EC, llvm::sys::fs::OpenFlags::F_Text);
+        if (EC) {
+            llvm::timeTraceProfilerCleanup();
+            error("couldn't open file", EC.message());
+        }
+        llvm::timeTraceProfilerWrite(trace);
+        llvm::timeTraceProfilerCleanup();
+    }
+}
+
+int main(int argc, char *argv[]) try {
+    std::vector<std::string> args;
+    args.assign(argv, argv + argc);
+    compile_options options = parse_options(args);
+
+    if (options.server) {
+        //each request is the arguments of one compile, -j sets the number of workers
+        serve(options.server_socket, options.jobs, [&args](const std::vector<std::string>& request) {
+            std::vector<std::string> request_args {args[0]};
+            request_args.insert(request_args.end(), request.begin(), request.end());
+            compile(args[0], parse_options(request_args));
+        });
+    } else {
+        compile(args[0], options);
+    }
 
     exit(EXIT_SUCCESS);
+} catch (const compile_error& e) {
+    std::cerr << e.what() << std::endl;
+    exit(EXIT_FAILURE);
 }
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <vector>
+
+//runs f(0) to f(n - 1) on up to jobs threads, including the calling one.
+//if any of them throw, the exception from the lowest index is rethrown,
+//so the error reported doesn't depend on scheduling
+template<typename F>
+void parallel_for(size_t n, size_t jobs, F&& f) {
+    std::vector<std::exception_ptr> errors(n);
+    std::atomic<size_t> next {0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < n; i = next++) {
+            try {
+                f(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < std::min(jobs, n); t++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    for (auto& e: errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+}
@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <llvm/Config/llvm-config.h>
+
+#include "bench.hh"
+#include "klrt.hh"
+
+//cpu for kernels from tests/parallel.kl, compiled by the compiler under test
+extern "C" {
+    void triad(float*, uint64_t, float*, uint64_t, float*, uint64_t, float);
+    void orbit(float*, uint64_t, uint32_t);
+}
+
+struct result {
+    const char* kernel;
+    uint32_t workers;
+    double seconds;
+    //the kernel's own unit of work per second, elements or loop iterations
+    double items_per_second;
+    //memory traffic, 0 for kernels that stay in cache
+    double bytes_per_second;
+    //compared to one worker
+    double speedup;
+};
+
+//the fastest of enough calls of f to take at least min_seconds, after one warm up call
+template<typename F>
+static double fastest(F&& f) {
+    constexpr double min_seconds = 0.2;
+    f();
+    double best = 1e300;
+    bench_timer total;
+    for (int calls = 0; calls < 3 || total.seconds() < min_seconds; calls++) {
+        bench_timer t;
+        f();
+        best = std::min(best, t.seconds());
+    }
+    return best;
+}
+
+static void record(std::vector<result>& results, const char* kernel, uint32_t workers, double seconds,
+    double items, double bytes) {
+    result r {kernel, workers, seconds, items / seconds, bytes / seconds, 1};
+    for (auto& one: results) {
+        if (std::strcmp(one.kernel, kernel) == 0 && one.workers == 1) {
+            r.speedup = one.seconds / seconds;
+        }
+    }
+    std::fprintf(stderr, "%-6s %3u workers %10.3f ms %10.3g items/s", kernel, workers, seconds * 1e3, r.items_per_second);
+    if (bytes) {
+        std::fprintf(stderr, " %8.2f GB/s", r.bytes_per_second / 1e9);
+    }
+    std::fprintf(stderr, " %6.2fx speedup %5.0f%% efficiency\n", r.speedup, r.speedup / workers * 100);
+    results.push_back(r);
+}
+
+static void print_json(FILE* out, const std::vector<result>& results, uint32_t cpus) {
+    std::fprintf(out, "{\n  \"compiler\": \"%s\",\n  \"llvm\": \"%s\",\n  \"cpus\": %u,\n  \"results\": [\n",
+        KL_VERSION, LLVM_VERSION_STRING, cpus);
+    for (size_t i = 0; i < results.size(); i++) {
+        auto& r = results[i];
+        std::fprintf(out, "    {\"kernel\": \"%s\", \"workers\": %u, \"seconds\": %.6f, \"items_per_second\": %.6g, "
+            "\"bytes_per_second\": %.6g, \"speedup\": %.4f, \"efficiency\": %.4f}%s\n",
+            r.kernel, r.workers, r.seconds, r.items_per_second, r.bytes_per_second, r.speedup, r.speedup / r.workers,
+            i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+}
+
+//times a memory bound and a compute bound cpu for kernel on 1 to n worker
+//threads, n being the second argument or the number of cpus. a table goes
+//to stderr, and json to the file given or stdout
+int main(int argc, char *argv[]) {
+    uint32_t cpus = std::max(std::thread::hardware_concurrency(), 1u);
+    uint32_t max_workers = argc > 2 ? std::max(std::atoi(argv[2]), 1) : cpus;
+    std::vector<uint32_t> counts;
+    for (uint32_t w = 1; w < max_workers; w *= 2) {
+        counts.push_back(w);
+    }
+    counts.push_back(max_workers);
+
+    //the triad's arrays are well past any last level cache, so it's limited
+    //by memory bandwidth rather than the cores
+    const size_t elements = size_t{1} << 23;
+    std::vector<float> a(elements), b(elements), c(elements);
+    for (size_t i = 0; i < elements; i++) {
+        b[i] = i % 1024;
+        c[i] = 1.0f / (i % 1024 + 1);
+    }
+    //the orbit's values stay in cache, and each takes steps dependent multiplies
+    const uint32_t steps = 2000;
+    std::vector<float> start(size_t{1} << 15), x(start.size());
+    for (size_t i = 0; i < start.size(); i++) {
+        start[i] = (i + 0.5f) / start.size();
+    }
+
+    std::vector<result> results;
+    for (uint32_t workers: counts) {
+        klrt_set_workers(workers);
+        double seconds = fastest([&]() {
+            triad(a.data(), a.size(), b.data(), b.size(), c.data(), c.size(), 3);
+        });
+        for (size_t i = 0; i < elements; i += 4099) {
+            if (a[i] != b[i] + 3 * c[i]) {
+                std::fprintf(stderr, "triad: wrong result at %lu with %u workers\n", static_cast<unsigned long>(i), workers);
+                return EXIT_FAILURE;
+            }
+        }
+        //two loads and a store per element
+        record(results, "triad", workers, seconds, elements, 3.0 * sizeof(float) * elements);
+    }
+    for (uint32_t workers: counts) {
+        klrt_set_workers(workers);
+        double seconds = fastest([&]() {
+            x = start;
+            orbit(x.data(), x.size(), steps);
+        });
+        for (size_t i = 0; i < x.size(); i += 1021) {
+            float v = start[i];
+            for (uint32_t step = 0; step < steps; step++) {
+                v = 3.7f * v * (1 - v);
+            }
+            if (x[i] != v) {
+                std::fprintf(stderr, "orbit: wrong result at %lu with %u workers\n", static_cast<unsigned long>(i), workers);
+                return EXIT_FAILURE;
+            }
+        }
+        record(results, "orbit", workers, seconds, static_cast<double>(x.size()) * steps, 0);
+    }
+
+    FILE* out = stdout;
+    if (argc > 1 && !(out = std::fopen(argv[1], "w"))) {
+        std::fprintf(stderr, "couldn't open %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    print_json(out, results, cpus);
+    if (out != stdout) {
+        std::fclose(out);
+    }
+}
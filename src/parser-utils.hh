@@ -1,28 +1,41 @@
 #pragma once
 
 #include <sstream>
+#include <algorithm>
 
 #include "parser.hh"
-
-struct parse_error : std::runtime_error {
-    using std::runtime_error::runtime_error;
-};
+#include "result.hh"
 
 template<typename... Ts>
-[[noreturn]] void p_error(Ts... args) {
+parser::parse_error p_error(Ts... args) {
     std::stringstream ss{};
     ((ss << args << " "), ...);
-    throw parse_error(ss.str());
+    return parser::parse_error{ss.str()};
 }
 
 void parser_context::next_token() {
-    buffer_loc++;
-    if (buffer_loc >= buffer.size()) {
-        buffer.push_back({lexer.yylex(), lexer.current_param});
-        std::cerr << buffer[buffer_loc].first << std::endl;
+    if (buffer_loc + 1 < tokens.size()) {
+        buffer_loc++;
     }
-    current_token = buffer[buffer_loc].first;
-    lexer.current_param = buffer[buffer_loc].second;
+    current_token = tokens.kinds[buffer_loc];
+}
+token_type parser_context::peek_token(size_t n) {
+    return tokens.kinds[std::min(buffer_loc + n, tokens.size() - 1)];
+}
+const param_type& parser_context::current_param() {
+    return tokens.params[tokens.payloads[buffer_loc]];
+}
+yy::location parser_context::current_location() {
+    //only needed for errors, so work out the line and column from the token
+    //offset on demand rather than tracking them while lexing
+    std::string_view before = lexer.source.view().substr(0, tokens.offsets[buffer_loc]);
+    size_t line_start = before.rfind('\n');
+    line_start = line_start == std::string_view::npos ? 0 : line_start + 1;
+    yy::location l = location;
+    l.begin.line = std::count(before.begin(), before.end(), '\n') + 1;
+    l.begin.column = before.size() - line_start + 1;
+    l.end = l.begin;
+    return l;
 }
 bool parser_context::accept(token_type t) {
     if (current_token == t) {
@@ -32,101 +45,32 @@ bool parser_context::accept(token_type t) {
         return false;
     }
 }
-void parser_context::expect(token_type t) {
-    if (!accept(t)) {
-        p_error(location, "parser expected", t, "got", current_token);
-    }
+parser::parse_error parser_context::expected(token_type t) {
+    return p_error(current_location(), "parser expected", t, "got", current_token);
 }
-param_type parser_context::expectp(token_type t) {
-    auto p = lexer.current_param;
-    expect(t);
-    return p;
-}
-
-template<typename T>
-auto parser_context::maybe(T parse) -> std::optional<decltype(std::invoke(parse, this))> {
-    size_t buffer_stop = buffer_loc;
-    try {
-        return std::optional<decltype(std::invoke(parse, this))>{std::move(std::invoke(parse, this))};
-    } catch (parse_error& e) {
-        buffer_loc = buffer_stop;
-        current_token = buffer[buffer_loc].first;
-        lexer.current_param = buffer[buffer_loc].second;
-        return std::nullopt;
-    }
-}
-template<typename T>
-auto parser_context::maybe_void(T parse) {
-    size_t buffer_stop = buffer_loc;
-    try {
-        std::invoke(parse);
-    } catch (parse_error& e) {
-        buffer_loc = buffer_stop;
-        current_token = buffer[buffer_loc].first;
-        lexer.current_param = buffer[buffer_loc].second;
+parser::result<token_type> parser_context::expect(token_type t) {
+    if (!accept(t)) {
+        return expected(t);
     }
+    return t;
 }
-
-template<typename ...T>
-auto parser_context::choose(std::optional<T>... os) -> std::optional<std::variant<T...>> {
-    static_assert(sizeof...(os) > 0, "choose must have at least one parameter");
-    std::variant<T...> v;
-    if (!((os ? v = std::move(os.value()), true : false) || ...)) {
-        return std::nullopt;
+parser::result<param_type> parser_context::expectp(token_type t) {
+    auto p = current_param();
+    if (!accept(t)) {
+        return expected(t);
     }
-    return {std::move(v)};
-}
-
-template<typename ...T>
-auto parser_context::choose(T... parse) -> std::optional<std::variant<decltype(std::invoke(parse, this))...>> {
-    return choose(maybe(parse)...);
-}
-
-template<typename ...T>
-auto parser_context::sequence(T... ps) -> std::tuple<T...> {
-    static_assert(sizeof...(ps) > 0, "sequence must have at least one parameter");
-    return std::tuple<T...> {std::invoke(ps, this)...};
-}
-
-template<typename S, typename ...T>
-auto parser_context::sequence(T... ps) -> S {
-    static_assert(sizeof...(ps) > 0, "sequence must have at least one parameter");
-    return S {std::invoke(ps, this)...};
+    return p;
 }
 
 template<typename T>
-std::vector<T> parser_context::parse_list(T (parser_context::*parse)()) {
+parser::result<std::vector<T>> parser_context::parse_list(parser::result<T> (parser_context::*parse)(), token_type delim) {
     std::vector<T> list;
     while (true) {
-        auto res = std::move(maybe(parse));
-        if (res) {
-            list.emplace_back(std::move(res.value()));
-        } else {
-            return list;
-        }
-    }
-}
-template<typename T>
-std::vector<T> parser_context::parse_list_sep(T (parser_context::*parse)(), token_type sep) {
-    std::vector<T> list;
-    while (true) {
-        auto res = std::move(maybe(parse));
+        auto res = std::invoke(parse, this);
         if (!res) {
-            break;
+            return res.error();
         }
         list.emplace_back(std::move(res.value()));
-        if (!accept(sep)) {
-            break;
-        }
-    }
-    return list;
-}
-template<typename T>
-std::vector<T> parser_context::parse_list(T (parser_context::*parse)(), token_type delim) {
-    std::vector<T> list;
-    while (true) {
-        auto res = std::move(std::invoke(parse, this));
-        list.emplace_back(std::move(res));
         if (accept(delim)) {
             break;
         }
@@ -134,14 +78,17 @@ std::vector<T> parser_context::parse_list(T (parser_context::*parse)(), token_ty
     return list;
 }
 template<typename T>
-std::vector<T> parser_context::parse_list(T (parser_context::*parse)(), token_type sep, token_type delim) {
+parser::result<std::vector<T>> parser_context::parse_list(parser::result<T> (parser_context::*parse)(), token_type sep, token_type delim) {
     std::vector<T> list;
     while (true) {
         if (accept(delim)) {
             break;
         }
-        auto res = std::move(std::invoke(parse, this));
-        list.emplace_back(std::move(res));
+        auto res = std::invoke(parse, this);
+        if (!res) {
+            return res.error();
+        }
+        list.emplace_back(std::move(res.value()));
         if (accept(sep)) {
             if (accept(delim)) {
                 break;
@@ -149,7 +96,7 @@ std::vector<T> parser_context::parse_list(T (parser_context::*parse)(), token_ty
         } else if (accept(delim)) {
             break;
         } else {
-            p_error(location, "parser expected", sep, "or", delim, "got", current_token);
+            return p_error(current_location(), "parser expected", sep, "or", delim, "got", current_token);
         }
     }
     return list;
@@ -4,361 +4,869 @@
 #include "driver.hh"
 #include "parser.hh"
 #include "parser-utils.hh"
+#include "timing.hh"
+
+//every choice in the grammar is decided from the current token and at most
+//one token of lookahead, so rules never need to backtrack and a failed rule
+//is always a syntax error that is passed straight back up as a result
 
 ast::program parser_context::parse_program(std::string filename) {
-    location.initialize(&filename);
+    this->filename = std::move(filename);
+    location.initialize(&this->filename);
     ast::program program_ast {};
-    next_token();
-    try {
-        program_ast.statements = parse_list(&parser_context::parse_top_level_statement, token_type::SEMICOLON, token_type::T_EOF);
-    } catch (parse_error& e) {
-        std::cerr << e.what() << std::endl;
-        exit(1);
-    }
-    program_ast.symbols_registry = lexer.symbols_registry;
+    arena = program_ast.arena.get();
+    {
+        time_scope scope("lex");
+        tokens = lexer.tokenize();
+    }
+    time_scope scope("parse");
+    buffer_loc = 0;
+    current_token = tokens.kinds[buffer_loc];
+    auto statements = parse_list(&parser_context::parse_top_level_statement, token_type::SEMICOLON, token_type::T_EOF);
+    if (!statements) {
+        error(statements.error().message);
+    }
+    program_ast.statements = std::move(statements.value());
+    program_ast.symbols_registry = std::move(lexer.symbols_registry);
     return program_ast;
 }
-ast::block parser_context::parse_block() {
-    expect(token_type::OPEN_C_BRACKET);
+parser::result<ast::block> parser_context::parse_block() {
+    if (!accept(token_type::OPEN_C_BRACKET)) {
+        return expected(token_type::OPEN_C_BRACKET);
+    }
     ast::block b {};
-    b.statements = parse_list(&parser_context::parse_statement, token_type::SEMICOLON, token_type::CLOSE_C_BRACKET);
+    auto statements = parse_list(&parser_context::parse_statement, token_type::SEMICOLON, token_type::CLOSE_C_BRACKET);
+    if (!statements) {
+        return statements.error();
+    }
+    b.statements = std::move(statements.value());
     return b;
 }
-ast::if_statement parser_context::parse_if_statement() {
-    expect(token_type::IF);
-    ast::if_statement s {};
-    s.conditions.emplace_back(parse_exp());
-    s.blocks.emplace_back(parse_block());
-    while (accept(token_type::ELIF)) {
-        s.conditions.emplace_back(parse_exp());
-        s.blocks.emplace_back(parse_block());
+parser::result<ast::if_statement> parser_context::parse_if_statement() {
+    if (!accept(token_type::IF)) {
+        return expected(token_type::IF);
     }
+    ast::if_statement s {};
+    do {
+        auto condition = parse_exp();
+        if (!condition) {
+            return condition.error();
+        }
+        s.conditions.emplace_back(std::move(condition.value()));
+        auto block = parse_block();
+        if (!block) {
+            return block.error();
+        }
+        s.blocks.emplace_back(std::move(block.value()));
+    } while (accept(token_type::ELIF));
     if (accept(token_type::ELSE)) {
-        s.blocks.emplace_back(parse_block());
+        auto block = parse_block();
+        if (!block) {
+            return block.error();
+        }
+        s.blocks.emplace_back(std::move(block.value()));
     }
     return s;
 }
-ast::for_loop parser_context::parse_for_loop() {
-    expect(token_type::FOR);
+parser::result<ast::for_loop> parser_context::parse_for_loop() {
     ast::for_loop s {};
-    s.initial = parse_variable_def();
-    expect(token_type::SEMICOLON);
-    s.condition = parse_exp();
-    expect(token_type::SEMICOLON);
-    s.step = parse_assignment();
-    s.block = parse_block();
+    if (current_token == token_type::SIMD) {
+        //loops that can't be vectorized are reported at the loop
+        s.loc = current_location();
+        next_token();
+        s.simd = ast::simd{};
+        if (current_token == token_type::LITERAL_INTEGER) {
+            s.simd->lanes = std::get<ast::literal_integer>(parse_literal_integer().value().literal).data;
+        }
+    } else if (current_token == token_type::CPU) {
+        s.loc = current_location();
+        next_token();
+        s.cpu = ast::cpu{};
+        if (current_token == token_type::LITERAL_INTEGER) {
+            s.cpu->grain = std::get<ast::literal_integer>(parse_literal_integer().value().literal).data;
+        }
+    }
+    if (!accept(token_type::FOR)) {
+        return expected(token_type::FOR);
+    }
+    if (current_token == token_type::IDENTIFIER) {
+        s.label = parse_identifier().value();
+    }
+    auto initial = parse_variable_def();
+    if (!initial) {
+        return initial.error();
+    }
+    s.initial = std::move(initial.value());
+    if (!accept(token_type::SEMICOLON)) {
+        return expected(token_type::SEMICOLON);
+    }
+    auto condition = parse_exp();
+    if (!condition) {
+        return condition.error();
+    }
+    s.condition = std::move(condition.value());
+    if (!accept(token_type::SEMICOLON)) {
+        return expected(token_type::SEMICOLON);
+    }
+    auto step = parse_assignment();
+    if (!step) {
+        return step.error();
+    }
+    s.step = std::move(step.value());
+    auto block = parse_block();
+    if (!block) {
+        return block.error();
+    }
+    s.block = std::move(block.value());
     return s;
 }
-ast::while_loop parser_context::parse_while_loop() {
-    expect(token_type::WHILE);
-    return sequence<ast::while_loop>(
-        &parser_context::parse_exp,
-        &parser_context::parse_block
-    );
+parser::result<ast::while_loop> parser_context::parse_while_loop() {
+    if (!accept(token_type::WHILE)) {
+        return expected(token_type::WHILE);
+    }
+    ast::while_loop w {};
+    auto condition = parse_exp();
+    if (!condition) {
+        return condition.error();
+    }
+    w.condition = std::move(condition.value());
+    auto block = parse_block();
+    if (!block) {
+        return block.error();
+    }
+    w.block = std::move(block.value());
+    return w;
 }
-ast::case_statement parser_context::parse_case() {
-    expect(token_type::CASE);
+parser::result<ast::case_statement> parser_context::parse_case() {
+    if (!accept(token_type::CASE)) {
+        return expected(token_type::CASE);
+    }
     ast::case_statement c {};
-    c.cases = parse_list_sep(&parser_context::parse_literal_integer, token_type::COMMA);
-    c.block = parse_block();
+    while (current_token == token_type::LITERAL_INTEGER) {
+        auto literal = parse_literal_integer();
+        if (!literal) {
+            return literal.error();
+        }
+        c.cases.emplace_back(std::move(literal.value()));
+        if (!accept(token_type::COMMA)) {
+            break;
+        }
+    }
+    auto block = parse_block();
+    if (!block) {
+        return block.error();
+    }
+    c.block = std::move(block.value());
     return c;
 }
-ast::switch_statement parser_context::parse_switch_statement() {
-    expect(token_type::SWITCH);
+parser::result<ast::switch_statement> parser_context::parse_switch_statement() {
+    if (!accept(token_type::SWITCH)) {
+        return expected(token_type::SWITCH);
+    }
     ast::switch_statement s {};
-    s.expression = parse_exp();
-    expect(token_type::OPEN_C_BRACKET);
-    s.cases = parse_list(&parser_context::parse_case, token_type::CLOSE_C_BRACKET);
+    auto expression = parse_exp();
+    if (!expression) {
+        return expression.error();
+    }
+    s.expression = std::move(expression.value());
+    if (!accept(token_type::OPEN_C_BRACKET)) {
+        return expected(token_type::OPEN_C_BRACKET);
+    }
+    auto cases = parse_list(&parser_context::parse_case, token_type::CLOSE_C_BRACKET);
+    if (!cases) {
+        return cases.error();
+    }
+    s.cases = std::move(cases.value());
     return s;
 }
-ast::identifier parser_context::parse_identifier() {
-    return std::get<ast::identifier>(expectp(token_type::IDENTIFIER));
+parser::result<ast::identifier> parser_context::parse_identifier() {
+    auto p = expectp(token_type::IDENTIFIER);
+    if (!p) {
+        return p.error();
+    }
+    return std::get<ast::identifier>(p.value());
 }
-ast::function_def parser_context::parse_function_def() {
+parser::result<ast::function_def> parser_context::parse_function_def() {
     ast::function_def f {};
     f.to_export = accept(token_type::EXPORT);
-    expect(token_type::FUNCTION);
-    auto t = maybe(&parser_context::parse_primitive_type);
-    if (t) {
-        f.returntype = {std::move(t.value())};
-    }
-    f.identifier = parse_identifier();
-    expect(token_type::OPEN_R_BRACKET);
-    f.parameter_list = parse_list(&parser_context::parse_field, token_type::COMMA, token_type::CLOSE_R_BRACKET);
-    f.block = parse_block();
+    if (!accept(token_type::FUNCTION)) {
+        return expected(token_type::FUNCTION);
+    }
+    if (current_token == token_type::PRIMITIVE_TYPE) {
+        f.returntype = {parse_primitive_type().value()};
+    }
+    auto identifier = parse_identifier();
+    if (!identifier) {
+        return identifier.error();
+    }
+    f.identifier = identifier.value();
+    if (!accept(token_type::OPEN_R_BRACKET)) {
+        return expected(token_type::OPEN_R_BRACKET);
+    }
+    auto parameter_list = parse_list(&parser_context::parse_field, token_type::COMMA, token_type::CLOSE_R_BRACKET);
+    if (!parameter_list) {
+        return parameter_list.error();
+    }
+    f.parameter_list = std::move(parameter_list.value());
+    auto block = parse_block();
+    if (!block) {
+        return block.error();
+    }
+    f.block = std::move(block.value());
     return f;
 }
-ast::function_call parser_context::parse_function_call() {
+parser::result<ast::function_call> parser_context::parse_function_call() {
     ast::function_call f {};
-    f.identifier = parse_identifier();
-    expect(token_type::OPEN_R_BRACKET);
-    f.arguments = parse_list(&parser_context::parse_exp, token_type::COMMA, token_type::CLOSE_R_BRACKET);
+    auto identifier = parse_identifier();
+    if (!identifier) {
+        return identifier.error();
+    }
+    f.identifier = identifier.value();
+    if (!accept(token_type::OPEN_R_BRACKET)) {
+        return expected(token_type::OPEN_R_BRACKET);
+    }
+    auto arguments = parse_list(&parser_context::parse_exp, token_type::COMMA, token_type::CLOSE_R_BRACKET);
+    if (!arguments) {
+        return arguments.error();
+    }
+    f.arguments = std::move(arguments.value());
     return f;
 }
-ast::type_def parser_context::parse_type_def() {
+parser::result<ast::type_def> parser_context::parse_type_def() {
     ast::type_def t {};
-    expect(token_type::TYPE);
-    parse_identifier();
-    expect(token_type::OP_ASSIGN);
-    t.type = parse_type();
+    if (!accept(token_type::TYPE)) {
+        return expected(token_type::TYPE);
+    }
+    auto identifier = parse_identifier();
+    if (!identifier) {
+        return identifier.error();
+    }
+    t.user_type = {identifier.value().value};
+    if (!accept(token_type::OP_ASSIGN)) {
+        return expected(token_type::OP_ASSIGN);
+    }
+    auto type = parse_type();
+    if (!type) {
+        return type.error();
+    }
+    t.type = std::move(type.value());
+    if (current_token == token_type::IDENTIFIER) {
+        if (!std::holds_alternative<std::unique_ptr<ast::array_type>>(t.type.type_)) {
+            return p_error(current_location(), "parser expected ; after a type that isn't an array. got", current_token);
+        }
+        auto layout = parse_layout();
+        if (!layout) {
+            return layout.error();
+        }
+        std::get<std::unique_ptr<ast::array_type>>(t.type.type_)->layout = layout.value();
+    }
     return t;
 }
-ast::assignment parser_context::parse_assignment() {
+parser::result<ast::assignment> parser_context::parse_assignment() {
     ast::assignment a {};
-    a.accessor = parse_accessor();
-    expect(token_type::OP_ASSIGN);
-    a.expression = parse_exp();
+    auto accessor = parse_accessor();
+    if (!accessor) {
+        return accessor.error();
+    }
+    a.accessor = std::move(accessor.value());
+    if (!accept(token_type::OP_ASSIGN)) {
+        return expected(token_type::OP_ASSIGN);
+    }
+    auto expression = parse_exp();
+    if (!expression) {
+        return expression.error();
+    }
+    a.expression = std::move(expression.value());
     return a;
 }
-ast::variable_def parser_context::parse_variable_def() {
+parser::result<ast::variable_def> parser_context::parse_variable_def() {
     ast::variable_def v {};
-    expect(token_type::VAR);
-    maybe_void([&v, this]() {
+    if (!accept(token_type::VAR)) {
+        return expected(token_type::VAR);
+    }
+    //an explicit type is either a primitive type, a buffer type, or a user
+    //type name followed by the variable name
+    if (current_token == token_type::PRIMITIVE_TYPE || current_token == token_type::OPEN_S_BRACKET ||
+        (current_token == token_type::IDENTIFIER && peek_token() == token_type::IDENTIFIER)) {
         auto t = parse_named_type();
-        auto i = parse_identifier();
-        v.explicit_type = t;
-        v.identifier = i;
-    });
-    maybe_void([&v, this]() {
-        v.identifier = parse_identifier();
-    });
-    //FIXME
-    expect(token_type::OP_ASSIGN);
-    v.expression = parse_exp();
+        if (!t) {
+            return t.error();
+        }
+        v.explicit_type = t.value();
+    }
+    auto identifier = parse_identifier();
+    if (!identifier) {
+        return identifier.error();
+    }
+    v.identifier = identifier.value();
+    //without a value the variable starts as zero, which needs its type given
+    if (!accept(token_type::OP_ASSIGN)) {
+        if (v.explicit_type) {
+            return v;
+        }
+        return expected(token_type::OP_ASSIGN);
+    }
+    auto expression = parse_exp();
+    if (!expression) {
+        return expression.error();
+    }
+    v.expression = std::move(expression.value());
     return v;
 }
-ast::s_return parser_context::parse_return() {
+parser::result<ast::s_return> parser_context::parse_return() {
     ast::s_return r {};
-    expect(token_type::RETURN);
-    r.expression = maybe(&parser_context::parse_exp);
+    if (!accept(token_type::RETURN)) {
+        return expected(token_type::RETURN);
+    }
+    if (current_token != token_type::SEMICOLON && current_token != token_type::CLOSE_C_BRACKET) {
+        auto expression = parse_exp();
+        if (!expression) {
+            return expression.error();
+        }
+        r.expression = std::move(expression.value());
+    }
     return r;
 }
-ast::s_break parser_context::parse_break() {
+parser::result<ast::s_break> parser_context::parse_break() {
     ast::s_break b {};
-    expect(token_type::BREAK);
+    if (!accept(token_type::BREAK)) {
+        return expected(token_type::BREAK);
+    }
     return b;
 }
-ast::s_continue parser_context::parse_continue() {
+parser::result<ast::s_continue> parser_context::parse_continue() {
     ast::s_continue c {};
-    expect(token_type::CONTINUE);
+    if (!accept(token_type::CONTINUE)) {
+        return expected(token_type::CONTINUE);
+    }
     return c;
 }
-ast::field_access parser_context::parse_field_access() {
-    ast::field_access f {};
-    expect(token_type::OP_ACCESS);
-    f = parse_identifier();
-    return f;
+parser::result<ast::field_access> parser_context::parse_field_access() {
+    if (!accept(token_type::OP_ACCESS)) {
+        return expected(token_type::OP_ACCESS);
+    }
+    return parse_identifier();
 }
-ast::array_access parser_context::parse_array_access() {
-    ast::array_access a {};
-    expect(token_type::OPEN_S_BRACKET);
-    a = parse_exp();
-    expect(token_type::CLOSE_S_BRACKET);
+parser::result<ast::array_access> parser_context::parse_array_access() {
+    if (!accept(token_type::OPEN_S_BRACKET)) {
+        return expected(token_type::OPEN_S_BRACKET);
+    }
+    auto a = parse_exp();
+    if (!a) {
+        return a.error();
+    }
+    if (!accept(token_type::CLOSE_S_BRACKET)) {
+        return expected(token_type::CLOSE_S_BRACKET);
+    }
     return a;
 }
-ast::access parser_context::parse_access() {
-    auto f = maybe(&parser_context::parse_field_access);
-    if (f) {
-        return std::move(f.value());
-    }
-    auto a = maybe(&parser_context::parse_array_access);
-    if (a) {
-        return std::move(a.value());
+parser::result<ast::access> parser_context::parse_access() {
+    switch (current_token) {
+        case token_type::OP_ACCESS: {
+            auto f = parse_field_access();
+            if (!f) {
+                return f.error();
+            }
+            return ast::access{f.value()};
+        }
+        case token_type::OPEN_S_BRACKET: {
+            auto a = parse_array_access();
+            if (!a) {
+                return a.error();
+            }
+            return ast::access{std::move(a.value())};
+        }
+        default:
+            return p_error(current_location(), "parser expected accessor. got", current_token);
     }
-    p_error(location, "parser expected accessor. got");
 }
-ast::accessor parser_context::parse_accessor() {
+parser::result<ast::accessor> parser_context::parse_accessor() {
     ast::accessor a {};
-    a.identifier = parse_identifier();
-    a.fields = parse_list(&parser_context::parse_access);
+    auto identifier = parse_identifier();
+    if (!identifier) {
+        return identifier.error();
+    }
+    a.identifier = identifier.value();
+    while (current_token == token_type::OP_ACCESS || current_token == token_type::OPEN_S_BRACKET) {
+        auto access = parse_access();
+        if (!access) {
+            return access.error();
+        }
+        a.fields.emplace_back(std::move(access.value()));
+    }
     return a;
 }
-ast::named_type parser_context::parse_named_type() {
+parser::result<ast::named_type> parser_context::parse_named_type() {
     switch (current_token) {
         case token_type::PRIMITIVE_TYPE:
-            return {parse_primitive_type()};
+            return ast::named_type{parse_primitive_type().value()};
         case token_type::IDENTIFIER:
             //TODO
-            return {ast::user_type {
-                std::get<ast::identifier>(expectp(token_type::IDENTIFIER)).value
+            return ast::named_type{ast::user_type {
+                parse_identifier().value().value
             }};
+        case token_type::OPEN_S_BRACKET: {
+            accept(token_type::OPEN_S_BRACKET);
+            auto element_type = parse_primitive_type();
+            if (!element_type) {
+                return element_type.error();
+            }
+            if (!accept(token_type::CLOSE_S_BRACKET)) {
+                return expected(token_type::CLOSE_S_BRACKET);
+            }
+            return ast::named_type{ast::buffer_type{element_type.value()}};
+        }
         default:
-            p_error(location, "parser expected named type. got", current_token);
+            return p_error(current_location(), "parser expected named type. got", current_token);
     }
 }
-ast::type parser_context::parse_type() {
-    ast::type t {};
-    auto n = maybe(&parser_context::parse_named_type);
-    if (n) {
-        return ast::type{n.value()};
-    }
-    auto s = maybe(&parser_context::parse_struct_type);
-    if (s) {
-        return ast::type{s.value()};
-    }
-    auto a = maybe(&parser_context::parse_array_type);
-    if (a) {
-        return ast::type{a.value()};
+parser::result<ast::type> parser_context::parse_type() {
+    switch (current_token) {
+        case token_type::PRIMITIVE_TYPE:
+        case token_type::IDENTIFIER:
+            return ast::type{parse_named_type().value()};
+        case token_type::STRUCT: {
+            auto s = parse_struct_type();
+            if (!s) {
+                return s.error();
+            }
+            return ast::type{s.value()};
+        }
+        case token_type::OPEN_S_BRACKET: {
+            //[f32] is a buffer, [f32 16] an array
+            if (peek_token(2) == token_type::CLOSE_S_BRACKET) {
+                auto b = parse_named_type();
+                if (!b) {
+                    return b.error();
+                }
+                return ast::type{b.value()};
+            }
+            auto a = parse_array_type();
+            if (!a) {
+                return a.error();
+            }
+            return ast::type{a.value()};
+        }
+        default:
+            return p_error(current_location(), "parser expected type. got", current_token);
     }
-    p_error(location, "parser expected type. got", current_token);
-}
-ast::primitive_type parser_context::parse_primitive_type() {
-    return std::get<ast::primitive_type>(expectp(token_type::PRIMITIVE_TYPE));
 }
-ast::named_type parser_context::parse_primitive_type_as_named_type() {
-    return ast::named_type{parse_primitive_type()};
+parser::result<ast::primitive_type> parser_context::parse_primitive_type() {
+    auto p = expectp(token_type::PRIMITIVE_TYPE);
+    if (!p) {
+        return p.error();
+    }
+    return std::get<ast::primitive_type>(p.value());
 }
-ast::field parser_context::parse_field() {
+parser::result<ast::field> parser_context::parse_field() {
     ast::field f;
-    f.type = parse_named_type();
-    f.identifier = parse_identifier();
+    auto type = parse_named_type();
+    if (!type) {
+        return type.error();
+    }
+    f.type = type.value();
+    auto identifier = parse_identifier();
+    if (!identifier) {
+        return identifier.error();
+    }
+    f.identifier = identifier.value();
     return f;
 }
-ast::struct_type parser_context::parse_struct_type() {
+parser::result<ast::struct_type> parser_context::parse_struct_type() {
     ast::struct_type s;
-    expect(token_type::STRUCT);
-    expect(token_type::OPEN_C_BRACKET);
-    s.fields = parse_list(&parser_context::parse_field, token_type::COMMA, token_type::CLOSE_C_BRACKET);
+    if (!accept(token_type::STRUCT)) {
+        return expected(token_type::STRUCT);
+    }
+    if (!accept(token_type::OPEN_C_BRACKET)) {
+        return expected(token_type::OPEN_C_BRACKET);
+    }
+    auto fields = parse_list(&parser_context::parse_field, token_type::COMMA, token_type::CLOSE_C_BRACKET);
+    if (!fields) {
+        return fields.error();
+    }
+    s.fields = std::move(fields.value());
     return s;
 }
-ast::array_type parser_context::parse_array_type() {
-    expect(token_type::OPEN_S_BRACKET);
+parser::result<ast::array_type> parser_context::parse_array_type() {
+    if (!accept(token_type::OPEN_S_BRACKET)) {
+        return expected(token_type::OPEN_S_BRACKET);
+    }
     ast::array_type a;
-    a.element_type = parse_named_type();
-    a.length = std::get<ast::literal_integer>(parse_literal_integer().literal).data;
-    expect(token_type::CLOSE_S_BRACKET);
+    auto element_type = parse_named_type();
+    if (!element_type) {
+        return element_type.error();
+    }
+    a.element_type = element_type.value();
+    auto length = parse_literal_integer();
+    if (!length) {
+        return length.error();
+    }
+    a.length = std::get<ast::literal_integer>(length.value().literal).data;
+    if (!accept(token_type::CLOSE_S_BRACKET)) {
+        return expected(token_type::CLOSE_S_BRACKET);
+    }
     return a;
 }
-ast::literal parser_context::parse_literal() {
+parser::result<ast::layout> parser_context::parse_layout() {
+    auto location = current_location();
+    auto identifier = parse_identifier();
+    if (!identifier) {
+        return identifier.error();
+    }
+    auto name = lexer.symbols_registry.get(identifier.value());
+    ast::layout l {};
+    if (name == "aos") {
+        l.value = ast::layout::aos;
+    } else if (name == "soa") {
+        l.value = ast::layout::soa;
+    } else if (name == "aosoa") {
+        l.value = ast::layout::aosoa;
+        auto block = parse_literal_integer();
+        if (!block) {
+            return block.error();
+        }
+        l.block = std::get<ast::literal_integer>(block.value().literal).data;
+    } else {
+        return p_error(location, "parser expected layout aos, soa or aosoa. got", name);
+    }
+    return l;
+}
+parser::result<ast::schedule> parser_context::parse_schedule() {
+    ast::schedule s {};
+    s.loc = current_location();
+    if (!accept(token_type::SCHEDULE)) {
+        return expected(token_type::SCHEDULE);
+    }
+    auto function = parse_identifier();
+    if (!function) {
+        return function.error();
+    }
+    s.function = function.value();
+    if (!accept(token_type::OPEN_C_BRACKET)) {
+        return expected(token_type::OPEN_C_BRACKET);
+    }
+    auto directives = parse_list(&parser_context::parse_directive, token_type::SEMICOLON, token_type::CLOSE_C_BRACKET);
+    if (!directives) {
+        return directives.error();
+    }
+    s.directives = std::move(directives.value());
+    return s;
+}
+parser::result<ast::directive> parser_context::parse_directive() {
+    ast::directive d {};
+    d.loc = current_location();
+    auto identifier = parse_identifier();
+    if (!identifier) {
+        return identifier.error();
+    }
+    //the labels and numbers after the name, l for a label and n for a number
+    std::string arguments;
+    while (current_token == token_type::IDENTIFIER || current_token == token_type::LITERAL_INTEGER) {
+        if (current_token == token_type::IDENTIFIER) {
+            d.loops.push_back(parse_identifier().value());
+            arguments += "l";
+        } else {
+            d.factors.push_back(std::get<ast::literal_integer>(parse_literal_integer().value().literal).data);
+            arguments += "n";
+        }
+    }
+    auto name = lexer.symbols_registry.get(identifier.value());
+    std::string_view usage;
+    bool matches = false;
+    if (name == "split") {
+        d.kind = ast::directive::split;
+        usage = "split loop factor outer inner";
+        matches = arguments == "lnll";
+    } else if (name == "tile") {
+        d.kind = ast::directive::tile;
+        usage = "tile y x y_factor x_factor y_outer x_outer y_inner x_inner";
+        matches = arguments == "llnnllll";
+    } else if (name == "reorder") {
+        d.kind = ast::directive::reorder;
+        usage = "reorder outermost ... innermost";
+        matches = arguments.size() >= 2 && d.factors.empty();
+    } else if (name == "vectorize") {
+        d.kind = ast::directive::vectorize;
+        usage = "vectorize loop [lanes]";
+        matches = arguments == "l" || arguments == "ln";
+    } else if (name == "parallel") {
+        d.kind = ast::directive::parallel;
+        usage = "parallel loop [grain]";
+        matches = arguments == "l" || arguments == "ln";
+    } else if (name == "unroll") {
+        d.kind = ast::directive::unroll;
+        usage = "unroll loop [count]";
+        matches = arguments == "l" || arguments == "ln";
+    } else {
+        return p_error(d.loc, "parser expected schedule directive split, tile, reorder, vectorize, parallel or unroll. got", name);
+    }
+    if (!matches) {
+        return p_error(d.loc, "parser expected", usage, "got", current_token);
+    }
+    return d;
+}
+parser::result<ast::literal> parser_context::parse_literal() {
     ast::literal l {};
     switch (current_token) {
         case token_type::LITERAL_BOOL:
-            l.literal = std::get<bool>(expectp(current_token));
-            l.explicit_type = maybe(&parser_context::parse_primitive_type_as_named_type);
+            l.literal = std::get<bool>(expectp(current_token).value());
             break;
         case token_type::LITERAL_INTEGER:
-            l.literal = std::get<ast::literal_integer>(expectp(current_token));
-            l.explicit_type = maybe(&parser_context::parse_primitive_type_as_named_type);
+            l.literal = std::get<ast::literal_integer>(expectp(current_token).value());
             break;
         case token_type::LITERAL_FLOAT:
-            l.literal = std::get<double>(expectp(current_token));
-            l.explicit_type = maybe(&parser_context::parse_primitive_type_as_named_type);
+            l.literal = std::get<double>(expectp(current_token).value());
             break;
         default:
-            p_error(location, "parser expected literal. got", current_token);
+            return p_error(current_location(), "parser expected literal. got", current_token);
+    }
+    if (current_token == token_type::PRIMITIVE_TYPE) {
+        l.explicit_type = ast::named_type{parse_primitive_type().value()};
     }
     return l;
 }
-ast::literal parser_context::parse_literal_integer() {
-    return ast::literal{std::get<ast::literal_integer>(expectp(token_type::LITERAL_INTEGER))};
+parser::result<ast::literal> parser_context::parse_literal_integer() {
+    auto p = expectp(token_type::LITERAL_INTEGER);
+    if (!p) {
+        return p.error();
+    }
+    return ast::literal{std::get<ast::literal_integer>(p.value())};
 }
-ast::statement parser_context::parse_top_level_statement() {
+parser::result<ast::statement> parser_context::parse_top_level_statement() {
     ast::statement s;
     switch (current_token) {
         case token_type::EXPORT:
-        case token_type::FUNCTION:  s.statement = parse_function_def(); break;
-        case token_type::TYPE:      s.statement = parse_type_def(); break;
-        case token_type::VAR:       s.statement = parse_variable_def(); break;
-        default: p_error(location, "parser expected top level statement: one of function def, type def, or variable def. got", current_token);
+        case token_type::FUNCTION: {
+            auto f = parse_function_def();
+            if (!f) {
+                return f.error();
+            }
+            s.statement = arena->make<ast::function_def>(std::move(f.value()));
+            break;
+        }
+        case token_type::TYPE: {
+            auto t = parse_type_def();
+            if (!t) {
+                return t.error();
+            }
+            s.statement = arena->make<ast::type_def>(std::move(t.value()));
+            break;
+        }
+        case token_type::VAR: {
+            auto v = parse_variable_def();
+            if (!v) {
+                return v.error();
+            }
+            s.statement = arena->make<ast::variable_def>(std::move(v.value()));
+            break;
+        }
+        case token_type::SCHEDULE: {
+            auto schedule = parse_schedule();
+            if (!schedule) {
+                return schedule.error();
+            }
+            s.statement = arena->make<ast::schedule>(std::move(schedule.value()));
+            break;
+        }
+        default:
+            return p_error(current_location(), "parser expected top level statement: one of function def, type def, variable def, or schedule. got", current_token);
     }
     return s;
 }
-ast::statement parser_context::parse_statement() {
+parser::result<ast::statement> parser_context::parse_statement() {
     ast::statement s;
-    auto v = choose(
-        &parser_context::parse_exp,
-        &parser_context::parse_function_def,
-        &parser_context::parse_variable_def,
-        &parser_context::parse_type_def,
-        &parser_context::parse_assignment,
-        &parser_context::parse_return,
-        &parser_context::parse_break,
-        &parser_context::parse_continue
-    );
-    if (!v) {
-        p_error(location, "parser expected statement. got", current_token);
-    }
-    s.statement = std::move(v.value());
-    return s;
+    switch (current_token) {
+        case token_type::EXPORT:
+        case token_type::FUNCTION:
+        case token_type::TYPE:
+        case token_type::VAR:
+            return parse_top_level_statement();
+        case token_type::RETURN: {
+            auto r = parse_return();
+            if (!r) {
+                return r.error();
+            }
+            s.statement = arena->make<ast::s_return>(std::move(r.value()));
+            return s;
+        }
+        case token_type::BREAK: {
+            auto b = parse_break();
+            if (!b) {
+                return b.error();
+            }
+            s.statement = arena->make<ast::s_break>(std::move(b.value()));
+            return s;
+        }
+        case token_type::CONTINUE: {
+            auto c = parse_continue();
+            if (!c) {
+                return c.error();
+            }
+            s.statement = std::move(c.value());
+            return s;
+        }
+        case token_type::IDENTIFIER:
+            if (peek_token() != token_type::OPEN_R_BRACKET) {
+                //an accessor starts both an assignment and an expression, so
+                //parse it once and decide on the token after it
+                auto a = parse_accessor();
+                if (!a) {
+                    return a.error();
+                }
+                if (accept(token_type::OP_ASSIGN)) {
+                    ast::assignment assignment {};
+                    assignment.accessor = std::move(a.value());
+                    auto expression = parse_exp();
+                    if (!expression) {
+                        return expression.error();
+                    }
+                    assignment.expression = std::move(expression.value());
+                    s.statement = arena->make<ast::assignment>(std::move(assignment));
+                    return s;
+                }
+                ast::expression lhs {};
+                lhs.expression = arena->make<ast::accessor>(std::move(a.value()));
+                auto e = parse_exp_operators(std::move(lhs), 0);
+                if (!e) {
+                    return e.error();
+                }
+                s.statement = std::move(e.value());
+                return s;
+            }
+            [[fallthrough]];
+        default: {
+            auto e = parse_exp();
+            if (!e) {
+                return e.error();
+            }
+            s.statement = std::move(e.value());
+            return s;
+        }
+    }
 }
-ast::expression parser_context::parse_exp() {
+parser::result<ast::expression> parser_context::parse_exp() {
     return parse_exp_at_precedence(0);
 }
 
-ast::expression parser_context::parse_exp_atom() {
+parser::result<ast::expression> parser_context::parse_exp_atom() {
     ast::expression e {};
     switch (current_token) {
         case token_type::LITERAL_BOOL:
         case token_type::LITERAL_INTEGER:
-        case token_type::LITERAL_FLOAT: e.expression = parse_literal(); break;
-        case token_type::IF:        e.expression = std::make_unique<ast::if_statement>(parse_if_statement()); break;
-        case token_type::SWITCH:    e.expression = std::make_unique<ast::switch_statement>(parse_switch_statement()); break;
-        case token_type::FOR:       e.expression = std::make_unique<ast::for_loop>(parse_for_loop()); break;
-        case token_type::WHILE:     e.expression = std::make_unique<ast::while_loop>(parse_while_loop()); break;
+        case token_type::LITERAL_FLOAT: {
+            auto l = parse_literal();
+            if (!l) {
+                return l.error();
+            }
+            e.expression = arena->make<ast::literal>(std::move(l.value()));
+            break;
+        }
+        case token_type::IF: {
+            auto s = parse_if_statement();
+            if (!s) {
+                return s.error();
+            }
+            e.expression = arena->make<ast::if_statement>(std::move(s.value()));
+            break;
+        }
+        case token_type::SWITCH: {
+            auto s = parse_switch_statement();
+            if (!s) {
+                return s.error();
+            }
+            e.expression = arena->make<ast::switch_statement>(std::move(s.value()));
+            break;
+        }
+        case token_type::SIMD:
+        case token_type::CPU:
+        case token_type::FOR: {
+            auto s = parse_for_loop();
+            if (!s) {
+                return s.error();
+            }
+            e.expression = arena->make<ast::for_loop>(std::move(s.value()));
+            break;
+        }
+        case token_type::WHILE: {
+            auto s = parse_while_loop();
+            if (!s) {
+                return s.error();
+            }
+            e.expression = arena->make<ast::while_loop>(std::move(s.value()));
+            break;
+        }
         case token_type::OPEN_C_BRACKET: {
             auto b = parse_block();
-            auto p = std::make_unique<ast::block>(std::move(b));
-            assert(p);
-            e.expression = std::move(p);
-            break;
+            if (!b) {
+                return b.error();
             }
+            e.expression = arena->make<ast::block>(std::move(b.value()));
+            break;
+        }
         case token_type::IDENTIFIER:
-            {
-            auto f = maybe(&parser_context::parse_function_call);
-            if (f) {
-                e.expression = std::make_unique<ast::function_call>(std::move(f.value()));
+            if (peek_token() == token_type::OPEN_R_BRACKET) {
+                auto f = parse_function_call();
+                if (!f) {
+                    return f.error();
+                }
+                e.expression = arena->make<ast::function_call>(std::move(f.value()));
             } else {
-                auto a = maybe(&parser_context::parse_accessor);
-                if (a) {
-                    e.expression = std::make_unique<ast::accessor>(std::move(a.value()));
-                } else {
-                    p_error(location, "parser expected function call or accessor after token", current_token);
+                auto a = parse_accessor();
+                if (!a) {
+                    return a.error();
                 }
+                e.expression = arena->make<ast::accessor>(std::move(a.value()));
             }
             break;
+        case token_type::OPEN_R_BRACKET: {
+            accept(token_type::OPEN_R_BRACKET);
+            auto inner = parse_exp();
+            if (!inner) {
+                return inner.error();
             }
-        case token_type::OPEN_R_BRACKET:
-            {
-            expect(token_type::OPEN_R_BRACKET);
-            e.expression = std::move(parse_exp().expression);
-            expect(token_type::CLOSE_R_BRACKET);
-            break;
+            e.expression = std::move(inner.value().expression);
+            if (!accept(token_type::CLOSE_R_BRACKET)) {
+                return expected(token_type::CLOSE_R_BRACKET);
             }
+            break;
+        }
         default:
-            p_error(location, "parser expected expression atom. got", current_token);
+            return p_error(current_location(), "parser expected expression atom. got", current_token);
     }
     return e;
 }
 
-ast::expression parser_context::parse_exp_at_precedence(int current_precedence) {
+parser::result<ast::expression> parser_context::parse_exp_at_precedence(int current_precedence) {
+    auto atom = parse_exp_atom();
+    if (!atom) {
+        return atom.error();
+    }
+    return parse_exp_operators(std::move(atom.value()), current_precedence);
+}
+
+parser::result<ast::expression> parser_context::parse_exp_operators(ast::expression lhs, int current_precedence) {
     //FIXME parsing unary operators
-    ast::expression el = parse_exp_atom();
-    std::optional<ast::expression> er {};
-    token_type op {};
-    while (true) {
-        if (!is_operator(current_token)) {
-            break;
-        }
-        op = current_token;
-        auto p = get_precedence(current_token);
+    while (is_operator(current_token)) {
+        token_type op = current_token;
+        auto p = get_precedence(op);
         if (p < current_precedence) {
             break;
         }
-        auto a = get_associativity(current_token);
-        accept(current_token);
-        er = {parse_exp_at_precedence(
+        auto a = get_associativity(op);
+        accept(op);
+        auto rhs = parse_exp_at_precedence(
             a == associativity::left ? p + 1 : p
-        )};
-    }
-    if (er) {
+        );
+        if (!rhs) {
+            return rhs.error();
+        }
         ast::binary_operator b {};
-        b.l = std::move(el);
-        b.r = std::move(er.value());
+        b.l = std::move(lhs);
+        b.r = std::move(rhs.value());
         b.binary_operator = get_binary_operator(op);
         ast::expression e {};
-        e.expression = std::make_unique<ast::binary_operator>(std::move(b));
-        return e;
-    } else {
-        return el;
+        e.expression = arena->make<ast::binary_operator>(std::move(b));
+        lhs = std::move(e);
     }
+    return lhs;
 }
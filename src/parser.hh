@@ -2,83 +2,74 @@
 
 #include <iostream>
 #include <functional>
-#include <deque>
-#include <exception>
 
 #include "ast.hh"
 #include "tokens.hh"
 #include "lexer.hh"
-
-using param_type = std::variant<ast::primitive_type, ast::identifier, bool, ast::literal_integer, double>;
+#include "result.hh"
 
 struct parser_context {
+    //locations point at it, so it has to outlive the parse
+    std::string filename;
     yy::location location;
     lexer_context& lexer;
+    ast::arena* arena = nullptr;
 
-    size_t buffer_loc = -1;
-    std::deque<std::pair<token_type, param_type>> buffer {};
+    token_stream tokens;
+    size_t buffer_loc = 0;
     token_type current_token {};
 
     parser_context(lexer_context& lexer_): lexer(lexer_) {}
 
     void next_token();
+    token_type peek_token(size_t n = 1);
+    const param_type& current_param();
+    yy::location current_location();
     bool accept(token_type t);
-    void expect(token_type t);
-    param_type expectp(token_type t);
+    parser::parse_error expected(token_type t);
+    parser::result<token_type> expect(token_type t);
+    parser::result<param_type> expectp(token_type t);
 
     template<typename T>
-    auto maybe(T parse) -> std::optional<decltype(std::invoke(parse, this))>;
-    template<typename T>
-    auto maybe_void(T parse);
-    template<typename ...T>
-    auto choose(std::optional<T>... opts) -> std::optional<std::variant<T...>>;
-    template<typename ...T>
-    auto choose(T... parse) -> std::optional<std::variant<decltype(std::invoke(parse, this))...>>;
-    template<typename ...T>
-    auto sequence(T... ps) -> std::tuple<T...>;
-    template<typename S, typename ...T>
-    auto sequence(T... ps) -> S;
-    template<typename T>
-    std::vector<T> parse_list(T (parser_context::*parse)());
-    template<typename T>
-    std::vector<T> parse_list(T (parser_context::*parse)(), token_type delim);
-    template<typename T>
-    std::vector<T> parse_list_sep(T (parser_context::*parse)(), token_type sep);
+    parser::result<std::vector<T>> parse_list(parser::result<T> (parser_context::*parse)(), token_type delim);
     template<typename T>
-    std::vector<T> parse_list(T (parser_context::*parse)(), token_type sep, token_type delim);
+    parser::result<std::vector<T>> parse_list(parser::result<T> (parser_context::*parse)(), token_type sep, token_type delim);
 
     ast::program parse_program(std::string filename);
-    ast::if_statement parse_if_statement();
-    ast::for_loop parse_for_loop();
-    ast::while_loop parse_while_loop();
-    ast::case_statement parse_case();
-    ast::switch_statement parse_switch_statement();
-    ast::identifier parse_identifier();
-    ast::function_def parse_function_def();
-    ast::function_call parse_function_call();
-    ast::type_def parse_type_def();
-    ast::assignment parse_assignment();
-    ast::variable_def parse_variable_def();
-    ast::s_return parse_return();
-    ast::s_break parse_break();
-    ast::s_continue parse_continue();
-    ast::block parse_block();
-    ast::field_access parse_field_access();
-    ast::array_access parse_array_access();
-    ast::access parse_access();
-    ast::accessor parse_accessor();
-    ast::type parse_type();
-    ast::named_type parse_named_type();
-    ast::primitive_type parse_primitive_type();
-    ast::named_type parse_primitive_type_as_named_type();
-    ast::field parse_field();
-    ast::struct_type parse_struct_type();
-    ast::array_type parse_array_type();
-    ast::literal parse_literal();
-    ast::literal parse_literal_integer();
-    ast::statement parse_top_level_statement();
-    ast::statement parse_statement();
-    ast::expression parse_exp();
-    ast::expression parse_exp_atom();
-    ast::expression parse_exp_at_precedence(int current_precedence);
+    parser::result<ast::if_statement> parse_if_statement();
+    parser::result<ast::for_loop> parse_for_loop();
+    parser::result<ast::while_loop> parse_while_loop();
+    parser::result<ast::case_statement> parse_case();
+    parser::result<ast::switch_statement> parse_switch_statement();
+    parser::result<ast::identifier> parse_identifier();
+    parser::result<ast::function_def> parse_function_def();
+    parser::result<ast::function_call> parse_function_call();
+    parser::result<ast::type_def> parse_type_def();
+    parser::result<ast::assignment> parse_assignment();
+    parser::result<ast::variable_def> parse_variable_def();
+    parser::result<ast::s_return> parse_return();
+    parser::result<ast::s_break> parse_break();
+    parser::result<ast::s_continue> parse_continue();
+    parser::result<ast::block> parse_block();
+    parser::result<ast::field_access> parse_field_access();
+    parser::result<ast::array_access> parse_array_access();
+    parser::result<ast::access> parse_access();
+    parser::result<ast::accessor> parse_accessor();
+    parser::result<ast::type> parse_type();
+    parser::result<ast::named_type> parse_named_type();
+    parser::result<ast::primitive_type> parse_primitive_type();
+    parser::result<ast::field> parse_field();
+    parser::result<ast::struct_type> parse_struct_type();
+    parser::result<ast::array_type> parse_array_type();
+    parser::result<ast::layout> parse_layout();
+    parser::result<ast::schedule> parse_schedule();
+    parser::result<ast::directive> parse_directive();
+    parser::result<ast::literal> parse_literal();
+    parser::result<ast::literal> parse_literal_integer();
+    parser::result<ast::statement> parse_top_level_statement();
+    parser::result<ast::statement> parse_statement();
+    parser::result<ast::expression> parse_exp();
+    parser::result<ast::expression> parse_exp_atom();
+    parser::result<ast::expression> parse_exp_at_precedence(int current_precedence);
+    parser::result<ast::expression> parse_exp_operators(ast::expression lhs, int current_precedence);
 };
@@ -0,0 +1,22 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "bench.hh"
+#include "lexer.hh"
+#include "parser.hh"
+
+int main(int argc, char *argv[]) {
+    size_t functions = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000;
+    for (size_t scale = 1; scale <= 8; scale *= 2) {
+        size_t n = functions * scale;
+        std::string filename = write_temp_source("parser_bench", generate_functions(n));
+        bench_timer t;
+        lexer_context lexer(filename);
+        parser_context parser(lexer);
+        auto program_ast = parser.parse_program(filename);
+        double s = t.seconds();
+        std::remove(filename.c_str());
+        printf("parsed %zu functions in %.3f s: %.2f us/function\n",
+            program_ast.statements.size(), s, s / n * 1e6);
+    }
+}
@@ -2,18 +2,28 @@
 
 #include <unordered_map>
 #include <vector>
+#include <string_view>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
 
 template<typename K, typename V>
 struct registry {
     std::unordered_map<decltype(K::value), V> data;
 
-    void insert(K& k, V& v) {
+    void insert(const K& k, V v) {
         data[k.value] = std::move(v);
     }
     
     V& get(K& k) {
         return data[k.value];
     }
+
+    V* find(const K& k) {
+        auto f = data.find(k.value);
+        return f != data.end() ? &f->second : nullptr;
+    }
 };
 
 template<typename K, typename V>
@@ -37,3 +47,90 @@ struct bi_registry {
         return list[k.value];
     }
 };
+
+
+template<typename K>
+struct interner {
+    //each symbol is stored once, null terminated, in chunked storage that
+    //never moves, so the views handed out stay valid for the interner's life
+    static constexpr size_t chunk_size = 64 * 1024;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    size_t chunk_used = chunk_size;
+
+    std::vector<std::string_view> list;
+    //hash of each symbol, kept so growing the table never rehashes strings
+    std::vector<uint64_t> hashes;
+    //open addressing table of list index + 1, 0 for an empty slot
+    std::vector<uint32_t> slots = std::vector<uint32_t>(64);
+
+    interner() = default;
+    interner(const interner&) = delete;
+    interner& operator=(const interner&) = delete;
+    interner(interner&&) = default;
+    interner& operator=(interner&&) = default;
+
+    static uint64_t hash(std::string_view s) {
+        uint64_t h = 14695981039346656037ull;
+        for (char c: s) {
+            h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+        return h;
+    }
+
+    K insert(std::string_view s) {
+        uint64_t h = hash(s);
+        size_t mask = slots.size() - 1;
+        size_t i = h & mask;
+        while (slots[i] != 0) {
+            size_t index = slots[i] - 1;
+            if (hashes[index] == h && list[index] == s) {
+                return K{index};
+            }
+            i = (i + 1) & mask;
+        }
+        K id {list.size()};
+        slots[i] = list.size() + 1;
+        list.push_back(store(s));
+        hashes.push_back(h);
+        if (list.size() * 2 > slots.size()) {
+            grow();
+        }
+        return id;
+    }
+
+    std::string_view get(K k) const {
+        return list[k.value];
+    }
+    const char* c_str(K k) const {
+        return list[k.value].data();
+    }
+    size_t size() const {
+        return list.size();
+    }
+
+private:
+    std::string_view store(std::string_view s) {
+        if (chunk_used + s.size() + 1 > chunk_size) {
+            chunks.emplace_back(new char[std::max(chunk_size, s.size() + 1)]);
+            chunk_used = 0;
+        }
+        char* p = chunks.back().get() + chunk_used;
+        std::memcpy(p, s.data(), s.size());
+        p[s.size()] = '\0';
+        //a symbol too big for a chunk gets its own, mark it full
+        chunk_used = s.size() + 1 > chunk_size ? chunk_size : chunk_used + s.size() + 1;
+        return {p, s.size()};
+    }
+    void grow() {
+        std::vector<uint32_t> new_slots(slots.size() * 2);
+        size_t mask = new_slots.size() - 1;
+        for (size_t index = 0; index < list.size(); index++) {
+            size_t i = hashes[index] & mask;
+            while (new_slots[i] != 0) {
+                i = (i + 1) & mask;
+            }
+            new_slots[i] = index + 1;
+        }
+        slots = std::move(new_slots);
+    }
+};
@@ -1,53 +1,31 @@
 #pragma once
 
+#include <string>
 #include <variant>
-#include <optional>
-
-#include "error.hh"
+#include <utility>
 
 namespace parser {
 
+struct parse_error {
+    std::string message;
+};
+
 template<typename T>
 struct result {
     std::variant<T, parser::parse_error> data;
 
-    template<typename ...Args>
-    result(Args&&... args) : data(std::forward<Args>(args)...) {}
+    result(T&& t) : data(std::move(t)) {}
+    result(const T& t) : data(t) {}
+    result(parser::parse_error e) : data(std::move(e)) {}
 
-    template<typename P>
-    result wrap(P parse) {
-        try {
-            data = std::invoke(parse);
-        } catch (parser::parse_error& e) {
-            data = e;
-        }
-        return *this;
-    }
-
-    operator bool() {
+    explicit operator bool() const {
         return std::holds_alternative<T>(data);
     }
-    operator std::optional<T>() {
-        if (*this) {
-            return {value()};
-        } else {
-            return std::nullopt;
-        }
-    }
-    T&& value() {
-        if (*this) {
-            return std::get<T>(data);
-        }
-    }
-    parser::parse_error error() {
-        if (!*this) {
-            return std::get<parser::parse_error>(data);
-        }
+    T& value() {
+        return std::get<T>(data);
     }
-    void unwrap() {
-        if (!*this) {
-            throw std::get<parser::parse_error>(data);
-        }
+    parser::parse_error& error() {
+        return std::get<parser::parse_error>(data);
     }
 };
 
@@ -0,0 +1,724 @@
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <variant>
+#include <vector>
+
+#include "schedule.hh"
+#include "clone.hh"
+#include "typecheck.hh"
+#include "scopes.hh"
+#include "error.hh"
+#include "timing.hh"
+
+//calls f on every expression under a node, outer ones first, except those
+//in function definitions, which have loops of their own
+template<typename F>
+struct walk_fn {
+    F& f;
+
+    template<typename T>
+    void operator()(ast::ptr<T>& p) {
+        std::invoke(*this, *p);
+    }
+    template<typename T>
+    void operator()(std::optional<T>& o) {
+        if (o) {
+            std::invoke(*this, *o);
+        }
+    }
+    template<typename T>
+    void operator()(std::vector<T>& v) {
+        for (auto& t: v) {
+            std::invoke(*this, t);
+        }
+    }
+
+    void operator()(ast::statement& statement) {
+        std::visit(*this, statement.statement);
+    }
+    void operator()(ast::expression& expression) {
+        f(expression);
+        std::visit(*this, expression.expression);
+    }
+    void operator()(ast::block& block) {
+        std::invoke(*this, block.statements);
+    }
+    void operator()(ast::function_def&) {
+    }
+    void operator()(ast::variable_def& variable_def) {
+        std::invoke(*this, variable_def.expression);
+    }
+    void operator()(ast::type_def&) {
+    }
+    void operator()(ast::assignment& assignment) {
+        std::invoke(*this, assignment.accessor);
+        std::invoke(*this, assignment.expression);
+    }
+    void operator()(ast::s_return& s_return) {
+        std::invoke(*this, s_return.expression);
+    }
+    void operator()(ast::s_break& s_break) {
+        std::invoke(*this, s_break.expression);
+    }
+    void operator()(ast::s_continue&) {
+    }
+    void operator()(ast::schedule&) {
+    }
+    void operator()(ast::if_statement& if_statement) {
+        std::invoke(*this, if_statement.conditions);
+        std::invoke(*this, if_statement.blocks);
+    }
+    void operator()(ast::for_loop& for_loop) {
+        std::invoke(*this, for_loop.initial);
+        std::invoke(*this, for_loop.condition);
+        std::invoke(*this, for_loop.step);
+        std::invoke(*this, for_loop.block);
+    }
+    void operator()(ast::while_loop& while_loop) {
+        std::invoke(*this, while_loop.condition);
+        std::invoke(*this, while_loop.block);
+    }
+    void operator()(ast::switch_statement& switch_statement) {
+        std::invoke(*this, switch_statement.expression);
+        for (auto& case_statement: switch_statement.cases) {
+            std::invoke(*this, case_statement.block);
+        }
+    }
+    void operator()(ast::accessor& accessor) {
+        for (auto& field: accessor.fields) {
+            if (auto* index = std::get_if<ast::array_access>(&field)) {
+                std::invoke(*this, *index);
+            }
+        }
+    }
+    void operator()(ast::identifier) {
+    }
+    void operator()(ast::literal&) {
+    }
+    void operator()(ast::function_call& function_call) {
+        std::invoke(*this, function_call.arguments);
+    }
+    void operator()(ast::binary_operator& binary_operator) {
+        std::invoke(*this, binary_operator.l);
+        std::invoke(*this, binary_operator.r);
+    }
+    void operator()(ast::unary_operator& unary_operator) {
+        std::invoke(*this, unary_operator.r);
+    }
+};
+
+template<typename T, typename F>
+static void walk(T& t, F&& f) {
+    std::invoke(walk_fn<F>{f}, t);
+}
+
+//the variables an expression reads
+struct variables_read {
+    std::unordered_set<size_t> whole;
+    //buffers only read for their length, which storing to elements doesn't change
+    std::unordered_set<size_t> lengths;
+    bool count(ast::identifier identifier) const {
+        return whole.count(identifier.value) || lengths.count(identifier.value);
+    }
+};
+
+//what a loop's body does that decides whether a directive keeps its meaning
+struct body_fn {
+    //variables defined in the body, which hide ones from outside it
+    ::scopes<ast::identifier, bool> locals;
+    //loops inside the body, which break and continue leave
+    size_t loops = 0;
+    //variables from outside the body it stores to, and ones it only stores
+    //elements of
+    std::unordered_set<size_t> stored;
+    std::unordered_set<size_t> stored_elements;
+    //a break or continue that leaves the loop itself, not one inside it
+    const char* leaves = nullptr;
+    bool defines_function = false;
+
+    template<typename T>
+    void operator()(ast::ptr<T>& p) {
+        std::invoke(*this, *p);
+    }
+    template<typename T>
+    void operator()(std::optional<T>& o) {
+        if (o) {
+            std::invoke(*this, *o);
+        }
+    }
+    template<typename T>
+    void operator()(std::vector<T>& v) {
+        for (auto& t: v) {
+            std::invoke(*this, t);
+        }
+    }
+
+    void operator()(ast::statement& statement) {
+        std::visit(*this, statement.statement);
+    }
+    void operator()(ast::expression& expression) {
+        std::visit(*this, expression.expression);
+    }
+    void operator()(ast::block& block) {
+        locals.push_scope();
+        std::invoke(*this, block.statements);
+        locals.pop_scope();
+    }
+    void operator()(ast::function_def&) {
+        defines_function = true;
+    }
+    void operator()(ast::variable_def& variable_def) {
+        std::invoke(*this, variable_def.expression);
+        locals.push_item(variable_def.identifier, true);
+    }
+    void operator()(ast::type_def&) {
+    }
+    void operator()(ast::assignment& assignment) {
+        auto& fields = assignment.accessor.fields;
+        if (!locals.find_item(assignment.accessor.identifier)) {
+            bool element = !fields.empty() && std::holds_alternative<ast::array_access>(fields.front());
+            (element ? stored_elements : stored).insert(assignment.accessor.identifier.value);
+        }
+        std::invoke(*this, assignment.accessor);
+        std::invoke(*this, assignment.expression);
+    }
+    void operator()(ast::s_return& s_return) {
+        std::invoke(*this, s_return.expression);
+    }
+    void operator()(ast::s_break& s_break) {
+        if (loops == 0) {
+            leaves = "break";
+        }
+        std::invoke(*this, s_break.expression);
+    }
+    void operator()(ast::s_continue&) {
+        if (loops == 0) {
+            leaves = "continue";
+        }
+    }
+    void operator()(ast::schedule&) {
+    }
+    void operator()(ast::if_statement& if_statement) {
+        std::invoke(*this, if_statement.conditions);
+        std::invoke(*this, if_statement.blocks);
+    }
+    void operator()(ast::for_loop& for_loop) {
+        locals.push_scope();
+        std::invoke(*this, for_loop.initial);
+        std::invoke(*this, for_loop.condition);
+        loops++;
+        std::invoke(*this, for_loop.block);
+        loops--;
+        std::invoke(*this, for_loop.step);
+        locals.pop_scope();
+    }
+    void operator()(ast::while_loop& while_loop) {
+        std::invoke(*this, while_loop.condition);
+        loops++;
+        std::invoke(*this, while_loop.block);
+        loops--;
+    }
+    void operator()(ast::switch_statement& switch_statement) {
+        std::invoke(*this, switch_statement.expression);
+        for (auto& case_statement: switch_statement.cases) {
+            std::invoke(*this, case_statement.block);
+        }
+    }
+    void operator()(ast::accessor& accessor) {
+        for (auto& field: accessor.fields) {
+            if (auto* index = std::get_if<ast::array_access>(&field)) {
+                std::invoke(*this, *index);
+            }
+        }
+    }
+    void operator()(ast::identifier) {
+    }
+    void operator()(ast::literal&) {
+    }
+    void operator()(ast::function_call& function_call) {
+        std::invoke(*this, function_call.arguments);
+    }
+    void operator()(ast::binary_operator& binary_operator) {
+        std::invoke(*this, binary_operator.l);
+        std::invoke(*this, binary_operator.r);
+    }
+    void operator()(ast::unary_operator& unary_operator) {
+        std::invoke(*this, unary_operator.r);
+    }
+};
+
+//the parts of a loop in the form directives rewrite, `var i = start; i < bound; i = i + step`
+struct loop_header {
+    ast::identifier variable;
+    ast::binary_operator& condition;
+    ast::literal& step;
+    uint64_t amount;
+    bool defines_function;
+};
+
+struct schedule_fn {
+    ast::program& program;
+    ast::function_def& function;
+    //the most iterations each loop a split made can run, by label, so it
+    //can be unrolled without a count
+    std::unordered_map<size_t, uint64_t> most_iterations;
+
+    std::string name(ast::identifier identifier) {
+        return std::string(program.symbols_registry.get(identifier));
+    }
+    template<typename ... Ts>
+    [[noreturn]] void fail(ast::directive& directive, std::string loops, Ts ... args) {
+        error(directive.loc, "schedule can't", directive.to_string(), loops + ",", args...);
+    }
+    //a name no variable in the source can have, for the ones directives add
+    ast::identifier derived(ast::identifier base, std::string_view suffix) {
+        return program.symbols_registry.insert(name(base) + "." + std::string(suffix));
+    }
+
+    variables_read reads(ast::expression& expression) {
+        variables_read read;
+        ast::identifier length = program.symbols_registry.insert("length");
+        walk(expression, [&](ast::expression& e) {
+            if (auto* identifier = std::get_if<ast::identifier>(&e.expression)) {
+                read.whole.insert(identifier->value);
+            } else if (auto* accessor = std::get_if<ast::ptr<ast::accessor>>(&e.expression)) {
+                auto& fields = (*accessor)->fields;
+                bool only_length = fields.size() == 1 && std::holds_alternative<ast::field_access>(fields.front()) &&
+                    std::get<ast::field_access>(fields.front()) == length;
+                (only_length ? read.lengths : read.whole).insert((*accessor)->identifier.value);
+            }
+        });
+        return read;
+    }
+
+    std::vector<ast::expression*> labelled(ast::identifier label) {
+        std::vector<ast::expression*> found;
+        walk(function.block, [&](ast::expression& expression) {
+            auto* for_loop = std::get_if<ast::ptr<ast::for_loop>>(&expression.expression);
+            if (for_loop && (*for_loop)->label == label) {
+                found.push_back(&expression);
+            }
+        });
+        return found;
+    }
+    //the expression holding the loop with a label
+    ast::expression& find(ast::directive& directive, ast::identifier label) {
+        auto found = labelled(label);
+        if (found.empty()) {
+            fail(directive, name(label), "no loop in", name(function.identifier), "has that label");
+        }
+        if (found.size() > 1) {
+            fail(directive, name(label), "more than one loop in", name(function.identifier), "has that label");
+        }
+        return *found.front();
+    }
+    static ast::for_loop& loop(ast::expression& expression) {
+        return *std::get<ast::ptr<ast::for_loop>>(expression.expression);
+    }
+    void unused(ast::directive& directive, ast::for_loop& for_loop, ast::identifier label) {
+        if (label != *for_loop.label && !labelled(label).empty()) {
+            fail(directive, name(*for_loop.label), "there's already a loop labelled", name(label));
+        }
+    }
+
+    //a directive only rewrites loops that run the same iterations however
+    //they're split up: a bound and step the body can't change, and no break
+    //or continue, which would leave a different loop once it's split
+    loop_header check_header(ast::directive& directive, ast::for_loop& for_loop) {
+        std::string label = name(*for_loop.label);
+        if (for_loop.simd || for_loop.cpu) {
+            fail(directive, label, "it's already a", for_loop.simd ? "simd" : "cpu", "for loop");
+        }
+        ast::identifier variable = for_loop.initial.identifier;
+        auto induction = [&](ast::expression& expression) {
+            if (auto* identifier = std::get_if<ast::identifier>(&expression.expression)) {
+                return *identifier == variable;
+            }
+            auto* accessor = std::get_if<ast::ptr<ast::accessor>>(&expression.expression);
+            return accessor && (*accessor)->identifier == variable && (*accessor)->fields.empty();
+        };
+        auto* condition = std::get_if<ast::ptr<ast::binary_operator>>(&for_loop.condition.expression);
+        if (!condition || !induction((*condition)->l) ||
+            ((*condition)->binary_operator != ast::binary_operator::C_LT && (*condition)->binary_operator != ast::binary_operator::C_LE)) {
+            fail(directive, label, "its condition isn't the loop variable < or <= a bound");
+        }
+        if (reads((*condition)->r).count(variable)) {
+            fail(directive, label, "its bound changes with the loop variable");
+        }
+        auto* step = std::get_if<ast::ptr<ast::binary_operator>>(&for_loop.step.expression.expression);
+        ast::literal* amount = nullptr;
+        if (step && (*step)->binary_operator == ast::binary_operator::A_ADD) {
+            if (induction((*step)->l) && std::holds_alternative<ast::ptr<ast::literal>>((*step)->r.expression)) {
+                amount = &*std::get<ast::ptr<ast::literal>>((*step)->r.expression);
+            } else if (induction((*step)->r) && std::holds_alternative<ast::ptr<ast::literal>>((*step)->l.expression)) {
+                amount = &*std::get<ast::ptr<ast::literal>>((*step)->l.expression);
+            }
+        }
+        if (for_loop.step.accessor.identifier != variable || !for_loop.step.accessor.fields.empty() || !amount ||
+            !std::holds_alternative<ast::literal_integer>(amount->literal) ||
+            (amount->explicit_type && !amount->explicit_type->is_integer()) ||
+            std::get<ast::literal_integer>(amount->literal).data == 0) {
+            fail(directive, label, "its step isn't the loop variable plus a constant");
+        }
+        body_fn body;
+        std::invoke(body, for_loop.block);
+        if (body.leaves) {
+            fail(directive, label, "its body has a", body.leaves);
+        }
+        if (body.stored.count(variable.value)) {
+            fail(directive, label, "its body changes the loop variable");
+        }
+        variables_read bounds = reads((*condition)->r);
+        if (for_loop.initial.expression) {
+            variables_read initial = reads(*for_loop.initial.expression);
+            bounds.whole.merge(initial.whole);
+            bounds.lengths.merge(initial.lengths);
+        }
+        for (auto identifier: bounds.whole) {
+            if (body.stored.count(identifier) || body.stored_elements.count(identifier)) {
+                fail(directive, label, "its body changes", name(ast::identifier{identifier}), "which its bounds use");
+            }
+        }
+        for (auto identifier: bounds.lengths) {
+            if (body.stored.count(identifier)) {
+                fail(directive, label, "its body changes", name(ast::identifier{identifier}), "which its bounds use");
+            }
+        }
+        return {variable, **condition, *amount, std::get<ast::literal_integer>(amount->literal).data, body.defines_function};
+    }
+
+    ast::expression variable(ast::identifier identifier, yy::location& loc) {
+        ast::accessor accessor {};
+        accessor.identifier = identifier;
+        accessor.loc = loc;
+        return {program.arena->make<ast::accessor>(std::move(accessor)), {}, loc};
+    }
+    //the step's literal with another value, so it has the loop variable's type
+    ast::expression constant(ast::literal& step, uint64_t value, yy::location& loc) {
+        ast::literal literal = step;
+        literal.literal = ast::literal_integer{value};
+        literal.loc = loc;
+        return {program.arena->make<ast::literal>(std::move(literal)), {}, loc};
+    }
+    ast::expression binary(ast::binary_operator::op op, ast::expression l, ast::expression r, yy::location& loc) {
+        return {program.arena->make<ast::binary_operator>(std::move(l), std::move(r), op, ast::named_type{}, loc), {}, loc};
+    }
+    //the largest value of the loop variable's type, which is the step's
+    static uint64_t largest(loop_header& header) {
+        ast::primitive_type type = header.step.explicit_type ?
+            std::get<ast::primitive_type>(header.step.explicit_type->type) : ast::primitive_type{ast::primitive_type::i32};
+        size_t bits = type.is_signed_integer() ? type.bits() - 1 : type.bits();
+        return bits == 64 ? UINT64_MAX : (uint64_t(1) << bits) - 1;
+    }
+    ast::block block_of(ast::expression expression) {
+        ast::block block {};
+        block.statements.push_back({std::move(expression)});
+        return block;
+    }
+
+    //`split x f xo xi` makes x an outer loop xo going through every f-th
+    //iteration, and an inner loop xi going through the f iterations from
+    //there, or up to x's bound
+    void split(ast::directive& directive, ast::expression& expression, uint64_t factor,
+        ast::identifier outer_label, ast::identifier inner_label) {
+        ast::for_loop& inner = loop(expression);
+        std::string label = name(*inner.label);
+        loop_header header = check_header(directive, inner);
+        if (factor == 0) {
+            fail(directive, label, "into blocks of 0 iterations");
+        }
+        if (outer_label == inner_label) {
+            fail(directive, label, "into two loops with the same label");
+        }
+        unused(directive, inner, outer_label);
+        unused(directive, inner, inner_label);
+
+        uint64_t most = largest(header);
+        if (factor > most / header.amount) {
+            fail(directive, label, "into blocks of more iterations than its type has values");
+        }
+        yy::location& loc = directive.loc;
+        clone_fn clone {*program.arena};
+        ast::identifier start = derived(outer_label, name(header.variable));
+        ast::identifier end = derived(inner_label, "end");
+        ast::for_loop outer {};
+        outer.label = outer_label;
+        outer.initial = {inner.initial.explicit_type, start, std::move(inner.initial.expression), loc};
+        outer.condition = binary(header.condition.binary_operator, variable(start, loc), clone(header.condition.r), loc);
+        ast::accessor step {};
+        step.identifier = start;
+        step.loc = loc;
+        outer.step = {std::move(step), binary(ast::binary_operator::A_ADD, variable(start, loc),
+            constant(header.step, factor * header.amount, loc), loc), loc};
+        //a block starting within a block of the type's largest value is the
+        //last, as the next would start past it, so the outer loop stops
+        //there rather than wrapping around to below the bound
+        outer.stop = binary(ast::binary_operator::C_GT, variable(start, loc),
+            constant(header.step, most - factor * header.amount, loc), loc);
+        outer.loc = inner.loc;
+        //the inner loop stops at the end of its block, or at the bound if
+        //that comes first. a block ending past the type's largest value ends
+        //past the bound too, and is caught before the end is added up, so
+        //that it can't wrap around to below the bound
+        uint64_t last = (header.condition.binary_operator == ast::binary_operator::C_LT ? factor : factor - 1) * header.amount;
+        ast::if_statement before_bound {};
+        before_bound.conditions.push_back(binary(ast::binary_operator::C_LT,
+            binary(ast::binary_operator::A_ADD, variable(start, loc), constant(header.step, last, loc), loc),
+            clone(header.condition.r), loc));
+        before_bound.blocks.push_back(block_of(binary(ast::binary_operator::A_ADD, variable(start, loc),
+            constant(header.step, last, loc), loc)));
+        before_bound.blocks.push_back(block_of(clone(header.condition.r)));
+        before_bound.loc = loc;
+        ast::if_statement nearest {};
+        nearest.conditions.push_back(binary(ast::binary_operator::C_LE,
+            variable(start, loc), constant(header.step, most - last, loc), loc));
+        nearest.blocks.push_back(block_of({program.arena->make<ast::if_statement>(std::move(before_bound)), {}, loc}));
+        nearest.blocks.push_back(block_of(std::move(header.condition.r)));
+        nearest.loc = loc;
+        outer.block.statements.push_back({program.arena->make<ast::variable_def>(std::nullopt, end,
+            ast::expression{program.arena->make<ast::if_statement>(std::move(nearest)), {}, loc}, loc)});
+
+        inner.label = inner_label;
+        inner.initial.expression = variable(start, loc);
+        header.condition.r = variable(end, loc);
+        outer.block.statements.push_back({std::move(expression)});
+        expression = {program.arena->make<ast::for_loop>(std::move(outer)), {}, loc};
+
+        most_iterations.erase(outer_label.value);
+        most_iterations[inner_label.value] = factor;
+    }
+
+    //swaps the headers of a loop and the one loop that makes up its body
+    void interchange(ast::directive& directive, ast::for_loop& parent, ast::for_loop& child) {
+        auto& statements = parent.block.statements;
+        auto* only = statements.size() == 1 ? std::get_if<ast::expression>(&statements.front().statement) : nullptr;
+        auto* nested = only ? std::get_if<ast::ptr<ast::for_loop>>(&only->expression) : nullptr;
+        if (!nested || &**nested != &child) {
+            fail(directive, name(*child.label), "the body of", name(*parent.label), "has more than that loop in it");
+        }
+        loop_header outer = check_header(directive, parent);
+        loop_header inner = check_header(directive, child);
+        auto uses = [this](ast::for_loop& for_loop, ast::identifier identifier) {
+            return (for_loop.initial.expression && reads(*for_loop.initial.expression).count(identifier)) ||
+                reads(std::get<ast::ptr<ast::binary_operator>>(for_loop.condition.expression)->r).count(identifier);
+        };
+        if (uses(child, outer.variable)) {
+            fail(directive, name(*child.label), "its bounds use the variable of loop", name(*parent.label));
+        }
+        if (uses(parent, inner.variable)) {
+            fail(directive, name(*parent.label), "its bounds use the variable of loop", name(*child.label));
+        }
+        //the outer loop's iterations have to be independent of each other,
+        //as a cpu for loop's are, whatever the inner loop does in them. the
+        //inner loop's being independent isn't enough, as a later outer
+        //iteration could use at an earlier inner iteration what an earlier
+        //one stored at a later inner iteration, and swapping would reverse them
+        if (!independent_iterations(program.symbols_registry, parent)) {
+            fail(directive, name(*parent.label), "it carries a dependence from one iteration to the next");
+        }
+        std::swap(parent.label, child.label);
+        std::swap(parent.initial, child.initial);
+        std::swap(parent.condition, child.condition);
+        std::swap(parent.step, child.step);
+        std::swap(parent.stop, child.stop);
+        std::swap(parent.loc, child.loc);
+    }
+
+    //`reorder a b c` nests the loops a, b and c, outermost first, which
+    //have to be nested in each other already with nothing else between them
+    void reorder(ast::directive& directive) {
+        size_t n = directive.loops.size();
+        std::string all;
+        for (auto label: directive.loops) {
+            all += (all.empty() ? "" : " ") + name(label);
+        }
+        std::vector<ast::expression*> loops;
+        for (auto label: directive.loops) {
+            loops.push_back(&find(directive, label));
+        }
+        //each loop's depth is how many of the others it's inside
+        std::vector<ast::expression*> nest(n, nullptr);
+        for (size_t i = 0; i < n; i++) {
+            size_t depth = 0;
+            for (size_t j = 0; j < n; j++) {
+                bool inside = false;
+                walk(loop(*loops[j]).block, [&](ast::expression& expression) {
+                    inside = inside || &expression == loops[i];
+                });
+                depth += inside;
+            }
+            if (nest[depth]) {
+                fail(directive, all, "they aren't nested in each other");
+            }
+            nest[depth] = loops[i];
+        }
+        auto rank = [&](ast::expression* expression) {
+            for (size_t i = 0; i < n; i++) {
+                if (directive.loops[i] == *loop(*expression).label) {
+                    return i;
+                }
+            }
+            return n;
+        };
+        //moves headers between the loops' nodes one adjacent swap at a time,
+        //so each swap is checked on its own
+        for (size_t pass = 0; pass < n; pass++) {
+            for (size_t i = 0; i + 1 < n; i++) {
+                if (rank(nest[i]) > rank(nest[i + 1])) {
+                    interchange(directive, loop(*nest[i]), loop(*nest[i + 1]));
+                }
+            }
+        }
+    }
+
+    //replaces a loop that runs at most count iterations with count copies of
+    //its body, each after the first only run if the loop would have got to it
+    void unroll_fully(ast::directive& directive, ast::expression& expression, uint64_t count) {
+        ast::for_loop& for_loop = loop(expression);
+        ast::identifier label = *for_loop.label;
+        loop_header header = check_header(directive, for_loop);
+        if (header.defines_function) {
+            fail(directive, name(label), "its body defines a function");
+        }
+        yy::location& loc = directive.loc;
+        clone_fn clone {*program.arena};
+        ast::identifier first = derived(label, "first");
+        ast::block unrolled {};
+        unrolled.statements.push_back({program.arena->make<ast::variable_def>(for_loop.initial.explicit_type, first,
+            std::move(for_loop.initial.expression), loc)});
+        //the loop variable's value in iteration i
+        auto iteration = [&](uint64_t i) {
+            return i == 0 ? variable(first, loc) :
+                binary(ast::binary_operator::A_ADD, variable(first, loc), constant(header.step, i * header.amount, loc), loc);
+        };
+        auto copy = [&](uint64_t i) {
+            ast::block body {};
+            body.statements.push_back({program.arena->make<ast::variable_def>(for_loop.initial.explicit_type,
+                header.variable, iteration(i), loc)});
+            body.statements.push_back({ast::expression{program.arena->make<ast::block>(
+                i == 0 ? std::move(for_loop.block) : clone(for_loop.block)), {}, loc}});
+            return ast::statement{ast::expression{program.arena->make<ast::block>(std::move(body)), {}, loc}};
+        };
+        //an empty block, so the ifs have no value
+        auto nothing = [&]() {
+            return ast::statement{ast::expression{program.arena->make<ast::block>(), {}, loc}};
+        };
+        std::optional<ast::statement> rest;
+        for (uint64_t i = count; i-- > 1;) {
+            ast::block taken {};
+            taken.statements.push_back(copy(i));
+            taken.statements.push_back(rest ? std::move(*rest) : nothing());
+            ast::if_statement guard {};
+            ast::expression reached = binary(header.condition.binary_operator, iteration(i), clone(header.condition.r), loc);
+            if (for_loop.stop) {
+                //a loop split made stops before its variable would go past the
+                //type's largest value, so no iteration before this one can have
+                reached = binary(ast::binary_operator::L_AND, binary(ast::binary_operator::C_LE, variable(first, loc),
+                    constant(header.step, largest(header) - i * header.amount, loc), loc), std::move(reached), loc);
+            }
+            guard.conditions.push_back(std::move(reached));
+            guard.blocks.push_back(std::move(taken));
+            guard.loc = loc;
+            rest = ast::statement{ast::expression{program.arena->make<ast::if_statement>(std::move(guard)), {}, loc}};
+        }
+        //the loop's first iteration always runs, it checks its condition after
+        unrolled.statements.push_back(copy(0));
+        unrolled.statements.push_back(rest ? std::move(*rest) : nothing());
+        expression = {program.arena->make<ast::block>(std::move(unrolled)), {}, loc};
+        most_iterations.erase(label.value);
+    }
+
+    void operator()(ast::directive& directive) {
+        auto& loops = directive.loops;
+        auto& factors = directive.factors;
+        switch (directive.kind) {
+            case ast::directive::split: {
+                split(directive, find(directive, loops[0]), factors[0], loops[1], loops[2]);
+                break;
+            }
+            case ast::directive::tile: {
+                //split both loops, then move the outer loop of the inner one out
+                split(directive, find(directive, loops[0]), factors[0], loops[2], loops[4]);
+                split(directive, find(directive, loops[1]), factors[1], loops[3], loops[5]);
+                ast::directive order = directive;
+                order.loops = {loops[2], loops[3], loops[4], loops[5]};
+                reorder(order);
+                break;
+            }
+            case ast::directive::reorder: {
+                reorder(directive);
+                break;
+            }
+            case ast::directive::vectorize: {
+                ast::for_loop& for_loop = loop(find(directive, loops[0]));
+                if (for_loop.simd || for_loop.cpu) {
+                    fail(directive, name(loops[0]), "it's already a", for_loop.simd ? "simd" : "cpu", "for loop");
+                }
+                for_loop.simd = ast::simd{};
+                if (!factors.empty()) {
+                    for_loop.simd->lanes = factors[0];
+                }
+                for_loop.loc = directive.loc;
+                break;
+            }
+            case ast::directive::parallel: {
+                ast::for_loop& for_loop = loop(find(directive, loops[0]));
+                if (for_loop.simd || for_loop.cpu) {
+                    fail(directive, name(loops[0]), "it's already a", for_loop.simd ? "simd" : "cpu", "for loop");
+                }
+                for_loop.cpu = ast::cpu{};
+                if (!factors.empty()) {
+                    for_loop.cpu->grain = factors[0];
+                }
+                for_loop.loc = directive.loc;
+                break;
+            }
+            case ast::directive::unroll: {
+                if (factors.empty()) {
+                    auto most = most_iterations.find(loops[0].value);
+                    if (most == most_iterations.end()) {
+                        fail(directive, name(loops[0]), "it needs a count, only loops split makes have one already");
+                    }
+                    unroll_fully(directive, find(directive, loops[0]), most->second);
+                    break;
+                }
+                if (factors[0] == 0) {
+                    fail(directive, name(loops[0]), "0 times");
+                }
+                //split off blocks of count iterations, then unroll each block
+                ast::identifier copies = derived(loops[0], "unrolled");
+                split(directive, find(directive, loops[0]), factors[0], loops[0], copies);
+                unroll_fully(directive, find(directive, copies), factors[0]);
+                break;
+            }
+        }
+    }
+};
+
+void schedule(ast::program &program) {
+    time_scope scope("schedule");
+    for (auto& statement: program.statements) {
+        auto* s = std::get_if<ast::ptr<ast::schedule>>(&statement.statement);
+        if (!s) {
+            continue;
+        }
+        ast::function_def* function = nullptr;
+        for (auto& other: program.statements) {
+            auto* function_def = std::get_if<ast::ptr<ast::function_def>>(&other.statement);
+            if (function_def && (*function_def)->identifier == (*s)->function) {
+                function = &**function_def;
+            }
+        }
+        if (!function) {
+            error((*s)->loc, "schedule for undefined function", program.symbols_registry.get((*s)->function));
+        }
+        schedule_fn apply {program, *function, {}};
+        for (auto& directive: (*s)->directives) {
+            apply(directive);
+        }
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "ast.hh"
+
+//rewrites the labelled for loops of each function a schedule names, as its
+//directives say, so they run their iterations in another order without
+//computing anything else. runs before typecheck, which then checks the
+//loops vectorize and parallel make as it does simd and cpu for loops.
+//directives that could change what the function computes are reported at
+//the directive
+void schedule(ast::program &program);
@@ -1,7 +1,62 @@
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
 #include "scopes.hh"
 #include "ast.hh"
+#include "bench.hh"
+
+//the old linear scan implementation, kept as the reference for the
+//randomised comparison and as the baseline for the scaling benchmark
+template<typename ID, typename T>
+class linear_scopes {
+private:
+    std::vector<std::pair<ID, T>> data;
+    std::vector<size_t> sizes;
+public:
+    linear_scopes() {
+        push_scope();
+    }
+    void push_item(ID id, T&& t) {
+        sizes.back()++;
+        data.push_back(std::make_pair(id, std::move(t)));
+    }
+    std::optional<std::reference_wrapper<T>> find_item_current_scope(ID id) {
+        auto l = std::find_if(data.rbegin(), data.rbegin() + sizes.back(),
+            [id](std::pair<ID, T> &x) -> bool {
+                return x.first == id;
+            }
+        );
+        if (l != data.rbegin() + sizes.back()) {
+            return {l->second};
+        } else {
+            return std::nullopt;
+        }
+    }
+    std::optional<std::reference_wrapper<T>> find_item(ID id) {
+        auto l = std::find_if(data.rbegin(), data.rend(),
+            [id](std::pair<ID, T> &x) -> bool {
+                return x.first == id;
+            }
+        );
+        if (l != data.rend()) {
+            return {l->second};
+        } else {
+            return std::nullopt;
+        }
+    }
+    void push_scope() {
+        sizes.push_back({0});
+    }
+    void pop_scope() {
+        size_t size = sizes.back();
+        data.resize(data.size() - size);
+        sizes.pop_back();
+    }
+};
 
-int main() {
+static void test_shadowing() {
     scopes<ast::identifier, ast::primitive_type> vars;
     vars.push_item({0}, {ast::primitive_type::t_void});
     vars.push_item({1}, {ast::primitive_type::t_bool});
@@ -9,18 +64,100 @@ int main() {
     vars.push_scope();
     vars.push_item({0}, {ast::primitive_type::u16});
     vars.push_item({1}, {ast::primitive_type::u32});
-    //FIXME
-    //assert(*vars.find_item({0}) == ast::primitive_type{ast::primitive_type::u16});
-    //assert(*vars.find_item({1}) == ast::primitive_type{ast::primitive_type::u32});
+    assert(vars.find_item({0})->get() == ast::primitive_type{ast::primitive_type::u16});
+    assert(vars.find_item({1})->get() == ast::primitive_type{ast::primitive_type::u32});
+    assert(vars.find_item({2})->get() == ast::primitive_type{ast::primitive_type::u8});
+    assert(vars.find_item_current_scope({0}) != std::nullopt);
     assert(vars.find_item_current_scope({2}) == std::nullopt);
+    assert(vars.find_item({3}) == std::nullopt);
     vars.pop_scope();
-    //assert(*vars.find_item({0}) == ast::primitive_type{ast::primitive_type::t_void});
-    //assert(*vars.find_item({1}) == ast::primitive_type{ast::primitive_type::t_bool});
-    //assert(*vars.find_item({2}) == ast::primitive_type{ast::primitive_type::u8});
+    assert(vars.find_item({0})->get() == ast::primitive_type{ast::primitive_type::t_void});
+    assert(vars.find_item({1})->get() == ast::primitive_type{ast::primitive_type::t_bool});
+    assert(vars.find_item({2})->get() == ast::primitive_type{ast::primitive_type::u8});
+    assert(vars.find_item_current_scope({2}) != std::nullopt);
     vars.pop_scope();
 
     scopes<ast::primitive_type, ast::type> types;
     types.push_item(ast::primitive_type{ast::primitive_type::t_void}, ast::type{ast::primitive_type{ast::primitive_type::t_void}});
-    types.find_item(ast::primitive_type{ast::primitive_type::t_void});
+    assert(types.find_item(ast::primitive_type{ast::primitive_type::t_void}) != std::nullopt);
+    assert(types.find_item(ast::primitive_type{ast::primitive_type::u8}) == std::nullopt);
+}
+
+static void test_against_linear() {
+    //random pushes, pops and lookups must agree with the linear implementation
+    std::mt19937 rng{42};
+    scopes<ast::identifier, size_t> hashed;
+    linear_scopes<ast::identifier, size_t> linear;
+    size_t depth = 1;
+    for (size_t step = 0; step < 200000; step++) {
+        ast::identifier id{rng() % 64};
+        switch (rng() % 8) {
+            case 0:
+                hashed.push_scope();
+                linear.push_scope();
+                depth++;
+                break;
+            case 1:
+                if (depth > 1) {
+                    hashed.pop_scope();
+                    linear.pop_scope();
+                    depth--;
+                }
+                break;
+            case 2: case 3: {
+                hashed.push_item(id, size_t{step});
+                linear.push_item(id, size_t{step});
+                break;
+            }
+            case 4: {
+                auto h = hashed.find_item_current_scope(id);
+                auto l = linear.find_item_current_scope(id);
+                assert(h.has_value() == l.has_value());
+                assert(!h || h->get() == l->get());
+                break;
+            }
+            default: {
+                auto h = hashed.find_item(id);
+                auto l = linear.find_item(id);
+                assert(h.has_value() == l.has_value());
+                assert(!h || h->get() == l->get());
+                break;
+            }
+        }
+    }
+}
+
+static volatile size_t sink;
+
+template<typename S>
+static double lookup_ns(size_t variables) {
+    //one long function: every variable is defined then used once,
+    //the shape of generated straight line code
+    S s;
+    s.push_scope();
+    size_t check = 0;
+    bench_timer timer;
+    for (size_t i = 0; i < variables; i++) {
+        s.push_item(ast::identifier{i}, size_t{i});
+        check += s.find_item_current_scope(ast::identifier{i / 2}) ? 0 : 1;
+        check += s.find_item(ast::identifier{i / 2})->get();
+    }
+    double ns = timer.seconds() / variables * 1e9;
+    s.pop_scope();
+    sink = check;
+    return ns;
+}
+
+int main(int argc, char *argv[]) {
+    test_shadowing();
+    test_against_linear();
+
+    size_t max_variables = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 16384;
+    printf("%10s %14s %14s\n", "variables", "linear ns/use", "hashed ns/use");
+    for (size_t n = 1024; n <= max_variables; n *= 4) {
+        printf("%10zu %14.1f %14.1f\n", n,
+            lookup_ns<linear_scopes<ast::identifier, size_t>>(n),
+            lookup_ns<scopes<ast::identifier, size_t>>(n));
+    }
     return 0;
 }
@@ -5,12 +5,23 @@
 #include <algorithm>
 #include <optional>
 #include <vector>
+#include <unordered_map>
 #include <functional>
 
 template<typename ID, typename T>
 class scopes {
 private:
-    std::vector<std::pair<ID, T>> data;
+    struct binding {
+        ID id;
+        T value;
+        //index + 1 of the binding this one shadows, 0 if none
+        size_t shadowed;
+        size_t scope;
+    };
+    //every live binding in push order, which doubles as the undo log for pop_scope
+    std::vector<binding> data;
+    //index + 1 of the innermost binding of each id
+    std::unordered_map<decltype(ID::value), size_t> heads;
     std::vector<size_t> sizes;
 public:
     scopes() {
@@ -18,38 +29,48 @@ public:
     }
     void push_item(ID id, T&& t) {
         sizes.back()++;
-        data.push_back(std::make_pair(id, std::move(t)));
+        size_t& head = heads[id.value];
+        data.push_back({id, std::move(t), head, sizes.size()});
+        head = data.size();
     }
     std::optional<std::reference_wrapper<T>> find_item_current_scope(ID id) {
-        auto l = std::find_if(data.rbegin(), data.rbegin() + sizes.back(),
-            [id](std::pair<ID, T> &x) -> bool {
-                return x.first == id;
-            }
-        );
-        if (l != data.rbegin() + sizes.back()) {
-            return {l->second};
+        auto l = heads.find(id.value);
+        if (l != heads.end() && data[l->second - 1].scope == sizes.size()) {
+            return {data[l->second - 1].value};
         } else {
             return std::nullopt;
         }
     }
     std::optional<std::reference_wrapper<T>> find_item(ID id) {
-        auto l = std::find_if(data.rbegin(), data.rend(),
-            [id](std::pair<ID, T> &x) -> bool {
-                return x.first == id;
-            }
-        );
-        if (l != data.rend()) {
-            return {l->second};
+        auto l = heads.find(id.value);
+        if (l != heads.end()) {
+            return {data[l->second - 1].value};
         } else {
             return std::nullopt;
         }
     }
+    //calls f(id, value) for the innermost binding of each id, in the order they were pushed
+    template<typename F>
+    void for_each_item(F&& f) {
+        for (size_t i = 0; i < data.size(); i++) {
+            if (heads.find(data[i].id.value)->second == i + 1) {
+                f(data[i].id, data[i].value);
+            }
+        }
+    }
     void push_scope() {
         sizes.push_back({0});
     }
     void pop_scope() {
-        size_t size = sizes.back();
-        data.resize(data.size() - size);
+        for (size_t size = sizes.back(); size > 0; size--) {
+            binding& b = data.back();
+            if (b.shadowed) {
+                heads[b.id.value] = b.shadowed;
+            } else {
+                heads.erase(b.id.value);
+            }
+            data.pop_back();
+        }
         sizes.pop_back();
     }
 };
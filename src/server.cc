@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "server.hh"
+#include "error.hh"
+
+namespace {
+
+class work_queue {
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::function<void()>> jobs;
+    bool closed = false;
+public:
+    void push(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        ready.notify_one();
+    }
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        ready.notify_all();
+    }
+    //runs jobs until the queue is closed and empty
+    void work() {
+        while (true) {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this]() { return closed || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+            auto job = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+            job();
+        }
+    }
+};
+
+//where the answers to one client's requests go. the socket is closed once
+//the client has hung up and every request it sent has been answered
+struct connection {
+    int fd;
+    bool owned;
+    std::mutex write_mutex;
+    connection(int fd, bool owned): fd(fd), owned(owned) {}
+    ~connection() {
+        if (owned) {
+            close(fd);
+        }
+    }
+    void answer(const std::string& line) {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        for (size_t written = 0; written < line.size();) {
+            ssize_t n = write(fd, line.data() + written, line.size() - written);
+            if (n <= 0) {
+                return;
+            }
+            written += n;
+        }
+    }
+};
+
+using handler = std::function<void(const std::vector<std::string>&)>;
+
+static void run_request(const std::string& line, connection& client, const handler& handle) {
+    std::istringstream fields(line);
+    std::string id;
+    fields >> id;
+    std::vector<std::string> args;
+    for (std::string arg; fields >> arg;) {
+        args.push_back(arg);
+    }
+    std::string answer = id + " ok\n";
+    try {
+        handle(args);
+    } catch (const std::exception& e) {
+        std::string message = e.what();
+        std::replace(message.begin(), message.end(), '\n', ' ');
+        answer = id + " error " + message + "\n";
+    }
+    client.answer(answer);
+}
+
+//queues every line read from in until it ends
+static void read_requests(int in, std::shared_ptr<connection> client, work_queue& queue, const handler& handle) {
+    std::string buffer;
+    char chunk[4096];
+    for (ssize_t n; (n = read(in, chunk, sizeof(chunk))) > 0;) {
+        buffer.append(chunk, n);
+        size_t start = 0;
+        for (size_t end; (end = buffer.find('\n', start)) != std::string::npos; start = end + 1) {
+            std::string line = buffer.substr(start, end - start);
+            if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                continue;
+            }
+            queue.push([line, client, &handle]() {
+                run_request(line, *client, handle);
+            });
+        }
+        buffer.erase(0, start);
+    }
+}
+
+}
+
+void serve(const std::string& socket_path, size_t workers, handler handle) {
+    //a client going away before its answers are written isn't an error for the server
+    std::signal(SIGPIPE, SIG_IGN);
+    work_queue queue;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < workers; i++) {
+        threads.emplace_back([&queue]() { queue.work(); });
+    }
+
+    if (socket_path.empty()) {
+        read_requests(STDIN_FILENO, std::make_shared<connection>(STDOUT_FILENO, false), queue, handle);
+        queue.close();
+        for (auto& thread: threads) {
+            thread.join();
+        }
+        return;
+    }
+
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        error("error: socket path too long", socket_path);
+    }
+    std::strcpy(address.sun_path, socket_path.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path.c_str());
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 64) != 0) {
+        error("error: couldn't listen on", socket_path, std::strerror(errno));
+    }
+    //runs until killed, each client's requests are read on a thread of its own
+    while (true) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            continue;
+        }
+        std::thread(read_requests, client, std::make_shared<connection>(client, true), std::ref(queue), std::cref(handle)).detach();
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+//serves requests from clients of a unix socket at socket_path, or from
+//stdin when it's empty until stdin ends. each request is a line holding an
+//id then whitespace separated arguments, run by handle on one of workers
+//threads, and is answered with a line holding the id then ok, or error and
+//the message of what handle threw. answers come back in the order requests finish
+void serve(const std::string& socket_path, size_t workers, std::function<void(const std::vector<std::string>&)> handle);
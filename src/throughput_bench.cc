@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+#include "bench.hh"
+#include "lexer.hh"
+#include "parser.hh"
+#include "typecheck.hh"
+#include "codegen_llvm.hh"
+#include "timing.hh"
+
+struct generator {
+    const char* name;
+    std::string (*generate)(size_t);
+    size_t size;
+};
+
+static const generator generators[] = {
+    {"functions", generate_functions, 2000},
+    {"nesting", generate_nested_blocks, 500},
+    {"expression", generate_long_expression, 2500},
+    {"switch", generate_switch, 5000},
+    {"identifiers", generate_identifiers, 20000},
+};
+
+struct phase_result {
+    const char* name;
+    double seconds;
+    double peak_mb;
+};
+
+static phase_result measure(const char* name, const std::function<void()>& phase) {
+    reset_peak_rss();
+    bench_timer t;
+    phase();
+    return {name, t.seconds(), peak_rss_mb()};
+}
+
+static void run(const generator& g, size_t size) {
+    std::string filename = write_temp_source("throughput_bench", g.generate(size));
+    std::vector<phase_result> phases;
+
+    size_t tokens = 0;
+    phases.push_back(measure("lex", [&]() {
+        lexer_context lexer(filename);
+        tokens = lexer.tokenize().size() - 1;
+    }));
+
+    //parse_program lexes again, the report has the parsing on its own
+    lexer_context lexer(filename);
+    parser_context parser(lexer);
+    time_report report;
+    time_report::active() = &report;
+    ast::program program_ast;
+    auto parse = measure("parse", [&]() {
+        program_ast = parser.parse_program(filename);
+    });
+    time_report::active() = nullptr;
+    parse.seconds = report.entries[report.find("parse")].seconds;
+    phases.push_back(parse);
+    size_t nodes = program_ast.arena->size();
+    size_t functions = std::get<ast::node_pool<ast::function_def>>(program_ast.arena->pools).size();
+
+    phases.push_back(measure("typecheck", [&]() {
+        typecheck_context typecheck_context{program_ast.symbols_registry};
+        typecheck(typecheck_context, program_ast);
+    }));
+
+    codegen_context_llvm codegen_context_llvm{program_ast.symbols_registry};
+    codegen_context_llvm.target_machine = create_target_machine("generic", "", optimization_level::O0);
+    phases.push_back(measure("codegen", [&]() {
+        codegen_llvm(codegen_context_llvm, program_ast, filename);
+    }));
+    std::remove(filename.c_str());
+
+    printf("%s %zu: %zu tokens, %zu ast nodes, %zu functions\n", g.name, size, tokens, nodes, functions);
+    for (auto& p: phases) {
+        printf("  %-10s %8.4f s %9.2f Mtokens/s %9.2f Mnodes/s %10.1f kfunctions/s %8.1f MB peak\n",
+            p.name, p.seconds, tokens / p.seconds / 1e6, nodes / p.seconds / 1e6,
+            functions / p.seconds / 1e3, p.peak_mb);
+    }
+}
+
+//each generator is run at its size, then twice and four times that, so a
+//phase that doesn't scale linearly shows as a falling rate
+int main(int argc, char *argv[]) {
+    for (auto& g: generators) {
+        if (argc > 1 && std::strcmp(argv[1], g.name) != 0) {
+            continue;
+        }
+        size_t size = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : g.size;
+        for (size_t scale = 1; scale <= 4; scale *= 2) {
+            run(g, size * scale);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/Support/TimeProfiler.h>
+
+//total time and count of each kind of time_scope, for --time-report
+struct time_report {
+    struct entry {
+        std::string name;
+        double seconds = 0;
+        size_t count = 0;
+        //how deeply the first scope of this kind was nested, for indenting
+        size_t depth = 0;
+    };
+    //in the order each kind was first seen
+    std::vector<entry> entries;
+    std::unordered_map<std::string, size_t> index;
+    size_t depth = 0;
+
+    //the report scopes on this thread are added to, if any. threads started
+    //for -j don't have one, so their per function scopes only show in traces
+    static time_report*& active() {
+        static thread_local time_report* report = nullptr;
+        return report;
+    }
+
+    size_t find(const char* name) {
+        auto [i, inserted] = index.emplace(name, entries.size());
+        if (inserted) {
+            entries.push_back({name, 0, 0, depth});
+        }
+        return i->second;
+    }
+    void print(FILE* out) const {
+        double total = entries.empty() ? 0 : entries.front().seconds;
+        std::fprintf(out, "%10s %7s %8s  %s\n", "seconds", "%", "count", "scope");
+        for (auto& e: entries) {
+            std::fprintf(out, "%10.4f %7.1f %8zu  %*s%s\n", e.seconds, total > 0 ? e.seconds / total * 100 : 0.0,
+                e.count, static_cast<int>(e.depth * 2), "", e.name.c_str());
+        }
+    }
+};
+
+//a span of compile time: added to the active time report, and with
+//--time-trace recorded by LLVM's TimeTraceProfiler next to its own scopes
+class time_scope {
+private:
+    time_report* report;
+    size_t entry = 0;
+    std::chrono::steady_clock::time_point start;
+    llvm::TimeTraceScope trace;
+public:
+    time_scope(const char* name, llvm::StringRef detail = ""): report(time_report::active()), trace(name, detail) {
+        if (report) {
+            entry = report->find(name);
+            report->depth++;
+            start = std::chrono::steady_clock::now();
+        }
+    }
+    ~time_scope() {
+        if (report) {
+            report->depth--;
+            auto& e = report->entries[entry];
+            e.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            e.count++;
+        }
+    }
+    time_scope(const time_scope&) = delete;
+    time_scope& operator=(const time_scope&) = delete;
+};
@@ -15,12 +15,12 @@ std::string token_type_names[] = {
     "{", "}",
     "[", "]",
     "if", "elif", "else",
-    "for", "while",
+    "for", "while", "simd", "cpu",
     "break", "continue",
     "switch", "case",
     "function", "return",
     "import", "export",
-    "var", "struct", "type",
+    "var", "struct", "type", "schedule",
     ";", ",",
     "primitive type",
     "literal bool", "literal integer", "literal float",
@@ -16,12 +16,12 @@ enum class token_type : int {
     OPEN_C_BRACKET, CLOSE_C_BRACKET,
     OPEN_S_BRACKET, CLOSE_S_BRACKET,
     IF, ELIF, ELSE,
-    FOR, WHILE,
+    FOR, WHILE, SIMD, CPU,
     BREAK, CONTINUE,
     SWITCH, CASE,
     FUNCTION, RETURN,
     IMPORT, EXPORT,
-    VAR, STRUCT, TYPE,
+    VAR, STRUCT, TYPE, SCHEDULE,
     SEMICOLON, COMMA,
     PRIMITIVE_TYPE,
     LITERAL_BOOL, LITERAL_INTEGER, LITERAL_FLOAT,
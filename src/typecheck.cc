@@ -7,42 +7,78 @@
 #include "typecheck.hh"
 #include "ast.hh"
 #include "error.hh"
+#include "parallel.hh"
+#include "timing.hh"
 
-ast::named_type accessor_access(typecheck_context& context, ast::accessor& accessor) {
-    std::optional<ast::named_type> v = context.variable_scopes.find_item(accessor.identifier);
-    if (!v.has_value()) {
-        error(accessor.loc, "variable used before being defined");
+std::optional<ast::named_type> find_variable(typecheck_context& context, ast::identifier identifier) {
+    for (typecheck_context* c = &context; c; c = c->parent) {
+        if (auto v = c->variable_scopes.find_item(identifier)) {
+            return v->get();
+        }
+    }
+    return std::nullopt;
+}
+
+std::vector<ast::named_type>* find_parameter_types(typecheck_context& context, ast::identifier identifier) {
+    for (typecheck_context* c = &context; c; c = c->parent) {
+        if (auto v = c->function_parameter_types.find(identifier)) {
+            return v;
+        }
+    }
+    return nullptr;
+}
+
+//the definition a user type names, following it through other user types
+ast::type* find_type(typecheck_context& context, ast::user_type user_type) {
+    for (typecheck_context* c = &context; c; c = c->parent) {
+        if (auto t = c->type_scopes.find_item(user_type)) {
+            ast::type* type = t->get();
+            if (std::holds_alternative<ast::user_type>(type->type_)) {
+                return find_type(context, std::get<ast::user_type>(type->type_));
+            }
+            return type;
+        }
     }
-    return *v;
+    return nullptr;
 }
 
 struct typecheck_fn {
     typecheck_context& context;
     ast::named_type operator()(ast::program& program) {
-        context.variable_scopes.push_scope();
+        //declarations first, so functions can be called before their definition
         for (auto& statement: program.statements) {
-            std::invoke(*this, statement);
+            if (std::holds_alternative<ast::ptr<ast::function_def>>(statement.statement)) {
+                declare_function(*std::get<ast::ptr<ast::function_def>>(statement.statement));
+            } else {
+                std::invoke(*this, statement);
+            }
+        }
+        for (auto& statement: program.statements) {
+            if (std::holds_alternative<ast::ptr<ast::function_def>>(statement.statement)) {
+                define_function(*std::get<ast::ptr<ast::function_def>>(statement.statement));
+            }
         }
-        context.variable_scopes.pop_scope();
         return {ast::primitive_type{ast::primitive_type::t_void}};
     }
     ast::named_type operator()(ast::statement& statement) {
         return std::visit(*this, statement.statement);
     }
-    ast::named_type operator()(std::unique_ptr<ast::block>& block) {
+    ast::named_type operator()(ast::ptr<ast::block>& block) {
         return std::invoke(*this, *block);
     }
     ast::named_type operator()(ast::block& block) {
         ast::named_type type = {ast::primitive_type{ast::primitive_type::t_void}};
         context.variable_scopes.push_scope();
+        context.type_scopes.push_scope();
         for (auto& statement: block.statements) {
             type = std::invoke(*this, statement);
         }
+        context.type_scopes.pop_scope();
         context.variable_scopes.pop_scope();
         block.type = type;
         return type;
     }
-    ast::named_type operator()(std::unique_ptr<ast::if_statement>& if_statement) {
+    ast::named_type operator()(ast::ptr<ast::if_statement>& if_statement) {
         return std::invoke(*this, *if_statement);
     }
     ast::named_type operator()(ast::if_statement& if_statement) {
@@ -51,9 +87,10 @@ struct typecheck_fn {
                 error(if_statement.loc, "if statement condition not a boolean");
             }
         }
+        //the first block is only checked once, nested ifs would be exponential otherwise
         ast::named_type type = std::invoke(*this, if_statement.blocks.front());
-        for (auto& block: if_statement.blocks) {
-            ast::named_type t = std::invoke(*this, block);
+        for (size_t i = 1; i < if_statement.blocks.size(); i++) {
+            ast::named_type t = std::invoke(*this, if_statement.blocks[i]);
             if (t != type) {
                 error(if_statement.loc, "type mismatch between if statement blocks");
             }
@@ -62,7 +99,7 @@ struct typecheck_fn {
         if_statement.type = type;
         return type;
     }
-    ast::named_type operator()(std::unique_ptr<ast::for_loop>& for_loop) {
+    ast::named_type operator()(ast::ptr<ast::for_loop>& for_loop) {
         return std::invoke(*this, *for_loop);
     }
     ast::named_type operator()(ast::for_loop& for_loop) {
@@ -73,10 +110,21 @@ struct typecheck_fn {
         }
         std::invoke(*this, for_loop.block);
         std::invoke(*this, for_loop.step);
+        if (for_loop.stop && std::invoke(*this, *for_loop.stop) != ast::named_type{ast::primitive_type{ast::primitive_type::t_bool}}) {
+            error(for_loop.loc, "for loop stop not a boolean");
+        }
+        if (for_loop.simd) {
+            check_simd(for_loop);
+        }
+        if (for_loop.cpu) {
+            check_cpu(for_loop);
+        }
         context.variable_scopes.pop_scope();
         return {ast::primitive_type{ast::primitive_type::t_void}};
     }
-    ast::named_type operator()(std::unique_ptr<ast::while_loop>& while_loop) {
+    void check_simd(ast::for_loop& for_loop);
+    void check_cpu(ast::for_loop& for_loop);
+    ast::named_type operator()(ast::ptr<ast::while_loop>& while_loop) {
         return std::invoke(*this, *while_loop);
     }
     ast::named_type operator()(ast::while_loop& while_loop) {
@@ -86,12 +134,12 @@ struct typecheck_fn {
         std::invoke(*this, while_loop.block);
         return {ast::primitive_type{ast::primitive_type::t_void}};
     }
-    ast::named_type operator()(std::unique_ptr<ast::switch_statement>& switch_statement) {
+    ast::named_type operator()(ast::ptr<ast::switch_statement>& switch_statement) {
         return std::invoke(*this, *switch_statement);
     }
     ast::named_type operator()(ast::switch_statement& switch_statement) {
         ast::named_type switch_type = std::invoke(*this, switch_statement.expression);
-        if (!switch_type.is_integer()) {
+        if (!switch_type.is_integer() || switch_type.is_vector()) {
             error(switch_statement.loc, "switch statement switch expression is not an integer");
         }
         ast::named_type type = {ast::primitive_type{ast::primitive_type::t_void}};
@@ -114,34 +162,164 @@ struct typecheck_fn {
         switch_statement.type = type;
         return type;
     }
+    ast::named_type operator()(ast::ptr<ast::function_def>& function_def) {
+        return std::invoke(*this, *function_def);
+    }
     ast::named_type operator()(ast::function_def& function_def) {
-        auto v = context.variable_scopes.find_item(function_def.identifier);
-        if (v.has_value()) {
+        declare_function(function_def);
+        define_function(function_def);
+        return {ast::primitive_type{ast::primitive_type::t_void}};
+    }
+    void declare_function(ast::function_def& function_def) {
+        if (find_variable(context, function_def.identifier).has_value()) {
             error(function_def.loc, "function already defined");
         }
-        context.variable_scopes.push_item(function_def.identifier, std::move(function_def.returntype));
+        context.variable_scopes.push_item(function_def.identifier, ast::named_type{function_def.returntype});
+        std::vector<ast::named_type> types;
+        for (auto& parameter: function_def.parameter_list) {
+            check_type(parameter.type, function_def.loc);
+            types.push_back(parameter.type);
+        }
+        context.function_parameter_types.insert(function_def.identifier, types);
+    }
+    void define_function(ast::function_def& function_def) {
+        auto name = context.symbols_registry.get(function_def.identifier);
+        time_scope scope("typecheck function", {name.data(), name.size()});
         context.current_function_returntype = function_def.returntype;
         context.variable_scopes.push_scope();
         for (auto& parameter: function_def.parameter_list) {
-            context.variable_scopes.push_item(parameter.identifier, std::move(parameter.type));
+            context.variable_scopes.push_item(parameter.identifier, ast::named_type{parameter.type});
         }
         std::invoke(*this, function_def.block);
         context.variable_scopes.pop_scope();
-        std::vector<ast::named_type> types;
-        for (auto& parameter: function_def.parameter_list) {
-            types.push_back(parameter.type);
-        }
-        context.function_parameter_types.insert(function_def.identifier, types);
-        return {ast::primitive_type{ast::primitive_type::t_void}};
+    }
+    ast::named_type operator()(ast::ptr<ast::type_def>& type_def) {
+        return std::invoke(*this, *type_def);
     }
     ast::named_type operator()(ast::type_def& type_def) {
         auto t = context.type_scopes.find_item_current_scope(type_def.user_type);
         if (t.has_value()) {
             error(type_def.loc, "type already defined in this scope");
         }
-        context.type_scopes.push_item(type_def.user_type, std::move(type_def.type));
+        if (std::holds_alternative<ast::user_type>(type_def.type.type_)) {
+            check_type({std::get<ast::user_type>(type_def.type.type_)}, type_def.loc);
+        }
+        if (std::holds_alternative<std::unique_ptr<ast::array_type>>(type_def.type.type_)) {
+            auto& array_type = std::get<std::unique_ptr<ast::array_type>>(type_def.type.type_);
+            check_type(array_type->element_type, type_def.loc);
+            if (array_type->layout.value != ast::layout::aos && !struct_type(array_type->element_type)) {
+                error(type_def.loc, "only arrays of structs can have a", array_type->layout.to_string(), "layout");
+            }
+            if (array_type->layout.value == ast::layout::aosoa && array_type->layout.block == 0) {
+                error(type_def.loc, "aosoa block size must be at least 1");
+            }
+        }
+        context.type_scopes.push_item(type_def.user_type, &type_def.type);
         return {ast::primitive_type{ast::primitive_type::t_void}};
     }
+    void check_type(ast::named_type type, yy::location& loc) {
+        if (std::holds_alternative<ast::user_type>(type.type) && !find_type(context, std::get<ast::user_type>(type.type))) {
+            error(loc, "type used before being defined");
+        }
+    }
+    ast::struct_type* struct_type(ast::named_type type) {
+        if (std::holds_alternative<ast::user_type>(type.type)) {
+            ast::type* t = find_type(context, std::get<ast::user_type>(type.type));
+            if (t && std::holds_alternative<std::unique_ptr<ast::struct_type>>(t->type_)) {
+                return std::get<std::unique_ptr<ast::struct_type>>(t->type_).get();
+            }
+        }
+        return nullptr;
+    }
+    ast::array_type* array_type(ast::named_type type) {
+        if (std::holds_alternative<ast::user_type>(type.type)) {
+            ast::type* t = find_type(context, std::get<ast::user_type>(type.type));
+            if (t && std::holds_alternative<std::unique_ptr<ast::array_type>>(t->type_)) {
+                return std::get<std::unique_ptr<ast::array_type>>(t->type_).get();
+            }
+        }
+        return nullptr;
+    }
+    //the type of the element an array or buffer index gives
+    ast::named_type element_type(ast::named_type type, yy::location& loc) {
+        if (type.is_buffer()) {
+            return {std::get<ast::buffer_type>(type.type).element_type};
+        }
+        if (type.is_vector()) {
+            ast::primitive_type p = std::get<ast::primitive_type>(type.type);
+            //masks are bit packed, their lanes aren't addressable
+            if (p.is_bool()) {
+                error(loc, "lanes of bool vectors can only be used through any and all");
+            }
+            return {p.scalar()};
+        }
+        if (ast::array_type* a = array_type(type)) {
+            return a->element_type;
+        }
+        error(loc, "indexed value is not an array or buffer");
+        assert(false);
+    }
+    ast::named_type field_type(ast::named_type type, ast::identifier field, bool assigned, yy::location& loc) {
+        if (type.is_vector()) {
+            ast::primitive_type p = std::get<ast::primitive_type>(type.type);
+            auto name = context.symbols_registry.get(field);
+            //horizontal reductions over the lanes, read like fields
+            if (((name == "sum" || name == "product" || name == "min" || name == "max") && p.is_number()) ||
+                ((name == "and" || name == "or" || name == "xor") && p.is_integer()) ||
+                ((name == "any" || name == "all") && p.is_bool())) {
+                if (assigned) {
+                    error(loc, "vector reductions cannot be assigned");
+                }
+                return {p.scalar()};
+            }
+        }
+        if (type.is_buffer() && context.symbols_registry.get(field) == "length") {
+            if (assigned) {
+                error(loc, "buffer length cannot be assigned");
+            }
+            return {ast::primitive_type{ast::primitive_type::u64}};
+        }
+        if (ast::struct_type* s = struct_type(type)) {
+            for (auto& f: s->fields) {
+                if (f.identifier == field) {
+                    return f.type;
+                }
+            }
+        }
+        error(loc, "no field", context.symbols_registry.get(field), "in", type.to_string(context.symbols_registry));
+        assert(false);
+    }
+    ast::named_type accessor_access(ast::accessor& accessor, bool assigned) {
+        std::optional<ast::named_type> v = find_variable(context, accessor.identifier);
+        if (!v.has_value()) {
+            error(accessor.loc, "variable used before being defined");
+        }
+        accessor.identifier_type = *v;
+        ast::named_type type = *v;
+        for (size_t i = 0; i < accessor.fields.size(); i++) {
+            auto& access = accessor.fields[i];
+            if (std::holds_alternative<ast::array_access>(access)) {
+                ast::named_type index = std::invoke(*this, std::get<ast::array_access>(access));
+                if (!index.is_integer() || index.is_vector()) {
+                    error(accessor.loc, "array index is not an integer");
+                }
+                //the fields of one element are stored apart, so there's no element as a whole
+                ast::array_type* a = array_type(type);
+                if (a && a->layout.value != ast::layout::aos &&
+                    (i + 1 == accessor.fields.size() || !std::holds_alternative<ast::field_access>(accessor.fields[i + 1]))) {
+                    error(accessor.loc, "elements of a", a->layout.to_string(), "array can only be used through their fields");
+                }
+                type = element_type(type, accessor.loc);
+            } else {
+                accessor.reduction = type.is_vector();
+                type = field_type(type, std::get<ast::field_access>(access), assigned, accessor.loc);
+            }
+        }
+        return type;
+    }
+    ast::named_type operator()(ast::ptr<ast::s_return>& s_return) {
+        return std::invoke(*this, *s_return);
+    }
     ast::named_type operator()(ast::s_return& s_return) {
         ast::named_type x = s_return.expression ? std::invoke(*this, *s_return.expression) : ast::named_type{ast::primitive_type{ast::primitive_type::t_void}};
         if (x != context.current_function_returntype) {
@@ -149,26 +327,47 @@ struct typecheck_fn {
         }
         return {ast::primitive_type{ast::primitive_type::t_void}};
     }
+    ast::named_type operator()(ast::ptr<ast::s_break>& s_break) {
+        return std::invoke(*this, *s_break);
+    }
     ast::named_type operator()(ast::s_break& s_break) {
         return s_break.expression ? std::invoke(*this, *s_break.expression) : ast::named_type{ast::primitive_type{ast::primitive_type::t_void}};
     }
     ast::named_type operator()(ast::s_continue& s_continue) {
         return {ast::primitive_type{ast::primitive_type::t_void}};
     }
+    //already applied to the function it names
+    ast::named_type operator()(ast::ptr<ast::schedule>&) {
+        return {ast::primitive_type{ast::primitive_type::t_void}};
+    }
+    ast::named_type operator()(ast::ptr<ast::variable_def>& variable_def) {
+        return std::invoke(*this, *variable_def);
+    }
     ast::named_type operator()(ast::variable_def& variable_def) {
         auto v = context.variable_scopes.find_item_current_scope(variable_def.identifier);
         if (v.has_value()) {
             error(variable_def.loc, "variable already defined in this scope");
         }
-        ast::named_type t = std::invoke(*this, variable_def.expression);
-        if (variable_def.explicit_type && variable_def.explicit_type != t) {
-            error(variable_def.loc, "type mismatch in variable definition");
+        if (variable_def.explicit_type) {
+            check_type(*variable_def.explicit_type, variable_def.loc);
+        }
+        ast::named_type t;
+        if (variable_def.expression) {
+            t = std::invoke(*this, *variable_def.expression);
+            if (variable_def.explicit_type && variable_def.explicit_type != t) {
+                error(variable_def.loc, "type mismatch in variable definition");
+            }
+        } else {
+            t = *variable_def.explicit_type;
         }
         context.variable_scopes.push_item(variable_def.identifier, std::move(t));
         return {ast::primitive_type{ast::primitive_type::t_void}};
     }
+    ast::named_type operator()(ast::ptr<ast::assignment>& assignment) {
+        return std::invoke(*this, *assignment);
+    }
     ast::named_type operator()(ast::assignment& assignment) {
-        ast::named_type access = accessor_access(context, assignment.accessor);
+        ast::named_type access = accessor_access(assignment.accessor, true);
         ast::named_type value = std::invoke(*this, assignment.expression);
         if (value != access) {
             error(assignment.loc, "type mismatch in assignment");
@@ -182,12 +381,15 @@ struct typecheck_fn {
         return type;
     }
     ast::named_type operator()(ast::identifier& identifier) {
-        auto v = context.variable_scopes.find_item(identifier);
+        auto v = find_variable(context, identifier);
         if (!v.has_value()) {
             error("variable used before being defined");
         }
         return *v;
     }
+    ast::named_type operator()(ast::ptr<ast::literal>& literal) {
+        return std::invoke(*this, *literal);
+    }
     ast::named_type operator()(ast::literal& literal) {
         struct literal_visitor {
             typecheck_context& context;
@@ -223,7 +425,7 @@ struct typecheck_fn {
                     return {ast::primitive_type{ast::primitive_type::t_bool}};
                 }
                 if (explicit_type.value().is_bool()) {
-                    return {ast::primitive_type{ast::primitive_type::t_bool}};
+                    return explicit_type.value();
                 } else {
                     error(loc, "bool literal cannot be converted to non bool type");
                     assert(false);
@@ -235,34 +437,41 @@ struct typecheck_fn {
         return type;
     }
     ast::named_type operator()(ast::accessor& accessor) {
-        ast::named_type type = accessor_access(context, accessor);
+        ast::named_type type = accessor_access(accessor, false);
         accessor.type = type;
         return type;
     }
-    ast::named_type operator()(std::unique_ptr<ast::accessor>& accessor) {
+    ast::named_type operator()(ast::ptr<ast::accessor>& accessor) {
         return std::invoke(*this, *accessor);;
     }
-    ast::named_type operator()(std::unique_ptr<ast::function_call>& function_call) {
+    ast::named_type operator()(ast::ptr<ast::function_call>& function_call) {
         std::vector<ast::named_type> function_parameter_type;
         for (auto& argument: function_call->arguments) {
             function_parameter_type.push_back(std::invoke(*this, argument));
         }
-        if (function_parameter_type != context.function_parameter_types.get(function_call->identifier)) {
-            error(function_call->loc, "type mismatch between function call parameters and function definition arguments");
+        auto parameter_types = find_parameter_types(context, function_call->identifier);
+        if (!parameter_types) {
+            error(function_call->loc, "call to undefined function");
         }
-        auto v = context.variable_scopes.find_item(function_call->identifier);
-        if (!v.has_value()) {
-            error(function_call->loc, "function called before being defined");
+        if (function_parameter_type != *parameter_types) {
+            error(function_call->loc, "type mismatch between function call parameters and function definition arguments");
         }
+        auto v = find_variable(context, function_call->identifier);
         ast::named_type type = *v;
         function_call->type = type;
         return type;
     }
-    ast::named_type operator()(std::unique_ptr<ast::binary_operator>& binary_operator) {
+    ast::named_type operator()(ast::ptr<ast::binary_operator>& binary_operator) {
         ast::primitive_type l = std::get<ast::primitive_type>(std::invoke(*this, binary_operator->l).type);
         ast::primitive_type r = std::get<ast::primitive_type>(std::invoke(*this, binary_operator->r).type);
         //TODO
         //user defined operators on user defined types
+        //a scalar with a vector is broadcast to each lane, vector operators work lane by lane
+        if (l.is_vector() && !r.is_vector()) {
+            r.lanes = l.lanes;
+        } else if (r.is_vector() && !l.is_vector()) {
+            l.lanes = r.lanes;
+        }
         ast::named_type type;
         switch (binary_operator->binary_operator) {
             case ast::binary_operator::A_ADD:
@@ -317,7 +526,7 @@ struct typecheck_fn {
                 if (l != r) {
                     error(binary_operator->loc, "LHS and RHS of comparison operator are not of the same type. have", l.to_string(), "and", r.to_string());
                 }
-                type = {ast::primitive_type{ast::primitive_type::t_bool}};
+                type = {ast::primitive_type{ast::primitive_type::t_bool, l.lanes}};
                 break;
             case ast::binary_operator::C_GT:
             case ast::binary_operator::C_GE:
@@ -329,13 +538,13 @@ struct typecheck_fn {
                 if (!l.is_number()) {
                     error(binary_operator->loc, "LHS and RHS of comparison operator are not numbers");
                 }
-                type = {ast::primitive_type{ast::primitive_type::t_bool}};
+                type = {ast::primitive_type{ast::primitive_type::t_bool, l.lanes}};
                 break;
         }
         binary_operator->type = type;
         return type;
     }
-    ast::named_type operator()(std::unique_ptr<ast::unary_operator>& unary_operator) {
+    ast::named_type operator()(ast::ptr<ast::unary_operator>& unary_operator) {
         ast::primitive_type r = std::get<ast::primitive_type>(std::invoke(*this, unary_operator->r).type);
         //TODO
         //user defined operators on user defined types
@@ -359,6 +568,760 @@ struct typecheck_fn {
     }
 };
 
-void typecheck(typecheck_context &context, ast::program &program) {
-    std::invoke(typecheck_fn{context}, program);
+//what an index adds to a simd or cpu for loop's variable, equal for two
+//accesses to the same element in the same iteration
+struct loop_offset {
+    //which of the accessor's fields the index is
+    size_t field;
+    bool subtracted;
+    //a literal, or a variable the body can't change
+    std::variant<uint64_t, ast::identifier> by;
+    bool operator==(const loop_offset& o) const {
+        return field == o.field && subtracted == o.subtracted && by == o.by;
+    }
+};
+
+//checks the loop variable is an integer, the condition compares it to a
+//bound the body can't change, and the step adds a constant, so the
+//iterations are known before any of them run. gives the step
+template<typename Check>
+static uint64_t check_loop_header(Check& check, ast::for_loop& for_loop, const char* keyword) {
+    ast::variable_def& initial = for_loop.initial;
+    ast::named_type type = initial.explicit_type ? *initial.explicit_type : initial.expression->type;
+    if (!type.is_integer() || type.is_vector()) {
+        error(for_loop.loc, keyword, "for loop variable is not an integer");
+    }
+    //the bound is worked out once, so only the loop variable can change the condition
+    auto* condition = std::get_if<ast::ptr<ast::binary_operator>>(&for_loop.condition.expression);
+    if (!condition || !check.induction((*condition)->l) ||
+        ((*condition)->binary_operator != ast::binary_operator::C_LT && (*condition)->binary_operator != ast::binary_operator::C_LE)) {
+        error(for_loop.loc, keyword, "for loop condition is not the loop variable < or <= a bound");
+    }
+    if (std::invoke(check, (*condition)->r)) {
+        error(for_loop.loc, keyword, "for loop bound changes with the loop variable");
+    }
+    auto* step = std::get_if<ast::ptr<ast::binary_operator>>(&for_loop.step.expression.expression);
+    ast::literal* amount = nullptr;
+    if (step && (*step)->binary_operator == ast::binary_operator::A_ADD) {
+        if (check.induction((*step)->l) && std::holds_alternative<ast::ptr<ast::literal>>((*step)->r.expression)) {
+            amount = &*std::get<ast::ptr<ast::literal>>((*step)->r.expression);
+        } else if (check.induction((*step)->r) && std::holds_alternative<ast::ptr<ast::literal>>((*step)->l.expression)) {
+            amount = &*std::get<ast::ptr<ast::literal>>((*step)->l.expression);
+        }
+    }
+    if (for_loop.step.accessor.identifier != initial.identifier || !for_loop.step.accessor.fields.empty() ||
+        !amount || std::get<ast::literal_integer>(amount->literal).data == 0) {
+        error(for_loop.loc, keyword, "for loop step is not the loop variable plus a constant");
+    }
+    return std::get<ast::literal_integer>(amount->literal).data;
+}
+
+//the offset when each iteration's index is its loop variable plus or minus
+//something that's the same in every iteration
+template<typename Check>
+static std::optional<loop_offset> consecutive_offset(Check& check, ast::expression& index, size_t field) {
+    if (check.induction(index)) {
+        return loop_offset{field, false, uint64_t{0}};
+    }
+    auto* b = std::get_if<ast::ptr<ast::binary_operator>>(&index.expression);
+    if (!b) {
+        return std::nullopt;
+    }
+    ast::expression* by = nullptr;
+    bool subtracted = (*b)->binary_operator == ast::binary_operator::A_SUB;
+    if ((*b)->binary_operator == ast::binary_operator::A_ADD && check.induction((*b)->r)) {
+        by = &(*b)->l;
+    } else if (((*b)->binary_operator == ast::binary_operator::A_ADD || subtracted) && check.induction((*b)->l)) {
+        by = &(*b)->r;
+    }
+    if (!by) {
+        return std::nullopt;
+    }
+    if (auto* literal = std::get_if<ast::ptr<ast::literal>>(&by->expression)) {
+        uint64_t value = std::get<ast::literal_integer>((*literal)->literal).data;
+        return loop_offset{field, subtracted && value != 0, value};
+    }
+    auto* accessor = std::get_if<ast::ptr<ast::accessor>>(&by->expression);
+    if (accessor && (*accessor)->fields.empty() && !std::invoke(check, *by)) {
+        return loop_offset{field, subtracted, (*accessor)->identifier};
+    }
+    return std::nullopt;
+}
+
+static bool same_expression(ast::expression& a, ast::expression& b);
+
+//whether two accessors' fields are written the same way
+static bool same_fields(std::vector<ast::access>& a, std::vector<ast::access>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].index() != b[i].index()) {
+            return false;
+        }
+        if (auto* field = std::get_if<ast::field_access>(&a[i])) {
+            if (!(*field == std::get<ast::field_access>(b[i]))) {
+                return false;
+            }
+        } else if (!same_expression(std::get<ast::array_access>(a[i]), std::get<ast::array_access>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+//whether two expressions are written the same way, so they have the same
+//value when nothing between them changes
+static bool same_expression(ast::expression& a, ast::expression& b) {
+    if (a.expression.index() != b.expression.index()) {
+        return false;
+    }
+    if (auto* identifier = std::get_if<ast::identifier>(&a.expression)) {
+        return *identifier == std::get<ast::identifier>(b.expression);
+    }
+    if (auto* accessor = std::get_if<ast::ptr<ast::accessor>>(&a.expression)) {
+        auto& other = std::get<ast::ptr<ast::accessor>>(b.expression);
+        return (*accessor)->identifier == other->identifier && same_fields((*accessor)->fields, other->fields);
+    }
+    if (auto* literal = std::get_if<ast::ptr<ast::literal>>(&a.expression)) {
+        auto& other = std::get<ast::ptr<ast::literal>>(b.expression);
+        if ((*literal)->literal.index() != other->literal.index() || (*literal)->explicit_type != other->explicit_type) {
+            return false;
+        }
+        return std::visit([&](auto& value) {
+            using T = std::decay_t<decltype(value)>;
+            if constexpr (std::is_same_v<T, ast::literal_integer>) {
+                return value.data == std::get<T>(other->literal).data;
+            } else {
+                return value == std::get<T>(other->literal);
+            }
+        }, (*literal)->literal);
+    }
+    if (auto* binary_operator = std::get_if<ast::ptr<ast::binary_operator>>(&a.expression)) {
+        auto& other = std::get<ast::ptr<ast::binary_operator>>(b.expression);
+        return (*binary_operator)->binary_operator == other->binary_operator &&
+            same_expression((*binary_operator)->l, other->l) && same_expression((*binary_operator)->r, other->r);
+    }
+    if (auto* unary_operator = std::get_if<ast::ptr<ast::unary_operator>>(&a.expression)) {
+        auto& other = std::get<ast::ptr<ast::unary_operator>>(b.expression);
+        return (*unary_operator)->unary_operator == other->unary_operator && same_expression((*unary_operator)->r, other->r);
+    }
+    return false;
+}
+
+//checks a simd for loop's body can be widened to a lane per iteration
+//without changing what it does, and reports why not at the loop. each node
+//gives whether its value can differ between lanes
+struct simd_check_fn {
+    typecheck_fn& typecheck;
+    ast::for_loop& for_loop;
+    //variables defined in the body, which have a value per lane
+    ::scopes<ast::identifier, bool> locals;
+    struct access {
+        ast::identifier identifier;
+        bool store;
+        //missing unless each lane's element is its loop variable plus the offset
+        std::optional<loop_offset> consecutive;
+    };
+    std::vector<access> accesses;
+
+    template<typename ... Ts>
+    [[noreturn]] void fail(Ts ... args) {
+        error(for_loop.loc, "simd for can't be vectorized,", args...);
+    }
+    std::string_view name(ast::identifier identifier) {
+        return typecheck.context.symbols_registry.get(identifier);
+    }
+    void check() {
+        ast::simd& simd = *for_loop.simd;
+        if (simd.lanes && (simd.lanes < 2 || simd.lanes > 64 || (simd.lanes & (simd.lanes - 1)))) {
+            error(for_loop.loc, "simd for loops have 2, 4, 8, 16, 32 or 64 lanes. got", simd.lanes);
+        }
+        simd.step = check_loop_header(*this, for_loop, "simd");
+
+        simd.widest_bits = 0;
+        std::invoke(*this, for_loop.block);
+        if (simd.widest_bits == 0) {
+            ast::variable_def& initial = for_loop.initial;
+            ast::named_type type = initial.explicit_type ? *initial.explicit_type : initial.expression->type;
+            simd.widest_bits = std::get<ast::primitive_type>(type.type).bits();
+        }
+        //a variable that's stored to has to be used a lane's element at a
+        //time, or one iteration could see what another stores
+        for (auto& store: accesses) {
+            if (!store.store) {
+                continue;
+            }
+            for (auto& a: accesses) {
+                if (a.identifier == store.identifier && !(a.consecutive && a.consecutive == store.consecutive)) {
+                    fail("loop carried dependence through", name(store.identifier));
+                }
+            }
+        }
+    }
+    bool local(ast::identifier identifier) {
+        return locals.find_item(identifier).has_value();
+    }
+    bool induction(ast::expression& expression) {
+        if (auto* identifier = std::get_if<ast::identifier>(&expression.expression)) {
+            return *identifier == for_loop.initial.identifier && !local(*identifier);
+        }
+        if (auto* accessor = std::get_if<ast::ptr<ast::accessor>>(&expression.expression)) {
+            return (*accessor)->identifier == for_loop.initial.identifier && (*accessor)->fields.empty() && !local((*accessor)->identifier);
+        }
+        return false;
+    }
+    //an element of a variable from outside the loop, recorded so accesses
+    //that could depend on each other are found
+    bool access(ast::accessor& accessor, ast::named_type type, bool store) {
+        if (local(accessor.identifier) || accessor.identifier == for_loop.initial.identifier) {
+            if (store && !local(accessor.identifier)) {
+                fail("it changes the loop variable");
+            }
+            return true;
+        }
+        if (accessor.identifier_type.is_vector()) {
+            fail("it uses the vector", name(accessor.identifier), "which isn't widened again");
+        }
+        if (accessor.fields.empty()) {
+            if (store) {
+                fail("loop carried dependence on", name(accessor.identifier));
+            }
+            return false;
+        }
+        size_t indices = 0;
+        size_t varying = 0;
+        std::optional<loop_offset> o;
+        for (size_t i = 0; i < accessor.fields.size(); i++) {
+            if (auto* index = std::get_if<ast::array_access>(&accessor.fields[i])) {
+                indices++;
+                if (std::invoke(*this, *index)) {
+                    varying++;
+                    o = consecutive_offset(*this, *index, i);
+                }
+            }
+        }
+        if (varying > 1) {
+            o.reset();
+        }
+        if (varying && (!type.is_primitive() || type.is_bool())) {
+            fail("elements of", name(accessor.identifier), "are", type.to_string(typecheck.context.symbols_registry), "which isn't widened");
+        }
+        if (store && !varying) {
+            fail("every iteration stores to the same element of", name(accessor.identifier));
+        }
+        if (store && !o) {
+            fail("iterations could store to the same element of", name(accessor.identifier));
+        }
+        if (varying) {
+            for_loop.simd->widest_bits = std::max(for_loop.simd->widest_bits, std::get<ast::primitive_type>(type.type).bits());
+        }
+        //fields like a buffer's length aren't in any element
+        if (indices) {
+            accesses.push_back({accessor.identifier, store, o});
+        }
+        return varying;
+    }
+
+    bool operator()(ast::statement& statement) {
+        return std::visit(*this, statement.statement);
+    }
+    bool operator()(ast::expression& expression) {
+        if (expression.type.is_vector()) {
+            fail("it uses", expression.type.to_string(typecheck.context.symbols_registry), "which isn't widened again");
+        }
+        return std::visit(*this, expression.expression);
+    }
+    bool operator()(ast::ptr<ast::block>& block) {
+        return std::invoke(*this, *block);
+    }
+    bool operator()(ast::block& block) {
+        bool varying = false;
+        locals.push_scope();
+        for (auto& statement: block.statements) {
+            varying |= std::invoke(*this, statement);
+        }
+        locals.pop_scope();
+        return varying;
+    }
+    bool operator()(ast::ptr<ast::if_statement>& if_statement) {
+        bool varying = false;
+        for (auto& condition: if_statement->conditions) {
+            varying |= std::invoke(*this, condition);
+        }
+        for (auto& block: if_statement->blocks) {
+            varying |= std::invoke(*this, block);
+        }
+        return varying;
+    }
+    bool operator()(ast::ptr<ast::for_loop>&) {
+        fail("it has a nested loop");
+    }
+    bool operator()(ast::ptr<ast::while_loop>&) {
+        fail("it has a nested loop");
+    }
+    bool operator()(ast::ptr<ast::switch_statement>&) {
+        fail("it has a switch statement");
+    }
+    bool operator()(ast::ptr<ast::function_def>&) {
+        fail("it defines a function");
+    }
+    bool operator()(ast::ptr<ast::type_def>&) {
+        return false;
+    }
+    bool operator()(ast::ptr<ast::s_return>&) {
+        fail("it has a return");
+    }
+    bool operator()(ast::ptr<ast::s_break>&) {
+        fail("it has a break");
+    }
+    bool operator()(ast::s_continue&) {
+        fail("it has a continue");
+    }
+    bool operator()(ast::ptr<ast::schedule>&) {
+        return false;
+    }
+    bool operator()(ast::ptr<ast::function_call>& function_call) {
+        fail("it calls", name(function_call->identifier), "which has no vector version");
+    }
+    bool operator()(ast::ptr<ast::variable_def>& variable_def) {
+        ast::named_type type = variable_def->explicit_type ? *variable_def->explicit_type : variable_def->expression->type;
+        if (!type.is_primitive() || type.is_vector()) {
+            fail("the variable", name(variable_def->identifier), "isn't a primitive type");
+        }
+        if (variable_def->expression) {
+            std::invoke(*this, *variable_def->expression);
+        }
+        if (!type.is_bool()) {
+            for_loop.simd->widest_bits = std::max(for_loop.simd->widest_bits, std::get<ast::primitive_type>(type.type).bits());
+        }
+        locals.push_item(variable_def->identifier, true);
+        return true;
+    }
+    bool operator()(ast::ptr<ast::assignment>& assignment) {
+        access(assignment->accessor, assignment->expression.type, true);
+        std::invoke(*this, assignment->expression);
+        return true;
+    }
+    bool operator()(ast::identifier& identifier) {
+        return local(identifier) || identifier == for_loop.initial.identifier;
+    }
+    bool operator()(ast::ptr<ast::literal>&) {
+        return false;
+    }
+    bool operator()(ast::ptr<ast::accessor>& accessor) {
+        return access(*accessor, accessor->type, false);
+    }
+    bool operator()(ast::ptr<ast::binary_operator>& binary_operator) {
+        bool l = std::invoke(*this, binary_operator->l);
+        bool r = std::invoke(*this, binary_operator->r);
+        return l || r;
+    }
+    bool operator()(ast::ptr<ast::unary_operator>& unary_operator) {
+        return std::invoke(*this, unary_operator->r);
+    }
+};
+
+//checks a cpu for loop's iterations can run at the same time on different
+//threads, in any order, and reports why not at the loop. each node gives
+//what's known of its value. elements stored to by an index that's different
+//in every iteration, like the loop variable plus something else, are
+//trusted to be different elements, and everything else that could be the
+//same is reported. a row's index times a width that isn't a literal is
+//trusted to keep rows apart, whatever column an inner loop adds to it
+struct cpu_check_fn {
+    interner<ast::identifier>& symbols_registry;
+    ast::for_loop& for_loop;
+    struct value {
+        //it can differ between iterations
+        bool varying = false;
+        //it can be the same in different iterations where it differs, as
+        //elements, calls and operators like / and % can give
+        bool repeating = false;
+        //it can change within an iteration, as an inner loop's variable does
+        bool changing = false;
+        //it's multiplied by a width the loop doesn't change
+        bool strided = false;
+        explicit operator bool() const {
+            return varying;
+        }
+        bool invariant() const {
+            return !varying && !changing;
+        }
+        //different iterations store to different elements through it
+        bool distinct() const {
+            return varying && !repeating;
+        }
+        bool operator==(const value& o) const {
+            return varying == o.varying && repeating == o.repeating && changing == o.changing && strided == o.strided;
+        }
+    };
+    //either of two values, which is only strided if both are
+    static value merge(value a, value b) {
+        value merged {a.varying || b.varying, a.repeating || b.repeating, a.changing || b.changing, false};
+        merged.strided = !merged.invariant() && (a.strided || a.invariant()) && (b.strided || b.invariant());
+        return merged;
+    }
+    //the values variables defined in the body can have
+    ::scopes<ast::identifier, value> locals;
+    //loops inside the body, which break and continue leave
+    size_t loops = 0;
+    struct access {
+        ast::accessor* accessor;
+        bool store;
+        bool varying;
+        std::optional<loop_offset> consecutive;
+    };
+    std::vector<access> accesses;
+
+    template<typename ... Ts>
+    [[noreturn]] void fail(Ts ... args) {
+        error(for_loop.loc, "cpu for can't run in parallel,", args...);
+    }
+    std::string_view name(ast::identifier identifier) {
+        return symbols_registry.get(identifier);
+    }
+    void check() {
+        for_loop.cpu->step = check_loop_header(*this, for_loop, "cpu");
+        check_iterations();
+    }
+    //only looks at the body's syntax, not its types
+    void check_iterations() {
+        std::invoke(*this, for_loop.block);
+        //an element one iteration stores can't be used by another, so every
+        //use of a variable the loop stores to has to be indexed the same way
+        for (auto& store: accesses) {
+            if (!store.store) {
+                continue;
+            }
+            for (auto& a: accesses) {
+                if (!(a.accessor->identifier == store.accessor->identifier)) {
+                    continue;
+                }
+                bool same = (a.consecutive && store.consecutive && *a.consecutive == *store.consecutive) ||
+                    same_fields(a.accessor->fields, store.accessor->fields);
+                if (!a.varying || !same) {
+                    fail("loop carried dependence through", name(store.accessor->identifier));
+                }
+            }
+        }
+    }
+    bool local(ast::identifier identifier) {
+        return locals.find_item(identifier).has_value();
+    }
+    bool induction(ast::expression& expression) {
+        if (auto* identifier = std::get_if<ast::identifier>(&expression.expression)) {
+            return *identifier == for_loop.initial.identifier && !local(*identifier);
+        }
+        if (auto* accessor = std::get_if<ast::ptr<ast::accessor>>(&expression.expression)) {
+            return (*accessor)->identifier == for_loop.initial.identifier && (*accessor)->fields.empty() && !local((*accessor)->identifier);
+        }
+        return false;
+    }
+    value access(ast::accessor& accessor, bool store) {
+        size_t indices = 0;
+        size_t varying = 0;
+        //whether one of the indices is different in every iteration
+        bool distinct = false;
+        value indexed;
+        std::optional<loop_offset> o;
+        for (size_t i = 0; i < accessor.fields.size(); i++) {
+            if (auto* index = std::get_if<ast::array_access>(&accessor.fields[i])) {
+                indices++;
+                value v = std::invoke(*this, *index);
+                indexed = merge(indexed, v);
+                if (v.varying) {
+                    varying++;
+                    o = consecutive_offset(*this, *index, i);
+                    distinct = distinct || v.distinct();
+                }
+            }
+        }
+        //elements can hold the same value in different iterations
+        value element {indexed.varying, indexed.varying, indexed.changing, false};
+        if (auto l = locals.find_item(accessor.identifier)) {
+            //each iteration has its own
+            return indices ? merge(l->get(), element) : l->get();
+        }
+        if (accessor.identifier == for_loop.initial.identifier) {
+            if (store) {
+                fail("it changes the loop variable");
+            }
+            return {true};
+        }
+        if (accessor.fields.empty()) {
+            if (store) {
+                fail("loop carried dependence on", name(accessor.identifier));
+            }
+            return {};
+        }
+        if (varying > 1) {
+            o.reset();
+        }
+        if (store && !varying) {
+            fail("every iteration stores to the same element of", name(accessor.identifier));
+        }
+        if (store && !distinct) {
+            fail("iterations could store to the same element of", name(accessor.identifier));
+        }
+        //fields like a buffer's length aren't in any element
+        if (indices) {
+            accesses.push_back({&accessor, store, varying > 0, o});
+        }
+        return element;
+    }
+    //goes through a loop inside the body until the values the variables
+    //it can change can have stop changing
+    template<typename Body>
+    void repeat(Body body) {
+        auto values = [this]() {
+            std::vector<value> values;
+            locals.for_each_item([&](ast::identifier, value& v) { values.push_back(v); });
+            return values;
+        };
+        std::vector<value> before;
+        do {
+            before = values();
+            body();
+        } while (values() != before);
+    }
+
+    value operator()(ast::statement& statement) {
+        return std::visit(*this, statement.statement);
+    }
+    value operator()(ast::expression& expression) {
+        return std::visit(*this, expression.expression);
+    }
+    value operator()(ast::ptr<ast::block>& block) {
+        return std::invoke(*this, *block);
+    }
+    value operator()(ast::block& block) {
+        value v;
+        locals.push_scope();
+        for (auto& statement: block.statements) {
+            v = merge(v, std::invoke(*this, statement));
+        }
+        locals.pop_scope();
+        return v;
+    }
+    //a value picked by a condition can be any of the choices in any iteration
+    value choice(value chosen, value condition) {
+        if (condition.invariant()) {
+            return chosen;
+        }
+        return {chosen.varying || condition.varying, chosen.repeating || condition.varying,
+            chosen.changing || condition.changing, false};
+    }
+    value operator()(ast::ptr<ast::if_statement>& if_statement) {
+        value condition;
+        for (auto& c: if_statement->conditions) {
+            condition = merge(condition, std::invoke(*this, c));
+        }
+        value chosen;
+        for (auto& block: if_statement->blocks) {
+            chosen = merge(chosen, std::invoke(*this, block));
+        }
+        return choice(chosen, condition);
+    }
+    value operator()(ast::ptr<ast::for_loop>& nested) {
+        locals.push_scope();
+        loops++;
+        std::invoke(*this, nested->initial);
+        repeat([&]() {
+            std::invoke(*this, nested->condition);
+            std::invoke(*this, nested->block);
+            std::invoke(*this, nested->step);
+        });
+        loops--;
+        locals.pop_scope();
+        return {};
+    }
+    value operator()(ast::ptr<ast::while_loop>& while_loop) {
+        loops++;
+        repeat([&]() {
+            std::invoke(*this, while_loop->condition);
+            std::invoke(*this, while_loop->block);
+        });
+        loops--;
+        return {};
+    }
+    value operator()(ast::ptr<ast::switch_statement>& switch_statement) {
+        value condition = std::invoke(*this, switch_statement->expression);
+        value chosen;
+        for (auto& c: switch_statement->cases) {
+            chosen = merge(chosen, std::invoke(*this, c.block));
+        }
+        return choice(chosen, condition);
+    }
+    value operator()(ast::ptr<ast::function_def>&) {
+        fail("it defines a function");
+    }
+    value operator()(ast::ptr<ast::type_def>&) {
+        return {};
+    }
+    value operator()(ast::ptr<ast::s_return>&) {
+        fail("it has a return");
+    }
+    value operator()(ast::ptr<ast::s_break>& s_break) {
+        if (!loops) {
+            fail("it has a break");
+        }
+        if (s_break->expression) {
+            std::invoke(*this, *s_break->expression);
+        }
+        return {};
+    }
+    value operator()(ast::s_continue&) {
+        if (!loops) {
+            fail("it has a continue");
+        }
+        return {};
+    }
+    value operator()(ast::ptr<ast::schedule>&) {
+        return {};
+    }
+    value operator()(ast::ptr<ast::function_call>& function_call) {
+        value arguments;
+        for (auto& argument: function_call->arguments) {
+            arguments = merge(arguments, std::invoke(*this, argument));
+        }
+        return {arguments.varying, arguments.varying, arguments.changing, false};
+    }
+    value operator()(ast::ptr<ast::variable_def>& variable_def) {
+        return std::invoke(*this, *variable_def);
+    }
+    value operator()(ast::variable_def& variable_def) {
+        value v;
+        if (variable_def.expression) {
+            v = std::invoke(*this, *variable_def.expression);
+        }
+        locals.push_item(variable_def.identifier, std::move(v));
+        return {};
+    }
+    value operator()(ast::ptr<ast::assignment>& assignment) {
+        return std::invoke(*this, *assignment);
+    }
+    value operator()(ast::assignment& assignment) {
+        value v = std::invoke(*this, assignment.expression);
+        access(assignment.accessor, true);
+        if (auto l = locals.find_item(assignment.accessor.identifier)) {
+            //it has had both values by the end of the iteration
+            l->get() = merge(l->get(), v);
+            l->get().changing = true;
+        }
+        return {};
+    }
+    value operator()(ast::identifier& identifier) {
+        if (auto l = locals.find_item(identifier)) {
+            return l->get();
+        }
+        return {identifier == for_loop.initial.identifier};
+    }
+    value operator()(ast::ptr<ast::literal>&) {
+        return {};
+    }
+    value operator()(ast::ptr<ast::accessor>& accessor) {
+        return access(*accessor, false);
+    }
+    static bool zero(ast::expression& expression) {
+        auto* literal = std::get_if<ast::ptr<ast::literal>>(&expression.expression);
+        auto* integer = literal ? std::get_if<ast::literal_integer>(&(*literal)->literal) : nullptr;
+        return integer && integer->data == 0;
+    }
+    value operator()(ast::ptr<ast::binary_operator>& binary_operator) {
+        value l = std::invoke(*this, binary_operator->l);
+        value r = std::invoke(*this, binary_operator->r);
+        value both = merge(l, r);
+        both.strided = false;
+        if (l.invariant() && r.invariant()) {
+            return both;
+        }
+        switch (binary_operator->binary_operator) {
+            case ast::binary_operator::A_ADD:
+            case ast::binary_operator::A_SUB: {
+                //adding something the same in every iteration keeps
+                //iterations apart, adding two things that differ may not,
+                //unless one is a row kept apart from the other's columns
+                value& v = l.varying ? l : r;
+                value& other = l.varying ? r : l;
+                if (l.varying && r.varying) {
+                    both.repeating = true;
+                } else if (other.invariant()) {
+                    both.strided = v.strided;
+                } else if (!v.strided && !other.strided) {
+                    both.repeating = both.varying;
+                }
+                return both;
+            }
+            case ast::binary_operator::A_MUL: {
+                if (zero(binary_operator->l) || zero(binary_operator->r)) {
+                    return {};
+                }
+                value& v = l.invariant() ? r : l;
+                value& by = l.invariant() ? l : r;
+                if (!by.invariant()) {
+                    both.repeating = both.varying;
+                    return both;
+                }
+                //a width that isn't a literal keeps rows apart
+                bool literal = std::holds_alternative<ast::ptr<ast::literal>>(
+                    (l.invariant() ? binary_operator->l : binary_operator->r).expression);
+                value product = v;
+                product.strided = v.strided || !literal;
+                return product;
+            }
+            default:
+                //these can give the same result for different operands
+                both.repeating = both.varying;
+                return both;
+        }
+    }
+    value operator()(ast::ptr<ast::unary_operator>& unary_operator) {
+        value v = std::invoke(*this, unary_operator->r);
+        if (unary_operator->unary_operator == ast::unary_operator::L_NOT) {
+            v.repeating = v.varying;
+            v.strided = false;
+        }
+        return v;
+    }
+};
+
+void typecheck_fn::check_simd(ast::for_loop& for_loop) {
+    simd_check_fn{*this, for_loop}.check();
+}
+void typecheck_fn::check_cpu(ast::for_loop& for_loop) {
+    cpu_check_fn{context.symbols_registry, for_loop}.check();
+}
+
+bool independent_iterations(interner<ast::identifier>& symbols_registry, ast::for_loop& for_loop) {
+    try {
+        cpu_check_fn{symbols_registry, for_loop}.check_iterations();
+    } catch (const compile_error&) {
+        return false;
+    }
+    return true;
+}
+
+void typecheck(typecheck_context &context, ast::program &program, size_t jobs) {
+    if (jobs <= 1) {
+        std::invoke(typecheck_fn{context}, program);
+        return;
+    }
+    //declarations go in the shared context, then each function body is
+    //checked in its own context which looks up globals in the shared one
+    std::vector<ast::function_def*> functions;
+    for (auto& statement: program.statements) {
+        if (std::holds_alternative<ast::ptr<ast::function_def>>(statement.statement)) {
+            ast::function_def& function_def = *std::get<ast::ptr<ast::function_def>>(statement.statement);
+            typecheck_fn{context}.declare_function(function_def);
+            functions.push_back(&function_def);
+        } else {
+            std::invoke(typecheck_fn{context}, statement);
+        }
+    }
+    parallel_for(functions.size(), jobs, [&](size_t i) {
+        typecheck_context function_context{context.symbols_registry};
+        function_context.parent = &context;
+        typecheck_fn{function_context}.define_function(*functions[i]);
+    });
 }
@@ -6,12 +6,21 @@
 #include "registry.hh"
 
 struct typecheck_context {
+    //the context holding the top level declarations, when checking one
+    //function body on its own
+    typecheck_context* parent = nullptr;
     ast::named_type current_function_returntype;
     ::registry<ast::identifier, std::vector<ast::named_type>> function_parameter_types;
     ::scopes<ast::identifier, ast::named_type> variable_scopes;
-    ::scopes<ast::user_type, ast::type> type_scopes;
-    bi_registry<ast::identifier, std::string>& symbols_registry;
-    typecheck_context(bi_registry<ast::identifier, std::string>& sr): symbols_registry(sr) {}
+    //the definitions stay in the ast, codegen looks them up again
+    ::scopes<ast::user_type, ast::type*> type_scopes;
+    interner<ast::identifier>& symbols_registry;
+    typecheck_context(interner<ast::identifier>& sr): symbols_registry(sr) {}
 };
 
-void typecheck(typecheck_context &context, ast::program &program);
+void typecheck(typecheck_context &context, ast::program &program, size_t jobs = 1);
+
+//whether no iteration of the loop uses an element another one stores, as
+//cpu for loops are checked. only looks at syntax, so schedules can ask
+//before typecheck
+bool independent_iterations(interner<ast::identifier>& symbols_registry, ast::for_loop& for_loop);
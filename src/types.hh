@@ -18,11 +18,17 @@ namespace ast {
             f16, f32, f64,
         };
         e value;
+        //1 for a scalar, or the lanes of a fixed width vector of value
+        uint8_t lanes = 1;
         operator e() const { return value; }
         explicit operator bool() = delete;
-        constexpr bool operator==(const primitive_type a) const { return value == a.value; }
-        constexpr bool operator!=(const primitive_type a) const { return value != a.value; }
+        constexpr bool operator==(const primitive_type a) const { return value == a.value && lanes == a.lanes; }
+        constexpr bool operator!=(const primitive_type a) const { return !(*this == a); }
         std::string to_string() {
+            std::string s = scalar_to_string();
+            return lanes > 1 ? s + "x" + std::to_string(lanes) : s;
+        }
+        std::string scalar_to_string() {
             switch (value) {
                 case t_void:    { return "void"; }
                 case t_bool:    { return "bool"; }
@@ -41,6 +47,11 @@ namespace ast {
             }
         }
         llvm::Type* to_llvm_type(llvm::LLVMContext &context) {
+            llvm::Type* scalar = scalar_to_llvm_type(context);
+            bool scalable = false;
+            return lanes > 1 ? llvm::VectorType::get(scalar, lanes, scalable) : scalar;
+        }
+        llvm::Type* scalar_to_llvm_type(llvm::LLVMContext &context) {
             switch (value) {
                 case t_void: return llvm::Type::getVoidTy(context);
                 case t_bool: return llvm::Type::getInt1Ty(context);
@@ -79,12 +90,29 @@ namespace ast {
         bool is_number() {
             return value >= u8 && value <= f64;
         }
+        bool is_vector() {
+            return lanes > 1;
+        }
+        primitive_type scalar() {
+            return {value};
+        }
+        //the size of one lane
+        size_t bits() {
+            switch (value) {
+                case t_bool: return 1;
+                case u8: case i8: return 8;
+                case u16: case i16: case f16: return 16;
+                case u32: case i32: case f32: return 32;
+                case u64: case i64: case f64: return 64;
+                default: return 0;
+            }
+        }
     };
     struct identifier {
         size_t value;
         constexpr bool operator==(const identifier a) const { return value == a.value; }
         constexpr bool operator!=(const identifier a) const { return value != a.value; }
-        std::string& to_string(bi_registry<ast::identifier, std::string>& symbols_registry) {
+        std::string_view to_string(interner<ast::identifier>& symbols_registry) {
             return symbols_registry.get(*this);
         }
     };
@@ -92,7 +120,7 @@ namespace ast {
         size_t value;
         constexpr bool operator==(const user_type& a) const { return value == a.value; }
         constexpr bool operator!=(const user_type& a) const { return value != a.value; }
-        std::string& to_string(bi_registry<ast::identifier, std::string>& symbols_registry) {
+        std::string_view to_string(interner<ast::identifier>& symbols_registry) {
             return symbols_registry.get(ast::identifier{value});
         }
         llvm::Type* to_llvm_type(llvm::LLVMContext &context) {
@@ -107,8 +135,24 @@ namespace ast {
         bool is_number() { return false; }
         bool is_primitive() { return false; }
     };
+    //elements in memory owned by someone else, a pointer and a u64 length.
+    //parameters of this type are passed as the two, like a c pointer and size
+    struct buffer_type {
+        primitive_type element_type;
+        constexpr bool operator==(const buffer_type& a) const { return element_type == a.element_type; }
+        constexpr bool operator!=(const buffer_type& a) const { return element_type != a.element_type; }
+        std::string to_string() {
+            return "[" + element_type.to_string() + "]";
+        }
+        llvm::Type* to_llvm_type(llvm::LLVMContext &context) {
+            return llvm::StructType::get(context, {
+                element_type.to_llvm_type(context)->getPointerTo(),
+                llvm::Type::getInt64Ty(context),
+            });
+        }
+    };
     struct named_type {
-        std::variant<primitive_type, user_type> type;
+        std::variant<primitive_type, user_type, buffer_type> type;
         constexpr bool operator==(const named_type& a) const { return type == a.type; }
         constexpr bool operator!=(const named_type& a) const { return type != a.type; }
         llvm::Type* to_llvm_type(llvm::LLVMContext &context) {
@@ -116,11 +160,13 @@ namespace ast {
                 return t.to_llvm_type(context);
             }, type);
         }
-        std::string to_string(bi_registry<ast::identifier, std::string>& symbols_registry) {
+        std::string to_string(interner<ast::identifier>& symbols_registry) {
             if (std::holds_alternative<ast::primitive_type>(type)) {
                 return std::get<primitive_type>(type).to_string();
+            } else if (std::holds_alternative<ast::buffer_type>(type)) {
+                return std::get<buffer_type>(type).to_string();
             } else {
-                return std::get<user_type>(type).to_string(symbols_registry);
+                return std::string{std::get<user_type>(type).to_string(symbols_registry)};
             }
         }
         bool is_void() { return is_primitive() && std::get<primitive_type>(type).is_void(); }
@@ -131,6 +177,8 @@ namespace ast {
         bool is_float() { return is_primitive() && std::get<primitive_type>(type).is_float(); }
         bool is_number() { return is_primitive() && std::get<primitive_type>(type).is_number(); }
         bool is_primitive() { return std::holds_alternative<primitive_type>(type); }
+        bool is_vector() { return is_primitive() && std::get<primitive_type>(type).is_vector(); }
+        bool is_buffer() { return std::holds_alternative<buffer_type>(type); }
     };
     struct type;
     struct field {
@@ -149,16 +197,35 @@ namespace ast {
             return llvm::StructType::get(context, llvm::ArrayRef<llvm::Type*>{llvm_fields}, packed);
         }
     };
+    //how an array of structs is stored: element by element, as one array
+    //per field, or as blocks of block elements with one array per field each
+    struct layout {
+        enum e {
+            aos, soa, aosoa,
+        } value = aos;
+        size_t block = 0;
+        constexpr bool operator==(const layout& a) const { return value == a.value && block == a.block; }
+        constexpr bool operator!=(const layout& a) const { return !(*this == a); }
+        std::string to_string() {
+            switch (value) {
+                case aos:   { return "aos"; }
+                case soa:   { return "soa"; }
+                case aosoa: { return "aosoa " + std::to_string(block); }
+                default: assert(false);
+            }
+        }
+    };
     struct array_type {
         ast::named_type element_type;
         size_t length;
+        ast::layout layout;
         llvm::Type* to_llvm_type(llvm::LLVMContext &context) {
             llvm::Type* llvm_element_type = element_type.to_llvm_type(context);
             return llvm::ArrayType::get(llvm_element_type, length);
         }
     };
     struct type {
-        std::variant<ast::primitive_type, ast::user_type, std::unique_ptr<struct_type>, std::unique_ptr<array_type>> type_;
+        std::variant<ast::primitive_type, ast::user_type, ast::buffer_type, std::unique_ptr<struct_type>, std::unique_ptr<array_type>> type_;
         constexpr type(named_type n) {
             std::visit([this](auto p) {
                 type_ = p;
@@ -179,9 +246,9 @@ namespace ast {
         bool is_float() { return is_primitive() && std::get<primitive_type>(type_).is_float(); }
         bool is_number() { return is_primitive() && std::get<primitive_type>(type_).is_number(); }
         bool is_primitive() { return std::holds_alternative<primitive_type>(type_); }
-        std::string to_string(bi_registry<ast::identifier, std::string>& symbols_registry) {
+        std::string to_string(interner<ast::identifier>& symbols_registry) {
             struct type_printer_fn {
-                bi_registry<ast::identifier, std::string>& symbols_registry;
+                interner<ast::identifier>& symbols_registry;
                 std::ostringstream s;
                 void operator()(ast::primitive_type primitive_type) {
                     s << primitive_type.to_string();
@@ -189,6 +256,9 @@ namespace ast {
                 void operator()(ast::user_type user_type) {
                     s << user_type.to_string(symbols_registry);
                 }
+                void operator()(ast::buffer_type buffer_type) {
+                    s << buffer_type.to_string();
+                }
                 void operator()(const std::unique_ptr<ast::struct_type>& struct_type) {
                     s << "struct { ";
                     for (auto field: struct_type->fields) {
@@ -205,6 +275,9 @@ namespace ast {
                     s << " ";
                     s << array_type->length;
                     s << "]";
+                    if (array_type->layout.value != ast::layout::aos) {
+                        s << " " << array_type->layout.to_string();
+                    }
                 }
             };
             type_printer_fn type_printer_fn{symbols_registry};
@@ -220,6 +293,9 @@ namespace ast {
                 llvm::Type* operator()(ast::user_type user_type) {
                     return user_type.to_llvm_type(context);
                 }
+                llvm::Type* operator()(ast::buffer_type buffer_type) {
+                    return buffer_type.to_llvm_type(context);
+                }
                 llvm::Type* operator()(const std::unique_ptr<ast::struct_type>& struct_type) {
                     return struct_type->to_llvm_type(context);
                 }
@@ -0,0 +1,21 @@
+#include <cstdint>
+#include <cstdio>
+
+extern "C" {
+    void scale(float*, uint64_t, float);
+    uint64_t sum(uint64_t*, uint64_t, uint64_t, uint64_t);
+    float horizontal_sum(float, float, float, float);
+}
+
+int main() {
+    float floats[] = {1, 2, 3, 4, 5};
+    scale(floats, 5, 2);
+    scale(nullptr, 0, 2);
+    uint64_t integers[] = {1, 2, 3, 4, 5, 6};
+    bool ok = floats[0] == 2 && floats[4] == 10
+        && sum(integers, 6, 1, 4) == 14
+        && integers[5] == 6
+        && horizontal_sum(1, 2, 3, 4) == 10;
+    printf("buffers %s\n", ok ? "match" : "don't match");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,23 @@
+#include <cstdint>
+#include <cstdio>
+
+extern "C" {
+    uint8_t wrapped();
+    int32_t signed_divide();
+    uint8_t unsigned_compare(uint32_t);
+    float rounded();
+    uint32_t identities(uint32_t);
+    uint32_t pruned(uint32_t);
+}
+
+int main() {
+    bool ok = wrapped() == 44
+        && signed_divide() == -13
+        && unsigned_compare(4000000000u) == 3
+        && rounded() == 0.1f + 0.2f
+        && identities(5) == 15
+        && pruned(0) == 2
+        && pruned(7) == 7;
+    printf("folded constants %s\n", ok ? "match" : "don't match");
+    return ok ? 0 : 1;
+}
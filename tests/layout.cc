@@ -0,0 +1,16 @@
+#include <cstdint>
+#include <cstdio>
+
+extern "C" {
+    uint32_t sum_aos(uint32_t);
+    uint32_t sum_soa(uint32_t);
+    uint32_t sum_aosoa(uint32_t);
+}
+
+int main() {
+    bool ok = sum_aos(3) == 190
+        && sum_soa(3) == 190
+        && sum_aosoa(3) == 190;
+    printf("layouts %s\n", ok ? "match" : "don't match");
+    return ok ? 0 : 1;
+}
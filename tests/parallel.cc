@@ -0,0 +1,103 @@
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+extern "C" {
+    void scale(float*, uint64_t, float);
+    void every_third(uint32_t*, uint64_t, uint32_t);
+    void around_zero(int32_t*, uint64_t);
+    void once(uint32_t*, uint64_t);
+    void table(uint64_t*, uint64_t, uint64_t, uint64_t);
+    void rows(float*, uint64_t, uint64_t, float);
+    void collatz_steps(uint32_t*, uint64_t);
+    uint32_t squares();
+    void triad(float*, uint64_t, float*, uint64_t, float*, uint64_t, float);
+    void orbit(float*, uint64_t, uint32_t);
+}
+
+//kl loops test their condition after the first iteration
+static uint32_t collatz(uint32_t n) {
+    uint32_t steps = 0;
+    do {
+        n = n % 2 == 0 ? n / 2 : 3 * n + 1;
+        steps++;
+    } while (n != 1);
+    return steps;
+}
+
+int main() {
+    bool ok = true;
+    //enough iterations to be split between threads
+    std::vector<float> data(100003);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = i;
+    }
+    scale(data.data(), data.size(), 2);
+    for (size_t i = 0; i < data.size(); i++) {
+        ok = ok && data[i] == 2.0f * i;
+    }
+
+    std::vector<uint32_t> thirds(3001, 1);
+    every_third(thirds.data(), thirds.size(), 3000);
+    for (uint32_t i = 0; i < thirds.size(); i++) {
+        ok = ok && thirds[i] == (i % 3 == 0 ? i * 2 : 1);
+    }
+
+    std::vector<int32_t> signed_values(1000);
+    around_zero(signed_values.data(), signed_values.size());
+    for (int32_t i = 0; i < 1000; i++) {
+        ok = ok && signed_values[i] == i - 500;
+    }
+
+    //the first iteration runs even though the condition doesn't hold
+    uint32_t first[2] = {0, 0};
+    once(first, 2);
+    ok = ok && first[0] == 7 && first[1] == 0;
+
+    std::vector<uint64_t> cells(37 * 101);
+    table(cells.data(), cells.size(), 37, 101);
+    for (uint64_t r = 0; r < 37; r++) {
+        for (uint64_t c = 0; c < 101; c++) {
+            ok = ok && cells[r * 101 + c] == r * 1000 + c;
+        }
+    }
+
+    std::vector<float> matrix(64 * 35, 3);
+    rows(matrix.data(), matrix.size(), 35, 0.5f);
+    for (float v: matrix) {
+        ok = ok && v == 1.5f;
+    }
+
+    std::vector<uint32_t> steps(2000);
+    collatz_steps(steps.data(), steps.size());
+    for (uint32_t i = 0; i < steps.size(); i++) {
+        ok = ok && steps[i] == collatz(i + 1);
+    }
+
+    ok = ok && squares() == 85344;
+
+    std::vector<float> a(5000), b(5000), c(5000);
+    for (size_t i = 0; i < a.size(); i++) {
+        b[i] = i;
+        c[i] = 1.0f / (i + 1);
+    }
+    triad(a.data(), a.size(), b.data(), b.size(), c.data(), c.size(), 3);
+    for (size_t i = 0; i < a.size(); i++) {
+        ok = ok && a[i] == b[i] + 3 * c[i];
+    }
+
+    std::vector<float> x(3000);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = (i + 0.5f) / x.size();
+    }
+    orbit(x.data(), x.size(), 50);
+    for (size_t i = 0; i < x.size(); i++) {
+        float v = (i + 0.5f) / x.size();
+        for (int step = 0; step < 50; step++) {
+            v = 3.7f * v * (1 - v);
+        }
+        ok = ok && x[i] == v;
+    }
+    printf("cpu for loops %s\n", ok ? "match" : "don't match");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+extern "C" {
+    void axpy(float*, uint64_t, float*, uint64_t, float);
+    void axpy_vectorized(float*, uint64_t, float*, uint64_t, float);
+    void axpy_unrolled(float*, uint64_t, float*, uint64_t, float);
+    void brighten(uint16_t*, uint64_t, uint64_t, uint16_t);
+    void brighten_scheduled(uint16_t*, uint64_t, uint64_t, uint16_t);
+    void transpose(uint64_t*, uint64_t, uint64_t*, uint64_t, uint64_t, uint64_t);
+    void transpose_tiled(uint64_t*, uint64_t, uint64_t*, uint64_t, uint64_t, uint64_t);
+    void transpose_reordered(uint64_t*, uint64_t, uint64_t*, uint64_t, uint64_t, uint64_t);
+    void matmul(float*, uint64_t, float*, uint64_t, float*, uint64_t, uint64_t);
+    void matmul_scheduled(float*, uint64_t, float*, uint64_t, float*, uint64_t, uint64_t);
+    float sum(float*, uint64_t);
+    float sum_scheduled(float*, uint64_t);
+    void thirds(uint32_t*, uint64_t, uint32_t);
+    void thirds_scheduled(uint32_t*, uint64_t, uint32_t);
+    uint32_t first_only(uint32_t, uint32_t);
+    uint32_t first_only_scheduled(uint32_t, uint32_t);
+    void count_near_max(uint32_t*, uint64_t, int32_t, int32_t);
+    void count_near_max_scheduled(uint32_t*, uint64_t, int32_t, int32_t);
+    void count_near_max_split(uint32_t*, uint64_t, int32_t, int32_t);
+    void count_near_max_unrolled(uint32_t*, uint64_t, int32_t, int32_t);
+}
+
+//each scheduled function has to give exactly what the one it was copied
+//from gives, floating point rounding included
+int main() {
+    bool ok = true;
+    //lengths that don't divide evenly by the split factors
+    for (size_t length: {1, 5, 64, 1001, 4099}) {
+        std::vector<float> x(length), plain(length), vectorized(length), unrolled(length);
+        for (size_t i = 0; i < length; i++) {
+            x[i] = 1.0f / (i + 1);
+            plain[i] = vectorized[i] = unrolled[i] = i * 0.25f;
+        }
+        axpy(plain.data(), length, x.data(), length, 3);
+        axpy_vectorized(vectorized.data(), length, x.data(), length, 3);
+        axpy_unrolled(unrolled.data(), length, x.data(), length, 3);
+        ok = ok && plain == vectorized && plain == unrolled;
+        for (size_t i = 0; i < length; i++) {
+            ok = ok && plain[i] == 3 * x[i] + i * 0.25f;
+        }
+        ok = ok && sum(x.data(), length) == sum_scheduled(x.data(), length);
+    }
+
+    for (uint64_t width: {1, 15, 16, 70}) {
+        std::vector<uint16_t> plain(width * 9), scheduled(width * 9);
+        for (size_t i = 0; i < plain.size(); i++) {
+            plain[i] = scheduled[i] = i * 31;
+        }
+        brighten(plain.data(), plain.size(), width, 1000);
+        brighten_scheduled(scheduled.data(), scheduled.size(), width, 1000);
+        ok = ok && plain == scheduled;
+        for (size_t i = 0; i < plain.size(); i++) {
+            ok = ok && plain[i] == static_cast<uint16_t>(i * 31 + 1000);
+        }
+    }
+
+    for (uint64_t width: {1, 13, 40}) {
+        for (uint64_t height: {1, 7, 33}) {
+            std::vector<uint64_t> in(width * height);
+            for (size_t i = 0; i < in.size(); i++) {
+                in[i] = i * 7;
+            }
+            std::vector<uint64_t> plain(in.size()), tiled(in.size()), reordered(in.size());
+            transpose(plain.data(), plain.size(), in.data(), in.size(), width, height);
+            transpose_tiled(tiled.data(), tiled.size(), in.data(), in.size(), width, height);
+            transpose_reordered(reordered.data(), reordered.size(), in.data(), in.size(), width, height);
+            ok = ok && plain == tiled && plain == reordered;
+            for (uint64_t y = 0; y < height; y++) {
+                for (uint64_t x = 0; x < width; x++) {
+                    ok = ok && plain[x * height + y] == in[y * width + x] + y;
+                }
+            }
+        }
+    }
+
+    for (uint64_t n: {1, 3, 24, 37}) {
+        std::vector<float> a(n * n), b(n * n), plain(n * n, 1), scheduled(n * n, 1);
+        for (size_t i = 0; i < a.size(); i++) {
+            a[i] = 1.0f / (i % 17 + 1);
+            b[i] = i % 5 + 0.5f;
+        }
+        matmul(plain.data(), n * n, a.data(), n * n, b.data(), n * n, n);
+        matmul_scheduled(scheduled.data(), n * n, a.data(), n * n, b.data(), n * n, n);
+        ok = ok && plain == scheduled;
+    }
+
+    for (uint32_t last: {1, 2, 15, 44, 100, 301}) {
+        std::vector<uint32_t> plain(last + 1, 1), scheduled(last + 1, 1);
+        thirds(plain.data(), plain.size(), last);
+        thirds_scheduled(scheduled.data(), scheduled.size(), last);
+        ok = ok && plain == scheduled;
+        for (uint32_t i = 0; i <= last; i++) {
+            ok = ok && plain[i] == (i % 3 == 1 ? i * 2 : 1);
+        }
+    }
+
+    //kl loops test their condition after the first iteration, so a loop
+    //that starts past its bound still runs once, however it's scheduled
+    for (uint32_t start: {0, 3, 9, 10, 20}) {
+        for (uint32_t bound: {0, 1, 4, 9, 10, 11}) {
+            uint32_t runs = start < bound ? bound - start : 1;
+            ok = ok && first_only(start, bound) == runs && first_only_scheduled(start, bound) == runs;
+        }
+    }
+
+    //the last blocks of a split loop bounded near the type's largest value
+    //end past it, and have to stop at the bound rather than wrap around,
+    //whether the loop of blocks runs in parallel, serially or unrolled
+    int32_t bound = 0x7ffffff0;
+    for (int32_t start: {bound - 622, bound - 640, bound - 63, bound - 1}) {
+        std::vector<uint32_t> plain(bound - start), scheduled(bound - start), split(bound - start), unrolled(bound - start);
+        count_near_max(plain.data(), plain.size(), start, bound);
+        count_near_max_scheduled(scheduled.data(), scheduled.size(), start, bound);
+        count_near_max_split(split.data(), split.size(), start, bound);
+        count_near_max_unrolled(unrolled.data(), unrolled.size(), start, bound);
+        ok = ok && plain == scheduled && plain == split && plain == unrolled &&
+            plain == std::vector<uint32_t>(plain.size(), 1);
+    }
+    printf("schedules %s\n", ok ? "match" : "don't match");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+#include <cstdint>
+#include <cstdio>
+
+extern "C" {
+    void saxpy(float, float*, uint64_t, float*, uint64_t);
+    void clamp(float*, uint64_t, float);
+    void divide(int32_t*, uint64_t, int32_t*, uint64_t);
+    void signs(float*, uint64_t, uint32_t*, uint64_t);
+    void lookup(uint32_t*, uint64_t, uint64_t*, uint64_t, uint32_t*, uint64_t);
+    void evens(uint64_t*, uint64_t, uint64_t);
+    void once(uint64_t*, uint64_t, uint64_t, uint64_t);
+    uint32_t spread(uint32_t);
+}
+
+int main() {
+    bool ok = true;
+    //lengths that aren't a multiple of the lanes, so the scalar loop runs too
+    float x[19], y[19];
+    for (int i = 0; i < 19; i++) {
+        x[i] = i;
+        y[i] = 1;
+    }
+    saxpy(2, x, 19, y, 19);
+    for (int i = 0; i < 19; i++) {
+        ok = ok && y[i] == 2 * i + 1;
+    }
+    clamp(x, 19, 10.5f);
+    for (int i = 0; i < 19; i++) {
+        ok = ok && x[i] == (i < 10.5f ? 10.5f : i);
+    }
+    int32_t n[11] = {7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17};
+    int32_t d[11] = {2, 0, 3, 0, 4, 0, 5, 0, 6, 0, 7};
+    divide(n, 11, d, 11);
+    for (int i = 0; i < 11; i++) {
+        ok = ok && n[i] == (i % 2 ? 0 : (7 + i) / (2 + i / 2));
+    }
+    float s[6] = {1, -1, 0, 2, -2, 0};
+    uint32_t sign[6];
+    signs(s, 6, sign, 6);
+    ok = ok && sign[0] == 1 && sign[1] == 2 && sign[2] == 0 && sign[3] == 1 && sign[4] == 2 && sign[5] == 0;
+    uint32_t table[5] = {10, 11, 12, 13, 14};
+    uint64_t indices[7] = {4, 0, 3, 3, 1, 2, 0};
+    uint32_t looked_up[7];
+    lookup(table, 5, indices, 7, looked_up, 7);
+    for (int i = 0; i < 7; i++) {
+        ok = ok && looked_up[i] == table[indices[i]];
+    }
+    uint64_t e[21] = {};
+    evens(e, 21, 20);
+    for (int i = 0; i < 21; i++) {
+        ok = ok && e[i] == (i % 2 ? 0 : 3 * i);
+    }
+    //a for loop runs once even when the condition starts out false
+    uint64_t o[4] = {};
+    once(o, 4, 2, 1);
+    ok = ok && o[0] == 0 && o[1] == 0 && o[2] == 1 && o[3] == 0;
+    once(o, 4, 0, 3);
+    ok = ok && o[0] == 1 && o[1] == 1 && o[2] == 1 && o[3] == 0;
+    ok = ok && spread(3) == 390;
+    printf("simd for loops %s\n", ok ? "match" : "don't match");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,28 @@
+#include <cstdint>
+#include <cstdio>
+
+typedef float f32x4 __attribute__((vector_size(16)));
+typedef int32_t i32x4 __attribute__((vector_size(16)));
+typedef uint8_t u8x16 __attribute__((vector_size(16)));
+
+extern "C" {
+    f32x4 axpy(float, f32x4, f32x4);
+    float reduce(f32x4);
+    int32_t lanes(i32x4);
+    bool all_below(u8x16, uint8_t);
+    uint32_t wide(uint32_t);
+}
+
+int main() {
+    f32x4 a = axpy(2, f32x4{1, 2, 3, 4}, f32x4{1, 1, 1, 1});
+    u8x16 below = {5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5};
+    u8x16 above = below;
+    above[9] = 9;
+    bool ok = a[0] == 3 && a[1] == 5 && a[2] == 7 && a[3] == 9
+        && reduce(f32x4{1, 2, 3, 4}) == 150
+        && lanes(i32x4{1, 2, 3, 4}) == 200
+        && all_below(below, 6) && !all_below(above, 6)
+        && wide(10) == 1116;
+    printf("vectors %s\n", ok ? "match" : "don't match");
+    return ok ? 0 : 1;
+}